@@ -157,6 +157,8 @@ static struct {
 		offsetof(struct ctdb_tunable_list, ip_alloc_algorithm) },
 	{ "AllowMixedVersions", 0, false,
 		offsetof(struct ctdb_tunable_list, allow_mixed_versions) },
+	{ "LockHelperPoolSize", 16, false,
+		offsetof(struct ctdb_tunable_list, lock_helper_pool_size) },
 	{ .obsolete = true, }
 };
 
@@ -162,25 +162,27 @@ struct ctdb_daemon_data {
 			ctdb_db->statistics.counter--;					\
 	}
 
-#define CTDB_UPDATE_RECLOCK_LATENCY(ctdb, name, counter, value) \
+#define CTDB_UPDATE_LATENCY_COUNTER(lc, value)					\
 	{										\
-		if (value > ctdb->statistics.counter.max)				\
-			ctdb->statistics.counter.max = value;				\
-		if (value > ctdb->statistics_current.counter.max)			\
-			ctdb->statistics_current.counter.max = value;			\
-											\
-		if (ctdb->statistics.counter.num == 0 ||				\
-		    value < ctdb->statistics.counter.min)				\
-			ctdb->statistics.counter.min = value;				\
-		if (ctdb->statistics_current.counter.num == 0 ||			\
-		    value < ctdb->statistics_current.counter.min)			\
-			ctdb->statistics_current.counter.min = value;			\
+		if (value > (lc).max)							\
+			(lc).max = value;						\
+		if ((lc).num == 0 || value < (lc).min)					\
+			(lc).min = value;						\
 											\
-		ctdb->statistics.counter.total += value;				\
-		ctdb->statistics_current.counter.total += value;			\
-											\
-		ctdb->statistics.counter.num++;						\
-		ctdb->statistics_current.counter.num++;					\
+		(lc).total += value;							\
+		(lc).num++;								\
+		(lc).buckets[ctdb_latency_bucket(value)]++;				\
+	}
+
+#define CTDB_UPDATE_STAT_LATENCY(ctdb, counter, value) \
+	{										\
+		CTDB_UPDATE_LATENCY_COUNTER(ctdb->statistics.counter, value);		\
+		CTDB_UPDATE_LATENCY_COUNTER(ctdb->statistics_current.counter, value);	\
+	}
+
+#define CTDB_UPDATE_RECLOCK_LATENCY(ctdb, name, counter, value) \
+	{										\
+		CTDB_UPDATE_STAT_LATENCY(ctdb, counter, value);				\
 											\
 		if (ctdb->tunable.reclock_latency_ms != 0) {				\
 			if (value*1000 > ctdb->tunable.reclock_latency_ms) {		\
@@ -193,14 +195,7 @@ struct ctdb_daemon_data {
 
 #define CTDB_UPDATE_DB_LATENCY(ctdb_db, operation, counter, value)			\
 	{										\
-		if (value > ctdb_db->statistics.counter.max)				\
-			ctdb_db->statistics.counter.max = value;			\
-		if (ctdb_db->statistics.counter.num == 0 || 				\
-		    value < ctdb_db->statistics.counter.min)				\
-			ctdb_db->statistics.counter.min = value;			\
-											\
-		ctdb_db->statistics.counter.total += value;				\
-		ctdb_db->statistics.counter.num++;					\
+		CTDB_UPDATE_LATENCY_COUNTER(ctdb_db->statistics.counter, value);	\
 											\
 		if (ctdb_db->ctdb->tunable.log_latency_ms != 0) {			\
 			if (value*1000 > ctdb_db->ctdb->tunable.log_latency_ms) {	\
@@ -215,23 +210,7 @@ struct ctdb_daemon_data {
 	{										\
 		double l = timeval_elapsed(&t);						\
 											\
-		if (l > ctdb->statistics.counter.max)					\
-			ctdb->statistics.counter.max = l;				\
-		if (l > ctdb->statistics_current.counter.max)				\
-			ctdb->statistics_current.counter.max = l;			\
-											\
-		if (ctdb->statistics.counter.num == 0 ||				\
-		    l < ctdb->statistics.counter.min)					\
-			ctdb->statistics.counter.min = l;				\
-		if (ctdb->statistics_current.counter.num == 0 ||			\
-		    l < ctdb->statistics_current.counter.min)				\
-			ctdb->statistics_current.counter.min = l;			\
-											\
-		ctdb->statistics.counter.total += l;					\
-		ctdb->statistics_current.counter.total += l;				\
-											\
-		ctdb->statistics.counter.num++;						\
-		ctdb->statistics_current.counter.num++;					\
+		CTDB_UPDATE_STAT_LATENCY(ctdb, counter, l);				\
 											\
 		if (ctdb->tunable.log_latency_ms != 0) {				\
 			if (l*1000 > ctdb->tunable.log_latency_ms) {			\
@@ -338,6 +317,8 @@ struct ctdb_context {
 	/* Used for locking record/db/alldb */
 	struct lock_context *lock_current;
 	struct lock_context *lock_pending;
+	struct lock_helper *lock_helpers;
+	uint32_t lock_num_helpers;
 };
 
 struct ctdb_db_context {
@@ -191,6 +191,8 @@ struct ctdb_db_statistics_old {
 	struct {
 		struct ctdb_latency_counter latency;
 	} vacuum;
+	struct ctdb_latency_counter call_latency;
+	struct ctdb_latency_counter migration_latency;
 	uint32_t db_ro_delegations;
 	uint32_t db_ro_revokes;
 	uint32_t hop_count_bucket[MAX_COUNT_BUCKETS];
@@ -380,11 +380,19 @@ enum ctdb_controls {CTDB_CONTROL_PROCESS_EXISTS          = 0,
 #define MAX_COUNT_BUCKETS 16
 #define MAX_HOT_KEYS      10
 
+/*
+ * Latency histogram buckets are log-linear with two buckets per power of
+ * two microseconds.  The last bucket also counts everything above it.
+ * See ctdb_latency_bucket().
+ */
+#define MAX_LATENCY_BUCKETS 48
+
 struct ctdb_latency_counter {
 	int num;
 	double min;
 	double max;
 	double total;
+	uint32_t buckets[MAX_LATENCY_BUCKETS];
 };
 
 struct ctdb_statistics {
@@ -446,6 +454,12 @@ struct ctdb_statistics {
 	struct timeval statistics_current_time;
 	uint32_t total_ro_delegations;
 	uint32_t total_ro_revokes;
+	struct ctdb_latency_counter control_latency;
+	struct ctdb_latency_counter migration_latency;
+	struct {
+		struct ctdb_latency_counter freeze;
+		struct ctdb_latency_counter total;
+	} recovery;
 };
 
 #define INVALID_GENERATION 1
@@ -658,6 +672,7 @@ struct ctdb_tunable_list {
 	uint32_t queue_buffer_size;
 	uint32_t ip_alloc_algorithm;
 	uint32_t allow_mixed_versions;
+	uint32_t lock_helper_pool_size;
 };
 
 struct ctdb_tickle_list {
@@ -828,6 +843,8 @@ struct ctdb_db_statistics {
 	struct {
 		struct ctdb_latency_counter latency;
 	} vacuum;
+	struct ctdb_latency_counter call_latency;
+	struct ctdb_latency_counter migration_latency;
 	uint32_t db_ro_delegations;
 	uint32_t db_ro_revokes;
 	uint32_t hop_count_bucket[MAX_COUNT_BUCKETS];
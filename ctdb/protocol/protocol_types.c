@@ -121,13 +121,15 @@ size_t ctdb_latency_counter_len(struct ctdb_latency_counter *in)
 		ctdb_padding_len(4) +
 		ctdb_double_len(&in->min) +
 		ctdb_double_len(&in->max) +
-		ctdb_double_len(&in->total);
+		ctdb_double_len(&in->total) +
+		MAX_LATENCY_BUCKETS * ctdb_uint32_len(&in->buckets[0]);
 }
 
 void ctdb_latency_counter_push(struct ctdb_latency_counter *in, uint8_t *buf,
 			       size_t *npush)
 {
 	size_t offset = 0, np;
+	int i;
 
 	ctdb_int32_push(&in->num, buf+offset, &np);
 	offset += np;
@@ -144,6 +146,11 @@ void ctdb_latency_counter_push(struct ctdb_latency_counter *in, uint8_t *buf,
 	ctdb_double_push(&in->total, buf+offset, &np);
 	offset += np;
 
+	for (i=0; i<MAX_LATENCY_BUCKETS; i++) {
+		ctdb_uint32_push(&in->buckets[i], buf+offset, &np);
+		offset += np;
+	}
+
 	*npush = offset;
 }
 
@@ -151,7 +158,7 @@ int ctdb_latency_counter_pull(uint8_t *buf, size_t buflen,
 			      struct ctdb_latency_counter *out, size_t *npull)
 {
 	size_t offset = 0, np;
-	int ret;
+	int ret, i;
 
 	ret = ctdb_int32_pull(buf+offset, buflen-offset, &out->num, &np);
 	if (ret != 0) {
@@ -183,6 +190,15 @@ int ctdb_latency_counter_pull(uint8_t *buf, size_t buflen,
 	}
 	offset += np;
 
+	for (i=0; i<MAX_LATENCY_BUCKETS; i++) {
+		ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+				       &out->buckets[i], &np);
+		if (ret != 0) {
+			return ret;
+		}
+		offset += np;
+	}
+
 	*npull = offset;
 	return 0;
 }
@@ -240,7 +256,11 @@ size_t ctdb_statistics_len(struct ctdb_statistics *in)
 		ctdb_timeval_len(&in->statistics_start_time) +
 		ctdb_timeval_len(&in->statistics_current_time) +
 		ctdb_uint32_len(&in->total_ro_delegations) +
-		ctdb_uint32_len(&in->total_ro_revokes);
+		ctdb_uint32_len(&in->total_ro_revokes) +
+		ctdb_latency_counter_len(&in->control_latency) +
+		ctdb_latency_counter_len(&in->migration_latency) +
+		ctdb_latency_counter_len(&in->recovery.freeze) +
+		ctdb_latency_counter_len(&in->recovery.total);
 }
 
 void ctdb_statistics_push(struct ctdb_statistics *in, uint8_t *buf,
@@ -406,6 +426,18 @@ void ctdb_statistics_push(struct ctdb_statistics *in, uint8_t *buf,
 	ctdb_uint32_push(&in->total_ro_revokes, buf+offset, &np);
 	offset += np;
 
+	ctdb_latency_counter_push(&in->control_latency, buf+offset, &np);
+	offset += np;
+
+	ctdb_latency_counter_push(&in->migration_latency, buf+offset, &np);
+	offset += np;
+
+	ctdb_latency_counter_push(&in->recovery.freeze, buf+offset, &np);
+	offset += np;
+
+	ctdb_latency_counter_push(&in->recovery.total, buf+offset, &np);
+	offset += np;
+
 	*npush = offset;
 }
 
@@ -774,6 +806,34 @@ static int ctdb_statistics_pull_elems(uint8_t *buf, size_t buflen,
 	}
 	offset += np;
 
+	ret = ctdb_latency_counter_pull(buf+offset, buflen-offset,
+					&out->control_latency, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_latency_counter_pull(buf+offset, buflen-offset,
+					&out->migration_latency, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_latency_counter_pull(buf+offset, buflen-offset,
+					&out->recovery.freeze, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_latency_counter_pull(buf+offset, buflen-offset,
+					&out->recovery.total, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
 	*npull = offset;
 	return 0;
 }
@@ -2624,7 +2684,8 @@ size_t ctdb_tunable_list_len(struct ctdb_tunable_list *in)
 		ctdb_uint32_len(&in->rec_buffer_size_limit) +
 		ctdb_uint32_len(&in->queue_buffer_size) +
 		ctdb_uint32_len(&in->ip_alloc_algorithm) +
-		ctdb_uint32_len(&in->allow_mixed_versions);
+		ctdb_uint32_len(&in->allow_mixed_versions) +
+		ctdb_uint32_len(&in->lock_helper_pool_size);
 }
 
 void ctdb_tunable_list_push(struct ctdb_tunable_list *in, uint8_t *buf,
@@ -2818,6 +2879,9 @@ void ctdb_tunable_list_push(struct ctdb_tunable_list *in, uint8_t *buf,
 	ctdb_uint32_push(&in->allow_mixed_versions, buf+offset, &np);
 	offset += np;
 
+	ctdb_uint32_push(&in->lock_helper_pool_size, buf+offset, &np);
+	offset += np;
+
 	*npush = offset;
 }
 
@@ -3263,6 +3327,13 @@ static int ctdb_tunable_list_pull_elems(uint8_t *buf, size_t buflen,
 	}
 	offset += np;
 
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->lock_helper_pool_size, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
 	*npull = offset;
 	return 0;
 }
@@ -4552,6 +4623,8 @@ size_t ctdb_db_statistics_len(struct ctdb_db_statistics *in)
 		MAX_COUNT_BUCKETS *
 			ctdb_uint32_len(&in->locks.buckets[0]) +
 		ctdb_latency_counter_len(&in->vacuum.latency) +
+		ctdb_latency_counter_len(&in->call_latency) +
+		ctdb_latency_counter_len(&in->migration_latency) +
 		ctdb_uint32_len(&in->db_ro_delegations) +
 		ctdb_uint32_len(&in->db_ro_revokes) +
 		MAX_COUNT_BUCKETS *
@@ -4599,6 +4672,12 @@ void ctdb_db_statistics_push(struct ctdb_db_statistics *in, uint8_t *buf,
 	ctdb_latency_counter_push(&in->vacuum.latency, buf+offset, &np);
 	offset += np;
 
+	ctdb_latency_counter_push(&in->call_latency, buf+offset, &np);
+	offset += np;
+
+	ctdb_latency_counter_push(&in->migration_latency, buf+offset, &np);
+	offset += np;
+
 	ctdb_uint32_push(&in->db_ro_delegations, buf+offset, &np);
 	offset += np;
 
@@ -4695,6 +4774,20 @@ static int ctdb_db_statistics_pull_elems(uint8_t *buf, size_t buflen,
 	}
 	offset += np;
 
+	ret = ctdb_latency_counter_pull(buf+offset, buflen-offset,
+					&out->call_latency, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_latency_counter_pull(buf+offset, buflen-offset,
+					&out->migration_latency, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
 	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
 			       &out->db_ro_delegations, &np);
 	if (ret != 0) {
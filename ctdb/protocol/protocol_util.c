@@ -114,6 +114,65 @@ enum ctdb_event ctdb_event_from_string(const char *event_str)
 	return CTDB_EVENT_MAX;
 }
 
+/*
+ * Map a latency in seconds to a histogram bucket.
+ *
+ * Latencies are rounded to microseconds.  Below 2us there is one bucket
+ * per microsecond.  Above that, each power of two is split into two
+ * buckets, giving a relative error of at most 50%.  Latencies beyond
+ * the range are counted in the last bucket.
+ */
+unsigned int ctdb_latency_bucket(double latency)
+{
+	uint64_t usec;
+	unsigned int msb, bucket;
+
+	if (latency < 0) {
+		return 0;
+	}
+	if (latency >= 1.0e9) {
+		return MAX_LATENCY_BUCKETS - 1;
+	}
+
+	usec = (uint64_t)(latency * 1000000 + 0.5);
+	if (usec < 2) {
+		return usec;
+	}
+
+	msb = 0;
+	while ((usec >> (msb+1)) != 0) {
+		msb += 1;
+	}
+
+	bucket = 2 * msb + ((usec >> (msb-1)) & 1);
+	if (bucket >= MAX_LATENCY_BUCKETS) {
+		bucket = MAX_LATENCY_BUCKETS - 1;
+	}
+
+	return bucket;
+}
+
+/*
+ * Return the upper limit (exclusive) of a histogram bucket in
+ * microseconds.  The last bucket has no upper limit and UINT64_MAX is
+ * returned.
+ */
+uint64_t ctdb_latency_bucket_limit(unsigned int bucket)
+{
+	unsigned int msb;
+
+	if (bucket >= MAX_LATENCY_BUCKETS - 1) {
+		return UINT64_MAX;
+	}
+
+	if (bucket < 2) {
+		return bucket + 1;
+	}
+
+	msb = bucket / 2;
+	return (uint64_t)(3 + bucket % 2) << (msb - 1);
+}
+
 int ctdb_sock_addr_to_buf(char *buf, socklen_t buflen,
 			  ctdb_sock_addr *addr, bool with_port)
 {
@@ -30,6 +30,9 @@ enum ctdb_runstate ctdb_runstate_from_string(const char *runstate_str);
 const char *ctdb_event_to_string(enum ctdb_event event);
 enum ctdb_event ctdb_event_from_string(const char *event_str);
 
+unsigned int ctdb_latency_bucket(double latency);
+uint64_t ctdb_latency_bucket_limit(unsigned int bucket);
+
 /*
  * buflen must be long enough to hold the longest possible "address:port".
  * For example, 1122:3344:5566:7788:99aa:bbcc:ddee:ff00:12345.
@@ -29,11 +29,13 @@
 #include "lib/util/debug.h"
 #include "lib/util/samba_util.h"
 #include "lib/util/talloc_report.h"
+#include "lib/util/time.h"
 
 #include "ctdb_private.h"
 #include "ctdb_client.h"
 
 #include "protocol/protocol_private.h"
+#include "protocol/protocol_util.h"
 
 #include "common/reqid.h"
 #include "common/common.h"
@@ -798,17 +800,25 @@ void ctdb_request_control(struct ctdb_context *ctdb, struct ctdb_req_header *hdr
 	int32_t status;
 	bool async_reply = false;
 	const char *errormsg = NULL;
+	struct timeval start_time;
 
 	data.dptr = &c->data[0];
 	data.dsize = c->datalen;
 
 	outdata = talloc_zero(c, TDB_DATA);
 
+	start_time = timeval_current();
+
 	status = ctdb_control_dispatch(ctdb, c, data, outdata, hdr->srcnode, 
 				       &errormsg, &async_reply);
 
 	if (!async_reply) {
+		double l;
+
 		ctdb_request_control_reply(ctdb, c, outdata, status, errormsg);
+
+		l = timeval_elapsed(&start_time);
+		CTDB_UPDATE_STAT_LATENCY(ctdb, control_latency, l);
 	}
 }
 
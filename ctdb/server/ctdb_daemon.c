@@ -40,6 +40,8 @@
 #include "ctdb_private.h"
 #include "ctdb_client.h"
 
+#include "protocol/protocol_util.h"
+
 #include "common/rb_tree.h"
 #include "common/reqid.h"
 #include "common/system.h"
@@ -436,6 +438,9 @@ struct daemon_call_state {
 	/* readonly request ? */
 	uint32_t readonly_fetch;
 	uint32_t client_callid;
+
+	/* record had to be fetched from another node ? */
+	bool migrate;
 };
 
 /* 
@@ -450,6 +455,7 @@ static void daemon_call_from_client_callback(struct ctdb_call_state *state)
 	uint32_t length;
 	struct ctdb_client *client = dstate->client;
 	struct ctdb_db_context *ctdb_db = state->ctdb_db;
+	double latency;
 
 	talloc_steal(client, dstate);
 	talloc_steal(dstate, dstate->call);
@@ -506,6 +512,14 @@ static void daemon_call_from_client_callback(struct ctdb_call_state *state)
 		DEBUG(DEBUG_ERR, (__location__ " Failed to queue packet from daemon to client\n"));
 	}
 	CTDB_UPDATE_LATENCY(client->ctdb, ctdb_db, "call_from_client_cb 3", call_latency, dstate->start_time);
+	latency = timeval_elapsed(&dstate->start_time);
+	CTDB_UPDATE_LATENCY_COUNTER(ctdb_db->statistics.call_latency, latency);
+	if (dstate->migrate) {
+		CTDB_UPDATE_STAT_LATENCY(client->ctdb, migration_latency,
+					 latency);
+		CTDB_UPDATE_LATENCY_COUNTER(
+			ctdb_db->statistics.migration_latency, latency);
+	}
 	CTDB_DECREMENT_STAT(client->ctdb, pending_calls);
 	talloc_free(dstate);
 }
@@ -888,6 +902,7 @@ static void daemon_request_call_from_client(struct ctdb_client *client,
 	}
 
 	dstate->readonly_fetch = 0;
+	dstate->migrate = false;
 	call->call_id = c->callid;
 	call->key = key;
 	call->call_data.dptr = c->data + c->keylen;
@@ -909,6 +924,7 @@ static void daemon_request_call_from_client(struct ctdb_client *client,
 		state = ctdb_call_local_send(ctdb_db, call, &header, &data);
 	} else {
 		state = ctdb_daemon_call_send_remote(ctdb_db, call, &header);
+		dstate->migrate = (dstate->readonly_fetch == 0);
 		if (ctdb->tunable.fetch_collapse == 1) {
 			/* This request triggered a remote fetch-lock.
 			   set up a deferral for this key so any additional
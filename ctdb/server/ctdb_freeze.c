@@ -27,9 +27,12 @@
 #include "lib/tdb_wrap/tdb_wrap.h"
 #include "lib/util/dlinklist.h"
 #include "lib/util/debug.h"
+#include "lib/util/time.h"
 
 #include "ctdb_private.h"
 
+#include "protocol/protocol_util.h"
+
 #include "common/rb_tree.h"
 #include "common/common.h"
 #include "common/logging.h"
@@ -120,6 +123,7 @@ struct ctdb_db_freeze_handle {
 	struct ctdb_db_context *ctdb_db;
 	struct lock_request *lreq;
 	struct ctdb_db_freeze_waiter *waiters;
+	struct timeval start_time;
 };
 
 /**
@@ -173,6 +177,9 @@ static void ctdb_db_freeze_handler(void *private_data, bool locked)
 
 	h->ctdb_db->freeze_mode = CTDB_FREEZE_FROZEN;
 
+	CTDB_UPDATE_LATENCY(h->ctdb_db->ctdb, h->ctdb_db, "freeze",
+			    recovery.freeze, h->start_time);
+
 	/* notify the waiters */
 	while ((w = h->waiters) != NULL) {
 		w->status = 0;
@@ -204,6 +211,7 @@ static void ctdb_start_db_freeze(struct ctdb_db_context *ctdb_db)
 	CTDB_NO_MEMORY_FATAL(ctdb_db->ctdb, h);
 
 	h->ctdb_db = ctdb_db;
+	h->start_time = timeval_current();
 	h->lreq = ctdb_lock_db(h, ctdb_db, false, ctdb_db_freeze_handler, h);
 	CTDB_NO_MEMORY_FATAL(ctdb_db->ctdb, h->lreq);
 	talloc_set_destructor(h, ctdb_db_freeze_handle_destructor);
@@ -32,17 +32,21 @@
 
 #include "ctdb_private.h"
 
+#include "protocol/protocol_util.h"
+
 #include "common/common.h"
 #include "common/logging.h"
 
 /*
  * Non-blocking Locking API
  *
- * 1. Create a child process to do blocking locks.
- * 2. Once the locks are obtained, signal parent process via fd.
+ * 1. Hand the lock request to a lock helper process to do blocking locks.
+ * 2. Once the locks are obtained, the helper signals parent process via fd.
  * 3. Invoke registered callback routine with locking status.
- * 4. If the child process cannot get locks within certain time,
+ * 4. If the helper cannot get locks within certain time,
  *    execute an external script to debug.
+ * 5. When the lock is released, the helper drops the lock and is
+ *    returned to a pool of idle helpers for reuse.
  *
  * ctdb_lock_record()      - get a lock on a record
  * ctdb_lock_db()          - get a lock on a DB
@@ -65,6 +69,7 @@ static const char * const lock_type_str[] = {
 };
 
 struct lock_request;
+struct lock_helper;
 
 /* lock_context is the common part for a lock request */
 struct lock_context {
@@ -76,9 +81,7 @@ struct lock_context {
 	uint32_t priority;
 	bool auto_mark;
 	struct lock_request *request;
-	pid_t child;
-	int fd[2];
-	struct tevent_fd *tfd;
+	struct lock_helper *helper;
 	struct tevent_timer *ttimer;
 	struct timeval start_time;
 	uint32_t key_hash;
@@ -92,6 +95,22 @@ struct lock_request {
 	void *private_data;
 };
 
+/*
+ * lock_helper is a persistent ctdb_lock_helper process running in server
+ * mode.  Requests are written to req_fd and results are read from res_fd.
+ */
+struct lock_helper {
+	struct lock_helper *next, *prev;
+	struct ctdb_context *ctdb;
+	pid_t pid;
+	int req_fd;
+	int res_fd;
+	struct tevent_fd *tfd;
+	struct lock_context *lock_ctx;
+	bool waiting;
+	bool locked;
+};
+
 
 int ctdb_db_iterator(struct ctdb_context *ctdb, ctdb_db_handler_t handler,
 		     void *private_data)
@@ -182,17 +201,19 @@ int ctdb_lockdb_unmark(struct ctdb_db_context *ctdb_db)
 }
 
 static void ctdb_lock_schedule(struct ctdb_context *ctdb);
+static void lock_helper_release(struct lock_helper *helper);
 
 /*
- * Destructor to kill the child locking process
+ * Destructor to release the lock held by the helper process
  */
 static int ctdb_lock_context_destructor(struct lock_context *lock_ctx)
 {
 	if (lock_ctx->request) {
 		lock_ctx->request->lctx = NULL;
 	}
-	if (lock_ctx->child > 0) {
-		ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGTERM);
+	if (lock_ctx->helper != NULL) {
+		lock_helper_release(lock_ctx->helper);
+		lock_ctx->helper = NULL;
 		if (lock_ctx->type == LOCK_RECORD) {
 			DLIST_REMOVE(lock_ctx->ctdb_db->lock_current, lock_ctx);
 		} else {
@@ -320,35 +341,20 @@ static int lock_bucket_id(double t)
 }
 
 /*
- * Callback routine when the required locks are obtained.
+ * Called when the lock helper has obtained the required locks or failed.
  * Called from parent context
  */
-static void ctdb_lock_handler(struct tevent_context *ev,
-			    struct tevent_fd *tfd,
-			    uint16_t flags,
-			    void *private_data)
+static void ctdb_lock_result(struct lock_context *lock_ctx, bool locked)
 {
-	struct lock_context *lock_ctx;
-	char c;
-	bool locked;
 	double t;
 	int id;
 
-	lock_ctx = talloc_get_type_abort(private_data, struct lock_context);
-
 	/* cancel the timeout event */
 	TALLOC_FREE(lock_ctx->ttimer);
 
 	t = timeval_elapsed(&lock_ctx->start_time);
 	id = lock_bucket_id(t);
 
-	/* Read the status from the child process */
-	if (sys_read(lock_ctx->fd[0], &c, 1) != 1) {
-		locked = false;
-	} else {
-		locked = (c == 0 ? true : false);
-	}
-
 	/* Update statistics */
 	CTDB_INCREMENT_STAT(lock_ctx->ctdb, locks.num_calls);
 	CTDB_INCREMENT_DB_STAT(lock_ctx->ctdb_db, locks.num_calls);
@@ -575,7 +581,7 @@ skip_lock_debug:
 }
 
 static bool lock_helper_args(TALLOC_CTX *mem_ctx,
-			     struct lock_context *lock_ctx, int fd,
+			     struct lock_context *lock_ctx,
 			     int *argc, const char ***argv)
 {
 	const char **args = NULL;
@@ -583,50 +589,41 @@ static bool lock_helper_args(TALLOC_CTX *mem_ctx,
 
 	switch (lock_ctx->type) {
 	case LOCK_RECORD:
-		nargs = 6;
+		nargs = 4;
 		break;
 
 	case LOCK_DB:
-		nargs = 5;
+		nargs = 3;
 		break;
 	}
 
-	/* Add extra argument for null termination */
-	nargs++;
-
 	args = talloc_array(mem_ctx, const char *, nargs);
 	if (args == NULL) {
 		return false;
 	}
 
-	args[0] = talloc_asprintf(args, "%d", getpid());
-	args[1] = talloc_asprintf(args, "%d", fd);
-
 	switch (lock_ctx->type) {
 	case LOCK_RECORD:
-		args[2] = talloc_strdup(args, "RECORD");
-		args[3] = talloc_strdup(args, lock_ctx->ctdb_db->db_path);
-		args[4] = talloc_asprintf(args, "0x%x",
+		args[0] = talloc_strdup(args, "RECORD");
+		args[1] = talloc_strdup(args, lock_ctx->ctdb_db->db_path);
+		args[2] = talloc_asprintf(args, "0x%x",
 				tdb_get_flags(lock_ctx->ctdb_db->ltdb->tdb));
 		if (lock_ctx->key.dsize == 0) {
-			args[5] = talloc_strdup(args, "NULL");
+			args[3] = talloc_strdup(args, "NULL");
 		} else {
-			args[5] = hex_encode_talloc(args, lock_ctx->key.dptr, lock_ctx->key.dsize);
+			args[3] = hex_encode_talloc(args, lock_ctx->key.dptr, lock_ctx->key.dsize);
 		}
 		break;
 
 	case LOCK_DB:
-		args[2] = talloc_strdup(args, "DB");
-		args[3] = talloc_strdup(args, lock_ctx->ctdb_db->db_path);
-		args[4] = talloc_asprintf(args, "0x%x",
+		args[0] = talloc_strdup(args, "DB");
+		args[1] = talloc_strdup(args, lock_ctx->ctdb_db->db_path);
+		args[2] = talloc_asprintf(args, "0x%x",
 				tdb_get_flags(lock_ctx->ctdb_db->ltdb->tdb));
 		break;
 	}
 
-	/* Make sure last argument is NULL */
-	args[nargs-1] = NULL;
-
-	for (i=0; i<nargs-1; i++) {
+	for (i=0; i<nargs; i++) {
 		if (args[i] == NULL) {
 			talloc_free(args);
 			return false;
@@ -638,6 +635,262 @@ static bool lock_helper_args(TALLOC_CTX *mem_ctx,
 	return true;
 }
 
+/*
+ * Send a request to a lock helper running in server mode
+ *
+ * Request is a 32-bit length followed by NUL terminated arguments.
+ */
+static bool lock_helper_send(struct lock_helper *helper,
+			     int argc, const char **argv)
+{
+	uint8_t *buf;
+	uint32_t len = 0;
+	size_t offset, n;
+	ssize_t nwritten;
+	int i;
+
+	for (i=0; i<argc; i++) {
+		len += strlen(argv[i]) + 1;
+	}
+
+	buf = talloc_size(helper, sizeof(len) + len);
+	if (buf == NULL) {
+		return false;
+	}
+
+	memcpy(buf, &len, sizeof(len));
+	offset = sizeof(len);
+	for (i=0; i<argc; i++) {
+		n = strlen(argv[i]) + 1;
+		memcpy(buf+offset, argv[i], n);
+		offset += n;
+	}
+
+	n = 0;
+	while (n < offset) {
+		nwritten = sys_write(helper->req_fd, buf+n, offset-n);
+		if (nwritten <= 0) {
+			DEBUG(DEBUG_ERR, ("Failed to send request to lock "
+					  "helper %d\n", (int)helper->pid));
+			talloc_free(buf);
+			return false;
+		}
+		n += nwritten;
+	}
+
+	talloc_free(buf);
+	return true;
+}
+
+static int lock_helper_destructor(struct lock_helper *helper)
+{
+	if (helper->lock_ctx != NULL) {
+		helper->lock_ctx->helper = NULL;
+	}
+	if (helper->pid > 0) {
+		ctdb_kill(helper->ctdb, helper->pid, SIGTERM);
+	}
+	if (helper->req_fd != -1) {
+		close(helper->req_fd);
+	}
+	return 0;
+}
+
+static void lock_helper_dead(struct lock_helper *helper)
+{
+	struct ctdb_context *ctdb = helper->ctdb;
+
+	helper->pid = -1;
+	TALLOC_FREE(helper->tfd);
+
+	if (helper->lock_ctx == NULL) {
+		/* Idle helper */
+		DLIST_REMOVE(ctdb->lock_helpers, helper);
+		ctdb->lock_num_helpers--;
+		talloc_free(helper);
+	}
+}
+
+/*
+ * Callback routine when the lock helper replies.
+ * Called from parent context
+ */
+static void lock_helper_handler(struct tevent_context *ev,
+				struct tevent_fd *tfd,
+				uint16_t flags,
+				void *private_data)
+{
+	struct lock_helper *helper = talloc_get_type_abort(
+		private_data, struct lock_helper);
+	struct lock_context *lock_ctx = helper->lock_ctx;
+	char c;
+
+	/* Read the status from the helper process */
+	if (sys_read(helper->res_fd, &c, 1) != 1) {
+		DEBUG(DEBUG_INFO, ("Lock helper %d exited\n",
+				   (int)helper->pid));
+		lock_helper_dead(helper);
+		if (lock_ctx != NULL) {
+			ctdb_lock_result(lock_ctx, false);
+		}
+		return;
+	}
+
+	if (lock_ctx == NULL || !helper->waiting) {
+		DEBUG(DEBUG_ERR, ("Unexpected reply from lock helper %d\n",
+				  (int)helper->pid));
+		ctdb_kill(helper->ctdb, helper->pid, SIGTERM);
+		lock_helper_dead(helper);
+		return;
+	}
+
+	helper->waiting = false;
+	helper->locked = (c == 0 ? true : false);
+
+	ctdb_lock_result(lock_ctx, helper->locked);
+}
+
+static struct lock_helper *lock_helper_create(struct ctdb_context *ctdb,
+					      const char *prog)
+{
+	struct lock_helper *helper;
+	const char *args[5];
+	int req_fd[2], res_fd[2];
+	int ret;
+
+	helper = talloc_zero(ctdb, struct lock_helper);
+	if (helper == NULL) {
+		DEBUG(DEBUG_ERR, ("Failed to allocate lock helper\n"));
+		return NULL;
+	}
+	helper->ctdb = ctdb;
+	helper->pid = -1;
+	helper->req_fd = -1;
+	helper->res_fd = -1;
+
+	ret = pipe(req_fd);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR, ("Failed to create pipe for lock helper\n"));
+		talloc_free(helper);
+		return NULL;
+	}
+
+	ret = pipe(res_fd);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR, ("Failed to create pipe for lock helper\n"));
+		close(req_fd[0]);
+		close(req_fd[1]);
+		talloc_free(helper);
+		return NULL;
+	}
+
+	set_close_on_exec(req_fd[1]);
+	set_close_on_exec(res_fd[0]);
+	helper->req_fd = req_fd[1];
+	helper->res_fd = res_fd[0];
+	talloc_set_destructor(helper, lock_helper_destructor);
+
+	helper->tfd = tevent_add_fd(ctdb->ev, helper, res_fd[0],
+				    TEVENT_FD_READ, lock_helper_handler,
+				    helper);
+	if (helper->tfd == NULL) {
+		DEBUG(DEBUG_ERR, ("Failed to add lock helper fd handler\n"));
+		close(req_fd[0]);
+		close(res_fd[0]);
+		close(res_fd[1]);
+		talloc_free(helper);
+		return NULL;
+	}
+	tevent_fd_set_auto_close(helper->tfd);
+
+	if (! ctdb->do_setsched) {
+		ret = setenv("CTDB_NOSETSCHED", "1", 1);
+		if (ret != 0) {
+			DEBUG(DEBUG_WARNING,
+			      ("Failed to set CTDB_NOSETSCHED variable\n"));
+		}
+	}
+
+	args[0] = talloc_asprintf(helper, "%d", getpid());
+	args[1] = talloc_asprintf(helper, "%d", res_fd[1]);
+	args[2] = "SERVER";
+	args[3] = talloc_asprintf(helper, "%d", req_fd[0]);
+	/* Make sure last argument is NULL */
+	args[4] = NULL;
+	if (args[0] == NULL || args[1] == NULL || args[3] == NULL) {
+		DEBUG(DEBUG_ERR, ("Failed to create lock helper args\n"));
+		close(req_fd[0]);
+		close(res_fd[1]);
+		talloc_free(helper);
+		return NULL;
+	}
+
+	helper->pid = ctdb_vfork_exec(helper, ctdb, prog, 5, args);
+
+	close(req_fd[0]);
+	close(res_fd[1]);
+
+	if (helper->pid == -1) {
+		DEBUG(DEBUG_ERR, ("Failed to create lock helper\n"));
+		talloc_free(helper);
+		return NULL;
+	}
+
+	return helper;
+}
+
+/*
+ * Get an idle lock helper from the pool or create a new one
+ */
+static struct lock_helper *lock_helper_get(struct ctdb_context *ctdb,
+					   const char *prog)
+{
+	struct lock_helper *helper = ctdb->lock_helpers;
+
+	if (helper != NULL) {
+		DLIST_REMOVE(ctdb->lock_helpers, helper);
+		ctdb->lock_num_helpers--;
+		return helper;
+	}
+
+	return lock_helper_create(ctdb, prog);
+}
+
+/*
+ * Release the lock held by a helper and return it to the pool
+ *
+ * A helper still waiting for a lock cannot be interrupted, so it is
+ * terminated instead.
+ */
+static void lock_helper_release(struct lock_helper *helper)
+{
+	struct ctdb_context *ctdb = helper->ctdb;
+	const char *unlock = "UNLOCK";
+
+	helper->lock_ctx = NULL;
+
+	if (helper->pid == -1 || helper->waiting) {
+		talloc_free(helper);
+		return;
+	}
+
+	if (helper->locked) {
+		helper->locked = false;
+		if (! lock_helper_send(helper, 1, &unlock)) {
+			talloc_free(helper);
+			return;
+		}
+	}
+
+	if (ctdb->lock_num_helpers >= ctdb->tunable.lock_helper_pool_size) {
+		talloc_free(helper);
+		return;
+	}
+
+	DLIST_ADD(ctdb->lock_helpers, helper);
+	ctdb->lock_num_helpers++;
+}
+
 /*
  * Find a lock request that can be scheduled
  */
@@ -695,13 +948,14 @@ static struct lock_context *ctdb_find_lock_context(struct ctdb_context *ctdb)
 }
 
 /*
- * Schedule a new lock child process
- * Set up callback handler and timeout handler
+ * Schedule a lock request on a lock helper process
+ * Set up timeout handler
  */
 static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 {
 	struct lock_context *lock_ctx;
-	int ret, argc;
+	struct lock_helper *helper;
+	int argc;
 	TALLOC_CTX *tmp_ctx;
 	static char prog[PATH_MAX+1] = "";
 	const char **args;
@@ -720,57 +974,38 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 		return;
 	}
 
-	lock_ctx->child = -1;
-	ret = pipe(lock_ctx->fd);
-	if (ret != 0) {
-		DEBUG(DEBUG_ERR, ("Failed to create pipe in ctdb_lock_schedule\n"));
-		return;
-	}
-
-	set_close_on_exec(lock_ctx->fd[0]);
-
-	/* Create data for child process */
+	/* Create data for helper process */
 	tmp_ctx = talloc_new(lock_ctx);
 	if (tmp_ctx == NULL) {
 		DEBUG(DEBUG_ERR, ("Failed to allocate memory for helper args\n"));
-		close(lock_ctx->fd[0]);
-		close(lock_ctx->fd[1]);
 		return;
 	}
 
-	if (! ctdb->do_setsched) {
-		ret = setenv("CTDB_NOSETSCHED", "1", 1);
-		if (ret != 0) {
-			DEBUG(DEBUG_WARNING,
-			      ("Failed to set CTDB_NOSETSCHED variable\n"));
-		}
-	}
-
 	/* Create arguments for lock helper */
-	if (!lock_helper_args(tmp_ctx, lock_ctx, lock_ctx->fd[1],
-			      &argc, &args)) {
+	if (!lock_helper_args(tmp_ctx, lock_ctx, &argc, &args)) {
 		DEBUG(DEBUG_ERR, ("Failed to create lock helper args\n"));
-		close(lock_ctx->fd[0]);
-		close(lock_ctx->fd[1]);
 		talloc_free(tmp_ctx);
 		return;
 	}
 
-	lock_ctx->child = ctdb_vfork_exec(lock_ctx, ctdb, prog, argc,
-					  (const char **)args);
-	if (lock_ctx->child == -1) {
-		DEBUG(DEBUG_ERR, ("Failed to create a child in ctdb_lock_schedule\n"));
-		close(lock_ctx->fd[0]);
-		close(lock_ctx->fd[1]);
+	helper = lock_helper_get(ctdb, prog);
+	if (helper == NULL) {
 		talloc_free(tmp_ctx);
 		return;
 	}
 
-	/* Parent process */
-	close(lock_ctx->fd[1]);
+	if (!lock_helper_send(helper, argc, args)) {
+		talloc_free(helper);
+		talloc_free(tmp_ctx);
+		return;
+	}
 
 	talloc_free(tmp_ctx);
 
+	helper->lock_ctx = lock_ctx;
+	helper->waiting = true;
+	lock_ctx->helper = helper;
+
 	/* Set up timeout handler */
 	lock_ctx->ttimer = tevent_add_timer(ctdb->ev,
 					    lock_ctx,
@@ -778,27 +1013,10 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 					    ctdb_lock_timeout_handler,
 					    (void *)lock_ctx);
 	if (lock_ctx->ttimer == NULL) {
-		ctdb_kill(ctdb, lock_ctx->child, SIGTERM);
-		lock_ctx->child = -1;
-		close(lock_ctx->fd[0]);
-		return;
-	}
-
-	/* Set up callback */
-	lock_ctx->tfd = tevent_add_fd(ctdb->ev,
-				      lock_ctx,
-				      lock_ctx->fd[0],
-				      TEVENT_FD_READ,
-				      ctdb_lock_handler,
-				      (void *)lock_ctx);
-	if (lock_ctx->tfd == NULL) {
-		TALLOC_FREE(lock_ctx->ttimer);
-		ctdb_kill(ctdb, lock_ctx->child, SIGTERM);
-		lock_ctx->child = -1;
-		close(lock_ctx->fd[0]);
+		lock_ctx->helper = NULL;
+		lock_helper_release(helper);
 		return;
 	}
-	tevent_fd_set_auto_close(lock_ctx->tfd);
 
 	/* Move the context from pending to current */
 	if (lock_ctx->type == LOCK_RECORD) {
@@ -868,7 +1086,7 @@ static struct lock_request *ctdb_lock_internal(TALLOC_CTX *mem_ctx,
 	lock_ctx->auto_mark = auto_mark;
 
 	lock_ctx->request = request;
-	lock_ctx->child = -1;
+	lock_ctx->helper = NULL;
 
 	/* Non-record locks are required by recovery and should be scheduled
 	 * immediately, so keep them at the head of the pending queue.
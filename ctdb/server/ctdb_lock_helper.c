@@ -21,6 +21,7 @@
 #include "system/filesys.h"
 #include "system/network.h"
 #include "system/wait.h"
+#include "system/select.h"
 
 #include <talloc.h>
 #include <tevent.h>
@@ -81,6 +82,7 @@ static void usage(const char *progname)
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Usage: %s <ctdbd-pid> <output-fd> RECORD <db-path> <db-flags> <db-key>\n", progname);
 	fprintf(stderr, "       %s <ctdbd-pid> <output-fd> DB <db-path> <db-flags>\n", progname);
+	fprintf(stderr, "       %s <ctdbd-pid> <output-fd> SERVER <input-fd>\n", progname);
 }
 
 static uint8_t *hex_decode_talloc(TALLOC_CTX *mem_ctx,
@@ -251,6 +253,215 @@ static void cleanup(struct lock_state *state)
 	}
 }
 
+/*
+ * Server mode
+ *
+ * The helper reads lock requests from input-fd, one at a time.  Each
+ * request is a 32-bit length followed by NUL terminated strings:
+ *
+ *   RECORD <db-path> <db-flags> <db-key>
+ *   DB <db-path> <db-flags>
+ *   UNLOCK
+ *
+ * For RECORD and DB requests the result is written to output-fd as for
+ * the single-shot mode.  The lock is held until an UNLOCK request is
+ * received, after which the helper waits for the next request.  The
+ * helper exits when input-fd is closed or the parent goes away.
+ */
+
+#define LOCK_SERVER_MAX_REQUEST	(1024*1024)
+
+static bool server_wait_for_input(int fd, pid_t ppid)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLIN,
+	};
+	int ret;
+
+	while (true) {
+		ret = poll(&pfd, 1, 5000);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (ret > 0) {
+			return true;
+		}
+
+		if (ppid == 1 || (kill(ppid, 0) == -1 && errno == ESRCH)) {
+			return false;
+		}
+	}
+}
+
+static bool server_read(int fd, void *buf, size_t len)
+{
+	uint8_t *ptr = (uint8_t *)buf;
+	size_t offset = 0;
+	ssize_t n;
+
+	while (offset < len) {
+		n = sys_read(fd, ptr+offset, len-offset);
+		if (n <= 0) {
+			return false;
+		}
+		offset += n;
+	}
+
+	return true;
+}
+
+static int server_request(TALLOC_CTX *mem_ctx, int fd, pid_t ppid,
+			  int *argc, const char ***argv)
+{
+	const char **args;
+	uint32_t len;
+	char *buf;
+	int nargs, i;
+	uint32_t offset;
+
+	if (! server_wait_for_input(fd, ppid)) {
+		return EPIPE;
+	}
+
+	if (! server_read(fd, &len, sizeof(len))) {
+		return EPIPE;
+	}
+
+	if (len == 0 || len > LOCK_SERVER_MAX_REQUEST) {
+		return EINVAL;
+	}
+
+	buf = talloc_size(mem_ctx, len);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	if (! server_read(fd, buf, len)) {
+		talloc_free(buf);
+		return EPIPE;
+	}
+
+	if (buf[len-1] != '\0') {
+		talloc_free(buf);
+		return EINVAL;
+	}
+
+	nargs = 0;
+	for (offset=0; offset<len; offset++) {
+		if (buf[offset] == '\0') {
+			nargs += 1;
+		}
+	}
+
+	args = talloc_array(buf, const char *, nargs);
+	if (args == NULL) {
+		talloc_free(buf);
+		return ENOMEM;
+	}
+
+	offset = 0;
+	for (i=0; i<nargs; i++) {
+		args[i] = &buf[offset];
+		offset += strlen(args[i]) + 1;
+	}
+
+	*argc = nargs;
+	*argv = args;
+	return 0;
+}
+
+static void server_reply(int fd, char result)
+{
+	ssize_t n;
+
+	n = sys_write(fd, &result, 1);
+	if (n != 1) {
+		fprintf(stderr, "locking: Failed to send result\n");
+		exit(1);
+	}
+}
+
+static int lock_server(pid_t ppid, int write_fd, int read_fd)
+{
+	struct lock_state state = { 0 };
+	bool locked = false;
+	int ret;
+
+	while (true) {
+		TALLOC_CTX *tmp_ctx = talloc_new(NULL);
+		const char **args = NULL;
+		int nargs = 0;
+		char result;
+
+		if (tmp_ctx == NULL) {
+			fprintf(stderr, "locking: Memory allocation error\n");
+			break;
+		}
+
+		ret = server_request(tmp_ctx, read_fd, ppid, &nargs, &args);
+		if (ret != 0) {
+			if (ret != EPIPE) {
+				fprintf(stderr,
+					"locking: Invalid request (%s)\n",
+					strerror(ret));
+			}
+			talloc_free(tmp_ctx);
+			break;
+		}
+
+		if (strcmp(args[0], "UNLOCK") == 0 && nargs == 1) {
+			if (locked) {
+				cleanup(&state);
+				TALLOC_FREE(state.key.dptr);
+				state = (struct lock_state) { 0 };
+				locked = false;
+			}
+			talloc_free(tmp_ctx);
+			continue;
+		}
+
+		if (locked) {
+			fprintf(stderr, "locking: Lock request while locked\n");
+			talloc_free(tmp_ctx);
+			break;
+		}
+
+		if (strcmp(args[0], "RECORD") == 0 && nargs == 4) {
+			result = lock_record(args[1], args[2], args[3], &state);
+		} else if (strcmp(args[0], "DB") == 0 && nargs == 3) {
+			result = lock_db(args[1], args[2], &state);
+		} else {
+			fprintf(stderr, "locking: Invalid request '%s'\n",
+				args[0]);
+			talloc_free(tmp_ctx);
+			break;
+		}
+		talloc_free(tmp_ctx);
+
+		if (result == 0) {
+			locked = true;
+		} else {
+			/* lock_record/lock_db may leave the database open */
+			if (state.tdb != NULL) {
+				tdb_close(state.tdb);
+			}
+			TALLOC_FREE(state.key.dptr);
+			state = (struct lock_state) { 0 };
+		}
+
+		server_reply(write_fd, result);
+	}
+
+	if (locked) {
+		cleanup(&state);
+	}
+	return 0;
+}
+
 static void signal_handler(struct tevent_context *ev,
 			   struct tevent_signal *se,
 			   int signum, int count, void *siginfo,
@@ -285,6 +496,17 @@ int main(int argc, char *argv[])
 	write_fd = atoi(argv[2]);
 	lock_type = argv[3];
 
+	if (strcmp(lock_type, "SERVER") == 0) {
+		if (argc != 5) {
+			fprintf(stderr,
+				"locking: Invalid number of arguments (%d)\n",
+				argc);
+			usage(argv[0]);
+			exit(1);
+		}
+		return lock_server(ppid, write_fd, atoi(argv[4]));
+	}
+
 	ev = tevent_context_init(NULL);
 	if (ev == NULL) {
 		fprintf(stderr, "locking: tevent_context_init() failed\n");
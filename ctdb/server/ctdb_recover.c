@@ -36,6 +36,8 @@
 #include "ctdb_private.h"
 #include "ctdb_client.h"
 
+#include "protocol/protocol_util.h"
+
 #include "common/system.h"
 #include "common/common.h"
 #include "common/logging.h"
@@ -1060,9 +1062,13 @@ struct recovery_callback_state {
 static void ctdb_end_recovery_callback(struct ctdb_context *ctdb, int status, void *p)
 {
 	struct recovery_callback_state *state = talloc_get_type(p, struct recovery_callback_state);
+	double l;
 
 	CTDB_INCREMENT_STAT(ctdb, num_recoveries);
 
+	l = timeval_elapsed(&ctdb->last_recovery_started);
+	CTDB_UPDATE_STAT_LATENCY(ctdb, recovery.total, l);
+
 	if (status != 0) {
 		DEBUG(DEBUG_ERR,(__location__ " recovered event script failed (status %d)\n", status));
 		if (status == -ETIMEDOUT) {
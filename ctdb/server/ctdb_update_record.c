@@ -34,6 +34,8 @@
 #include "ctdb_private.h"
 #include "ctdb_client.h"
 
+#include "protocol/protocol_util.h"
+
 #include "common/system.h"
 #include "common/common.h"
 #include "common/logging.h"
@@ -38,6 +38,7 @@
 #include "ctdb_client.h"
 
 #include "protocol/protocol_private.h"
+#include "protocol/protocol_util.h"
 
 #include "common/rb_tree.h"
 #include "common/common.h"
@@ -68,92 +68,157 @@ static uint32_t ip_distance(ctdb_sock_addr *ip1, ctdb_sock_addr *ip2)
 	return distance;
 }
 
+/*
+ * State for the LCP2 algorithm.
+ *
+ * The IPs in all_ips are indexed by their position in the list.  For
+ * each IP and node, dsum caches the sum of the squared distances
+ * between the IP and the IPs currently assigned to the node.  This is
+ * the cost of having the IP on that node, so candidate moves can be
+ * evaluated without rescanning the IP list.  When an IP moves, only
+ * the cached sums involving its old and new node are updated.
+ */
+struct lcp2_state {
+	struct ipalloc_state *ipalloc_state;
+	unsigned int num_ips;
+	unsigned int num_nodes;
+	struct public_ip_list **ips;
+	uint32_t *dsum;
+	uint32_t *imbalances;
+	bool *rebalance_candidates;
+};
+
+#define LCP2_DSUM(_state, _ip, _pnn) \
+	((_state)->dsum[(_ip) * (_state)->num_nodes + (_pnn)])
+
 /* Calculate the IP distance for the given IP relative to IPs on the
-   given node.  The ips argument is generally the all_ips variable
-   used in the main part of the algorithm.
+   given node, excluding the IP itself.
  */
-static uint32_t ip_distance_2_sum(ctdb_sock_addr *ip,
-				  struct public_ip_list *ips,
+static uint32_t ip_distance_2_sum(struct lcp2_state *state,
+				  unsigned int ip,
 				  unsigned int pnn)
 {
-	struct public_ip_list *t;
-	uint32_t d;
+	return LCP2_DSUM(state, ip, pnn);
+}
 
-	uint32_t sum = 0;
+/* Move an IP to a node, updating the cached distance sums.  The IP
+ * may be unassigned (CTDB_UNKNOWN_PNN).
+ */
+static void lcp2_move_ip(struct lcp2_state *state,
+			 unsigned int ip,
+			 unsigned int pnn)
+{
+	struct public_ip_list *t = state->ips[ip];
+	unsigned int i;
 
-	for (t = ips; t != NULL; t = t->next) {
-		if (t->pnn != pnn) {
-			continue;
-		}
+	for (i = 0; i < state->num_ips; i++) {
+		uint32_t d;
 
-		/* Optimisation: We never calculate the distance
-		 * between an address and itself.  This allows us to
-		 * calculate the effect of removing an address from a
-		 * node by simply calculating the distance between
-		 * that address and all of the exitsing addresses.
-		 * Moreover, we assume that we're only ever dealing
-		 * with addresses from all_ips so we can identify an
-		 * address via a pointer rather than doing a more
-		 * expensive address comparison. */
-		if (&(t->addr) == ip) {
+		if (i == ip) {
 			continue;
 		}
 
-		d = ip_distance(ip, &(t->addr));
-		sum += d * d;  /* Cheaper than pulling in math.h :-) */
+		d = ip_distance(&t->addr, &state->ips[i]->addr);
+		d = d * d;
+
+		if (t->pnn != CTDB_UNKNOWN_PNN) {
+			LCP2_DSUM(state, i, t->pnn) -= d;
+		}
+		LCP2_DSUM(state, i, pnn) += d;
 	}
 
-	return sum;
+	t->pnn = pnn;
 }
 
-/* Return the LCP2 imbalance metric for addresses currently assigned
-   to the given node.
- */
-static uint32_t lcp2_imbalance(struct public_ip_list * all_ips,
-			       unsigned int pnn)
+static bool lcp2_init(struct ipalloc_state *ipalloc_state,
+		      struct lcp2_state **lcp2_state)
 {
+	unsigned int i, j, numnodes;
 	struct public_ip_list *t;
+	struct lcp2_state *state;
 
-	uint32_t imbalance = 0;
+	numnodes = ipalloc_state->num;
 
-	for (t = all_ips; t != NULL; t = t->next) {
-		if (t->pnn != pnn) {
-			continue;
-		}
-		/* Pass the rest of the IPs rather than the whole
-		   all_ips input list.
-		*/
-		imbalance += ip_distance_2_sum(&(t->addr), t->next, pnn);
+	state = talloc_zero(ipalloc_state, struct lcp2_state);
+	if (state == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		return false;
 	}
+	state->ipalloc_state = ipalloc_state;
+	state->num_nodes = numnodes;
 
-	return imbalance;
-}
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		state->num_ips++;
+	}
 
-static bool lcp2_init(struct ipalloc_state *ipalloc_state,
-		      uint32_t **lcp2_imbalances,
-		      bool **rebalance_candidates)
-{
-	unsigned int i, numnodes;
-	struct public_ip_list *t;
+	state->ips = talloc_array(state, struct public_ip_list *,
+				  state->num_ips);
+	if (state->ips == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		talloc_free(state);
+		return false;
+	}
+	i = 0;
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		state->ips[i++] = t;
+	}
 
-	numnodes = ipalloc_state->num;
+	state->dsum = talloc_zero_array(state, uint32_t,
+					state->num_ips * numnodes);
+	if (state->dsum == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		talloc_free(state);
+		return false;
+	}
 
-	*rebalance_candidates = talloc_array(ipalloc_state, bool, numnodes);
-	if (*rebalance_candidates == NULL) {
+	state->rebalance_candidates = talloc_array(state, bool, numnodes);
+	if (state->rebalance_candidates == NULL) {
 		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		talloc_free(state);
 		return false;
 	}
-	*lcp2_imbalances = talloc_array(ipalloc_state, uint32_t, numnodes);
-	if (*lcp2_imbalances == NULL) {
+	state->imbalances = talloc_zero_array(state, uint32_t, numnodes);
+	if (state->imbalances == NULL) {
 		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		talloc_free(state);
 		return false;
 	}
 
+	/* Each pair of IPs is only considered once.  The LCP2
+	 * imbalance metric for a node is the sum of the squared
+	 * distances between all pairs of IPs assigned to it.
+	 */
+	for (i = 0; i < state->num_ips; i++) {
+		struct public_ip_list *ip1 = state->ips[i];
+
+		for (j = i + 1; j < state->num_ips; j++) {
+			struct public_ip_list *ip2 = state->ips[j];
+			uint32_t d;
+
+			if (ip1->pnn == CTDB_UNKNOWN_PNN &&
+			    ip2->pnn == CTDB_UNKNOWN_PNN) {
+				continue;
+			}
+
+			d = ip_distance(&ip1->addr, &ip2->addr);
+			d = d * d;
+
+			if (ip2->pnn != CTDB_UNKNOWN_PNN) {
+				LCP2_DSUM(state, i, ip2->pnn) += d;
+			}
+			if (ip1->pnn != CTDB_UNKNOWN_PNN) {
+				LCP2_DSUM(state, j, ip1->pnn) += d;
+			}
+			if (ip1->pnn != CTDB_UNKNOWN_PNN &&
+			    ip1->pnn == ip2->pnn) {
+				state->imbalances[ip1->pnn] += d;
+			}
+		}
+	}
+
 	for (i=0; i<numnodes; i++) {
-		(*lcp2_imbalances)[i] =
-			lcp2_imbalance(ipalloc_state->all_ips, i);
 		/* First step: assume all nodes are candidates */
-		(*rebalance_candidates)[i] = true;
+		state->rebalance_candidates[i] = true;
 	}
 
 	/* 2nd step: if a node has IPs assigned then it must have been
@@ -165,10 +230,12 @@ static bool lcp2_init(struct ipalloc_state *ipalloc_state,
 	 */
 	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
 		if (t->pnn != CTDB_UNKNOWN_PNN) {
-			(*rebalance_candidates)[t->pnn] = false;
+			state->rebalance_candidates[t->pnn] = false;
 		}
 	}
 
+	*lcp2_state = state;
+
 	/* 3rd step: if a node is forced to re-balance then
 	   we allow failback onto the node */
 	if (ipalloc_state->force_rebalance_nodes == NULL) {
@@ -186,7 +253,7 @@ static bool lcp2_init(struct ipalloc_state *ipalloc_state,
 
 		DEBUG(DEBUG_NOTICE,
 		      ("Forcing rebalancing of IPs to node %u\n", pnn));
-		(*rebalance_candidates)[pnn] = true;
+		state->rebalance_candidates[pnn] = true;
 	}
 
 	return true;
@@ -195,16 +262,17 @@ static bool lcp2_init(struct ipalloc_state *ipalloc_state,
 /* Allocate any unassigned addresses using the LCP2 algorithm to find
  * the IP/node combination that will cost the least.
  */
-static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
-				     uint32_t *lcp2_imbalances)
+static void lcp2_allocate_unassigned(struct lcp2_state *state)
 {
+	struct ipalloc_state *ipalloc_state = state->ipalloc_state;
+	uint32_t *lcp2_imbalances = state->imbalances;
 	struct public_ip_list *t;
-	unsigned int dstnode, numnodes;
+	unsigned int dstnode, numnodes, i;
 
 	unsigned int minnode;
 	uint32_t mindsum, dstdsum, dstimbl;
 	uint32_t minimbl = 0;
-	struct public_ip_list *minip;
+	unsigned int minip;
 
 	bool should_loop = true;
 	bool have_unassigned = true;
@@ -219,10 +287,12 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
 
 		minnode = CTDB_UNKNOWN_PNN;
 		mindsum = 0;
-		minip = NULL;
+		minip = 0;
 
 		/* loop over each unassigned ip. */
-		for (t = ipalloc_state->all_ips; t != NULL ; t = t->next) {
+		for (i = 0; i < state->num_ips; i++) {
+			t = state->ips[i];
+
 			if (t->pnn != CTDB_UNKNOWN_PNN) {
 				continue;
 			}
@@ -236,9 +306,7 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
 					continue;
 				}
 
-				dstdsum = ip_distance_2_sum(&(t->addr),
-							    ipalloc_state->all_ips,
-							    dstnode);
+				dstdsum = ip_distance_2_sum(state, i, dstnode);
 				dstimbl = lcp2_imbalances[dstnode] + dstdsum;
 				DEBUG(DEBUG_DEBUG,
 				      (" %s -> %d [+%d]\n",
@@ -254,7 +322,7 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
 					minnode = dstnode;
 					minimbl = dstimbl;
 					mindsum = dstdsum;
-					minip = t;
+					minip = i;
 					should_loop = true;
 				}
 			}
@@ -264,12 +332,13 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
 
 		/* If we found one then assign it to the given node. */
 		if (minnode != CTDB_UNKNOWN_PNN) {
-			minip->pnn = minnode;
+			lcp2_move_ip(state, minip, minnode);
 			lcp2_imbalances[minnode] = minimbl;
 			DEBUG(DEBUG_INFO,(" %s -> %d [+%d]\n",
 					  ctdb_sock_addr_to_string(
 						  ipalloc_state,
-						  &(minip->addr), false),
+						  &(state->ips[minip]->addr),
+						  false),
 					  minnode,
 					  mindsum));
 		}
@@ -303,19 +372,20 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
  * to move IPs from, determines the best IP/destination node
  * combination to move from the source node.
  */
-static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
-				    unsigned int srcnode,
-				    uint32_t *lcp2_imbalances,
-				    bool *rebalance_candidates)
+static bool lcp2_failback_candidate(struct lcp2_state *state,
+				    unsigned int srcnode)
 {
-	unsigned int dstnode, mindstnode, numnodes;
+	struct ipalloc_state *ipalloc_state = state->ipalloc_state;
+	uint32_t *lcp2_imbalances = state->imbalances;
+	bool *rebalance_candidates = state->rebalance_candidates;
+	unsigned int dstnode, mindstnode, numnodes, i;
 	uint32_t srcdsum, dstimbl, dstdsum;
 	uint32_t minsrcimbl, mindstimbl;
-	struct public_ip_list *minip;
+	unsigned int minip;
 	struct public_ip_list *t;
 
 	/* Find an IP and destination node that best reduces imbalance. */
-	minip = NULL;
+	minip = 0;
 	minsrcimbl = 0;
 	mindstnode = CTDB_UNKNOWN_PNN;
 	mindstimbl = 0;
@@ -326,18 +396,18 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 	DEBUG(DEBUG_DEBUG,(" CONSIDERING MOVES FROM %d [%d]\n",
 			   srcnode, lcp2_imbalances[srcnode]));
 
-	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+	for (i = 0; i < state->num_ips; i++) {
 		uint32_t srcimbl;
 
+		t = state->ips[i];
+
 		/* Only consider addresses on srcnode. */
 		if (t->pnn != srcnode) {
 			continue;
 		}
 
 		/* What is this IP address costing the source node? */
-		srcdsum = ip_distance_2_sum(&(t->addr),
-					    ipalloc_state->all_ips,
-					    srcnode);
+		srcdsum = ip_distance_2_sum(state, i, srcnode);
 		srcimbl = lcp2_imbalances[srcnode] - srcdsum;
 
 		/* Consider this IP address would cost each potential
@@ -358,9 +428,7 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 				continue;
 			}
 
-			dstdsum = ip_distance_2_sum(&(t->addr),
-						    ipalloc_state->all_ips,
-						    dstnode);
+			dstdsum = ip_distance_2_sum(state, i, dstnode);
 			dstimbl = lcp2_imbalances[dstnode] + dstdsum;
 			DEBUG(DEBUG_DEBUG,(" %d [%d] -> %s -> %d [+%d]\n",
 					   srcnode, -srcdsum,
@@ -374,7 +442,7 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 			    ((mindstnode == CTDB_UNKNOWN_PNN) ||				\
 			     ((srcimbl + dstimbl) < (minsrcimbl + mindstimbl)))) {
 
-				minip = t;
+				minip = i;
 				minsrcimbl = srcimbl;
 				mindstnode = dstnode;
 				mindstimbl = dstimbl;
@@ -389,13 +457,14 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 		      ("%d [%d] -> %s -> %d [+%d]\n",
 		       srcnode, minsrcimbl - lcp2_imbalances[srcnode],
 		       ctdb_sock_addr_to_string(ipalloc_state,
-						&(minip->addr), false),
+						&(state->ips[minip]->addr),
+						false),
 		       mindstnode, mindstimbl - lcp2_imbalances[mindstnode]));
 
 
 		lcp2_imbalances[srcnode] = minsrcimbl;
 		lcp2_imbalances[mindstnode] = mindstimbl;
-		minip->pnn = mindstnode;
+		lcp2_move_ip(state, minip, mindstnode);
 
 		return true;
 	}
@@ -426,10 +495,10 @@ static int lcp2_cmp_imbalance_pnn(const void * a, const void * b)
  * node with the highest LCP2 imbalance, and then determines the best
  * IP/destination node combination to move from the source node.
  */
-static void lcp2_failback(struct ipalloc_state *ipalloc_state,
-			  uint32_t *lcp2_imbalances,
-			  bool *rebalance_candidates)
+static void lcp2_failback(struct lcp2_state *state)
 {
+	struct ipalloc_state *ipalloc_state = state->ipalloc_state;
+	uint32_t *lcp2_imbalances = state->imbalances;
 	int i, numnodes;
 	struct lcp2_imbalance_pnn * lips;
 	bool again;
@@ -461,10 +530,7 @@ try_again:
 			break;
 		}
 
-		if (lcp2_failback_candidate(ipalloc_state,
-					    lips[i].pnn,
-					    lcp2_imbalances,
-					    rebalance_candidates)) {
+		if (lcp2_failback_candidate(state, lips[i].pnn)) {
 			again = true;
 			break;
 		}
@@ -478,21 +544,19 @@ try_again:
 
 bool ipalloc_lcp2(struct ipalloc_state *ipalloc_state)
 {
-	uint32_t *lcp2_imbalances;
-	bool *rebalance_candidates;
+	struct lcp2_state *state = NULL;
 	int numnodes, i;
 	bool have_rebalance_candidates;
 	bool ret = true;
 
 	unassign_unsuitable_ips(ipalloc_state);
 
-	if (!lcp2_init(ipalloc_state,
-		       &lcp2_imbalances, &rebalance_candidates)) {
+	if (!lcp2_init(ipalloc_state, &state)) {
 		ret = false;
 		goto finished;
 	}
 
-	lcp2_allocate_unassigned(ipalloc_state, lcp2_imbalances);
+	lcp2_allocate_unassigned(state);
 
 	/* If we don't want IPs to fail back then don't rebalance IPs. */
 	if (ipalloc_state->no_ip_failback) {
@@ -506,7 +570,7 @@ bool ipalloc_lcp2(struct ipalloc_state *ipalloc_state)
 	numnodes = ipalloc_state->num;
 	have_rebalance_candidates = false;
 	for (i=0; i<numnodes; i++) {
-		if (rebalance_candidates[i]) {
+		if (state->rebalance_candidates[i]) {
 			have_rebalance_candidates = true;
 			break;
 		}
@@ -518,8 +582,9 @@ bool ipalloc_lcp2(struct ipalloc_state *ipalloc_state)
 	/* Now, try to make sure the ip adresses are evenly distributed
 	   across the nodes.
 	*/
-	lcp2_failback(ipalloc_state, lcp2_imbalances, rebalance_candidates);
+	lcp2_failback(state);
 
 finished:
+	TALLOC_FREE(state);
 	return ret;
 }
@@ -61,6 +61,7 @@ RecBufferSizeLimit         = 1000000
 QueueBufferSize            = 1024
 IPAllocAlgorithm           = 2
 AllowMixedVersions         = 0
+LockHelperPoolSize         = 16
 EOF
 
 simple_test
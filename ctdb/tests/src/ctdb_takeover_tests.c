@@ -19,11 +19,13 @@
 
 #include "replace.h"
 #include "system/network.h"
+#include "system/time.h"
 
 #include <assert.h>
 #include <talloc.h>
 
 #include "lib/util/debug.h"
+#include "lib/util/time.h"
 
 #include "protocol/protocol.h"
 #include "protocol/protocol_util.h"
@@ -241,6 +243,47 @@ static void ctdb_test_ipalloc(const char nodestates[],
 	talloc_free(tmp_ctx);
 }
 
+/* Run the IP allocation algorithm repeatedly against the IP layout
+ * read from stdin and report the average time taken.  The result of
+ * the final run is printed, so output can be compared with ipalloc.
+ */
+static void ctdb_test_ipalloc_bench(const char nodestates[],
+				    const char *count_str)
+{
+	TALLOC_CTX *tmp_ctx = talloc_new(NULL);
+	struct ipalloc_state *ipalloc_state;
+	struct public_ip_list *all_ips = NULL;
+	struct timeval start;
+	double elapsed;
+	int count, i;
+
+	count = (int) strtol(count_str, NULL, 0);
+	if (count < 1) {
+		count = 1;
+	}
+
+	ctdb_test_init(tmp_ctx, nodestates, &ipalloc_state, false);
+
+	start = timeval_current();
+	for (i = 0; i < count; i++) {
+		/* Each run builds a new merged IP list */
+		while (all_ips != NULL) {
+			struct public_ip_list *t = all_ips->next;
+			talloc_free(all_ips);
+			all_ips = t;
+		}
+		all_ips = ipalloc(ipalloc_state);
+	}
+	elapsed = timeval_elapsed(&start);
+
+	print_ctdb_public_ip_list(tmp_ctx, all_ips);
+
+	fprintf(stderr, "%d runs, %.6f seconds per run\n",
+		count, elapsed / count);
+
+	talloc_free(tmp_ctx);
+}
+
 static void usage(void)
 {
 	fprintf(stderr, "usage: ctdb_takeover_tests <op>\n");
@@ -270,6 +313,9 @@ int main(int argc, const char *argv[])
 		   strcmp(argv[1], "ipalloc") == 0 &&
 		   strcmp(argv[3], "multi") == 0) {
 		ctdb_test_ipalloc(argv[2], true);
+	} else if (argc == 4 &&
+		   strcmp(argv[1], "ipalloc_bench") == 0) {
+		ctdb_test_ipalloc_bench(argv[2], argv[3]);
 	} else {
 		usage();
 	}
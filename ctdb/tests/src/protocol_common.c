@@ -73,19 +73,29 @@ void verify_ctdb_tdb_datan(TDB_DATA *p1, TDB_DATA *p2)
 
 void fill_ctdb_latency_counter(struct ctdb_latency_counter *p)
 {
+	int i;
+
 	p->num = rand32i();
 	p->min = rand_double();
 	p->max = rand_double();
 	p->total = rand_double();
+	for (i=0; i<MAX_LATENCY_BUCKETS; i++) {
+		p->buckets[i] = rand32();
+	}
 }
 
 void verify_ctdb_latency_counter(struct ctdb_latency_counter *p1,
 				 struct ctdb_latency_counter *p2)
 {
+	int i;
+
 	assert(p1->num == p2->num);
 	assert(p1->min == p2->min);
 	assert(p1->max == p2->max);
 	assert(p1->total == p2->total);
+	for (i=0; i<MAX_LATENCY_BUCKETS; i++) {
+		assert(p1->buckets[i] == p2->buckets[i]);
+	}
 }
 
 void fill_ctdb_statistics(TALLOC_CTX *mem_ctx, struct ctdb_statistics *p)
@@ -148,6 +158,10 @@ void fill_ctdb_statistics(TALLOC_CTX *mem_ctx, struct ctdb_statistics *p)
 	fill_ctdb_timeval(&p->statistics_current_time);
 	p->total_ro_delegations = rand32();
 	p->total_ro_revokes = rand32();
+	fill_ctdb_latency_counter(&p->control_latency);
+	fill_ctdb_latency_counter(&p->migration_latency);
+	fill_ctdb_latency_counter(&p->recovery.freeze);
+	fill_ctdb_latency_counter(&p->recovery.total);
 }
 
 void verify_ctdb_statistics(struct ctdb_statistics *p1,
@@ -214,6 +228,14 @@ void verify_ctdb_statistics(struct ctdb_statistics *p1,
 			    &p2->statistics_current_time);
 	assert(p1->total_ro_delegations == p2->total_ro_delegations);
 	assert(p1->total_ro_revokes == p2->total_ro_revokes);
+	verify_ctdb_latency_counter(&p1->control_latency,
+				    &p2->control_latency);
+	verify_ctdb_latency_counter(&p1->migration_latency,
+				    &p2->migration_latency);
+	verify_ctdb_latency_counter(&p1->recovery.freeze,
+				    &p2->recovery.freeze);
+	verify_ctdb_latency_counter(&p1->recovery.total,
+				    &p2->recovery.total);
 }
 
 void fill_ctdb_vnn_map(TALLOC_CTX *mem_ctx, struct ctdb_vnn_map *p)
@@ -656,6 +678,7 @@ void fill_ctdb_tunable_list(TALLOC_CTX *mem_ctx, struct ctdb_tunable_list *p)
 	p->queue_buffer_size = rand32();
 	p->ip_alloc_algorithm = rand32();
 	p->allow_mixed_versions = rand32();
+	p->lock_helper_pool_size = rand32();
 }
 
 void verify_ctdb_tunable_list(struct ctdb_tunable_list *p1,
@@ -723,6 +746,7 @@ void verify_ctdb_tunable_list(struct ctdb_tunable_list *p1,
 	assert(p1->queue_buffer_size == p2->queue_buffer_size);
 	assert(p1->ip_alloc_algorithm == p2->ip_alloc_algorithm);
 	assert(p1->allow_mixed_versions == p2->allow_mixed_versions);
+	assert(p1->lock_helper_pool_size == p2->lock_helper_pool_size);
 }
 
 void fill_ctdb_tickle_list(TALLOC_CTX *mem_ctx, struct ctdb_tickle_list *p)
@@ -1077,6 +1101,8 @@ void fill_ctdb_db_statistics(TALLOC_CTX *mem_ctx,
 	}
 
 	fill_ctdb_latency_counter(&p->vacuum.latency);
+	fill_ctdb_latency_counter(&p->call_latency);
+	fill_ctdb_latency_counter(&p->migration_latency);
 
 	p->db_ro_delegations = rand32();
 	p->db_ro_revokes = rand32();
@@ -1106,6 +1132,9 @@ void verify_ctdb_db_statistics(struct ctdb_db_statistics *p1,
 	}
 
 	verify_ctdb_latency_counter(&p1->vacuum.latency, &p2->vacuum.latency);
+	verify_ctdb_latency_counter(&p1->call_latency, &p2->call_latency);
+	verify_ctdb_latency_counter(&p1->migration_latency,
+				    &p2->migration_latency);
 
 	assert(p1->db_ro_delegations == p2->db_ro_delegations);
 	assert(p1->db_ro_revokes == p2->db_ro_revokes);
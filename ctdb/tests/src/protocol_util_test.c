@@ -26,6 +26,28 @@
 #include "protocol/protocol_types.c"
 #include "protocol/protocol_util.c"
 
+/*
+ * Test latency histogram buckets
+ */
+
+static void test_latency_bucket(double latency, unsigned int bucket)
+{
+	assert(ctdb_latency_bucket(latency) == bucket);
+}
+
+static void test_latency_bucket_limits(void)
+{
+	unsigned int i;
+
+	for (i=0; i<MAX_LATENCY_BUCKETS-1; i++) {
+		uint64_t limit = ctdb_latency_bucket_limit(i);
+
+		assert(ctdb_latency_bucket((double)(limit - 1) / 1000000) == i);
+		assert(ctdb_latency_bucket((double)limit / 1000000) == i+1);
+	}
+	assert(ctdb_latency_bucket_limit(MAX_LATENCY_BUCKETS-1) == UINT64_MAX);
+}
+
 /*
  * Test parsing of IPs, conversion to string
  */
@@ -325,6 +347,19 @@ fe80::6af7:28ff:fefa:d138:12345 fe80::6af7:28ff:fefa:d137:54322\n\
 
 int main(int argc, char *argv[])
 {
+	test_latency_bucket(0.0, 0);
+	test_latency_bucket(0.0000004, 0);
+	test_latency_bucket(0.000001, 1);
+	test_latency_bucket(0.000002, 2);
+	test_latency_bucket(0.000003, 3);
+	test_latency_bucket(0.000004, 4);
+	test_latency_bucket(0.000006, 5);
+	test_latency_bucket(0.001, 19);
+	test_latency_bucket(1.0, 39);
+	test_latency_bucket(3600.0, MAX_LATENCY_BUCKETS-1);
+	test_latency_bucket(-1.0, 0);
+	test_latency_bucket_limits();
+
 	test_sock_addr_to_string("0.0.0.0", false);
 	test_sock_addr_to_string("127.0.0.1", false);
 	test_sock_addr_to_string("::1", false);
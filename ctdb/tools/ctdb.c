@@ -1189,6 +1189,68 @@ const struct {
 
 #define LATENCY_AVG(v)	((v).num ? (v).total / (v).num : 0.0 )
 
+const struct {
+	const char *name;
+	uint32_t offset;
+} stats_latency_fields[] = {
+#define STATISTICS_LATENCY_FIELD(n, f) \
+	{ #n, offsetof(struct ctdb_statistics, f) }
+	STATISTICS_LATENCY_FIELD(reclock_ctdbd_latency, reclock.ctdbd),
+	STATISTICS_LATENCY_FIELD(reclock_recd_latency, reclock.recd),
+	STATISTICS_LATENCY_FIELD(call_latency, call_latency),
+	STATISTICS_LATENCY_FIELD(lockwait_latency, locks.latency),
+	STATISTICS_LATENCY_FIELD(childwrite_latency, childwrite_latency),
+	STATISTICS_LATENCY_FIELD(control_latency, control_latency),
+	STATISTICS_LATENCY_FIELD(migration_latency, migration_latency),
+	STATISTICS_LATENCY_FIELD(recovery_freeze_latency, recovery.freeze),
+	STATISTICS_LATENCY_FIELD(recovery_latency, recovery.total),
+};
+
+static void print_latency_counter_header(const char *name)
+{
+	printf("num_%s%s", name, options.sep);
+	printf("min_%s%s", name, options.sep);
+	printf("avg_%s%s", name, options.sep);
+	printf("max_%s%s", name, options.sep);
+}
+
+static void print_latency_counter(struct ctdb_latency_counter *c)
+{
+	printf("%d%s", c->num, options.sep);
+	printf("%.6f%s", c->min, options.sep);
+	printf("%.6f%s", LATENCY_AVG(*c), options.sep);
+	printf("%.6f%s", c->max, options.sep);
+}
+
+/*
+ * Histogram columns are named after the upper limit of each bucket in
+ * microseconds
+ */
+static void print_latency_histogram_header(const char *name)
+{
+	unsigned int i;
+
+	for (i=0; i<MAX_LATENCY_BUCKETS; i++) {
+		uint64_t limit = ctdb_latency_bucket_limit(i);
+
+		if (limit == UINT64_MAX) {
+			printf("hist_%s_inf%s", name, options.sep);
+		} else {
+			printf("hist_%s_%"PRIu64"us%s",
+			       name, limit, options.sep);
+		}
+	}
+}
+
+static void print_latency_histogram(struct ctdb_latency_counter *c)
+{
+	unsigned int i;
+
+	for (i=0; i<MAX_LATENCY_BUCKETS; i++) {
+		printf("%u%s", c->buckets[i], options.sep);
+	}
+}
+
 static void print_statistics_machine(struct ctdb_statistics *s,
 				     bool show_header)
 {
@@ -1225,6 +1287,16 @@ static void print_statistics_machine(struct ctdb_statistics *s,
 		printf("min_childwrite_latency%s", options.sep);
 		printf("avg_childwrite_latency%s", options.sep);
 		printf("max_childwrite_latency%s", options.sep);
+
+		print_latency_counter_header("control_latency");
+		print_latency_counter_header("migration_latency");
+		print_latency_counter_header("recovery_freeze_latency");
+		print_latency_counter_header("recovery_latency");
+
+		for (i=0; i<ARRAY_SIZE(stats_latency_fields); i++) {
+			print_latency_histogram_header(
+				stats_latency_fields[i].name);
+		}
 		printf("\n");
 	}
 
@@ -1260,6 +1332,17 @@ static void print_statistics_machine(struct ctdb_statistics *s,
 	printf("%.6f%s", s->childwrite_latency.min, options.sep);
 	printf("%.6f%s", LATENCY_AVG(s->childwrite_latency), options.sep);
 	printf("%.6f%s", s->childwrite_latency.max, options.sep);
+
+	print_latency_counter(&s->control_latency);
+	print_latency_counter(&s->migration_latency);
+	print_latency_counter(&s->recovery.freeze);
+	print_latency_counter(&s->recovery.total);
+
+	for (i=0; i<ARRAY_SIZE(stats_latency_fields); i++) {
+		print_latency_histogram(
+			(struct ctdb_latency_counter *)
+			(stats_latency_fields[i].offset+(uint8_t *)s));
+	}
 	printf("\n");
 }
 
@@ -1336,6 +1419,26 @@ static void print_statistics(struct ctdb_statistics *s)
 	       s->childwrite_latency.min,
 	       LATENCY_AVG(s->childwrite_latency),
 	       s->childwrite_latency.max, s->childwrite_latency.num);
+
+	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
+	       "control_latency    MIN/AVG/MAX",
+	       s->control_latency.min, LATENCY_AVG(s->control_latency),
+	       s->control_latency.max, s->control_latency.num);
+
+	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
+	       "migration_latency  MIN/AVG/MAX",
+	       s->migration_latency.min, LATENCY_AVG(s->migration_latency),
+	       s->migration_latency.max, s->migration_latency.num);
+
+	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
+	       "recovery_freeze    MIN/AVG/MAX",
+	       s->recovery.freeze.min, LATENCY_AVG(s->recovery.freeze),
+	       s->recovery.freeze.max, s->recovery.freeze.num);
+
+	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
+	       "recovery           MIN/AVG/MAX",
+	       s->recovery.total.min, LATENCY_AVG(s->recovery.total),
+	       s->recovery.total.max, s->recovery.total.num);
 }
 
 static int control_statistics(TALLOC_CTX *mem_ctx, struct ctdb_context *ctdb,
@@ -5636,6 +5739,55 @@ const struct {
 	DBSTATISTICS_FIELD(locks.num_failed),
 };
 
+const struct {
+	const char *name;
+	uint32_t offset;
+} db_stats_latency_fields[] = {
+#define DBSTATISTICS_LATENCY_FIELD(n, f) \
+	{ #n, offsetof(struct ctdb_db_statistics, f) }
+	DBSTATISTICS_LATENCY_FIELD(lockwait_latency, locks.latency),
+	DBSTATISTICS_LATENCY_FIELD(vacuum_latency, vacuum.latency),
+	DBSTATISTICS_LATENCY_FIELD(call_latency, call_latency),
+	DBSTATISTICS_LATENCY_FIELD(migration_latency, migration_latency),
+};
+
+static void print_dbstatistics_machine(const char *db_name,
+				       struct ctdb_db_statistics *s)
+{
+	size_t i;
+
+	printf("DB%s", options.sep);
+	for (i=0; i<ARRAY_SIZE(db_stats_fields); i++) {
+		printf("%s%s", db_stats_fields[i].name, options.sep);
+	}
+	for (i=0; i<ARRAY_SIZE(db_stats_latency_fields); i++) {
+		print_latency_counter_header(db_stats_latency_fields[i].name);
+	}
+	for (i=0; i<ARRAY_SIZE(db_stats_latency_fields); i++) {
+		print_latency_histogram_header(
+			db_stats_latency_fields[i].name);
+	}
+	printf("\n");
+
+	printf("%s%s", db_name, options.sep);
+	for (i=0; i<ARRAY_SIZE(db_stats_fields); i++) {
+		printf("%u%s",
+		       *(uint32_t *)(db_stats_fields[i].offset+(uint8_t *)s),
+		       options.sep);
+	}
+	for (i=0; i<ARRAY_SIZE(db_stats_latency_fields); i++) {
+		print_latency_counter(
+			(struct ctdb_latency_counter *)
+			(db_stats_latency_fields[i].offset+(uint8_t *)s));
+	}
+	for (i=0; i<ARRAY_SIZE(db_stats_latency_fields); i++) {
+		print_latency_histogram(
+			(struct ctdb_latency_counter *)
+			(db_stats_latency_fields[i].offset+(uint8_t *)s));
+	}
+	printf("\n");
+}
+
 static void print_dbstatistics(const char *db_name,
 			       struct ctdb_db_statistics *s)
 {
@@ -5684,6 +5836,16 @@ static void print_dbstatistics(const char *db_name,
 	       s->vacuum.latency.min, LATENCY_AVG(s->vacuum.latency),
 	       s->vacuum.latency.max, s->vacuum.latency.num);
 
+	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
+	       "call_latency       MIN/AVG/MAX",
+	       s->call_latency.min, LATENCY_AVG(s->call_latency),
+	       s->call_latency.max, s->call_latency.num);
+
+	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
+	       "migration_latency  MIN/AVG/MAX",
+	       s->migration_latency.min, LATENCY_AVG(s->migration_latency),
+	       s->migration_latency.max, s->migration_latency.num);
+
 	printf(" Num Hot Keys:     %d\n", s->num_hot_keys);
 	for (i=0; i<s->num_hot_keys; i++) {
 		size_t j;
@@ -5720,7 +5882,11 @@ static int control_dbstatistics(TALLOC_CTX *mem_ctx, struct ctdb_context *ctdb,
 		return ret;
 	}
 
-	print_dbstatistics(db_name, dbstats);
+	if (options.machinereadable) {
+		print_dbstatistics_machine(db_name, dbstats);
+	} else {
+		print_dbstatistics(db_name, dbstats);
+	}
 	return 0;
 }
 
@@ -91,6 +91,9 @@ int ldb_schema_attribute_add_with_syntax(struct ldb_context *ldb,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	/* cached DNs may have been casefolded with the old handler */
+	ldb_dn_cache_flush(ldb);
+
 	n = ldb->schema.num_attributes + 1;
 
 	a = talloc_realloc(ldb, ldb->schema.attributes,
@@ -241,6 +244,8 @@ void ldb_schema_attribute_remove(struct ldb_context *ldb, const char *name)
 		talloc_free(discard_const_p(char, a->name));
 	}
 
+	ldb_dn_cache_flush(ldb);
+
 	i = a - ldb->schema.attributes;
 	if (i < ldb->schema.num_attributes - 1) {
 		memmove(&ldb->schema.attributes[i], 
@@ -274,6 +279,7 @@ void ldb_schema_attribute_remove_flagged(struct ldb_context *ldb, unsigned int f
 		if (a->flags & LDB_ATTR_FLAG_ALLOCATED) {
 			talloc_free(discard_const_p(char, a->name));
 		}
+		ldb_dn_cache_flush(ldb);
 		if (i < ldb->schema.num_attributes - 1) {
 			memmove(&ldb->schema.attributes[i],
 				a+1, sizeof(*a) * (ldb->schema.num_attributes-(i+1)));
@@ -382,6 +388,7 @@ void ldb_schema_attribute_set_override_handler(struct ldb_context *ldb,
 {
 	ldb->schema.attribute_handler_override_private = private_data;
 	ldb->schema.attribute_handler_override = override;
+	ldb_dn_cache_flush(ldb);
 }
 
 /*
@@ -77,8 +77,175 @@ struct ldb_dn {
 
 	unsigned int ext_comp_num;
 	struct ldb_dn_ext_component *ext_components;
+
+	/*
+	 * The components were parsed from linearized and haven't been
+	 * changed since, so may be shared through the DN cache
+	 */
+	bool cacheable;
+};
+
+/*
+ * A cache of recently casefolded DNs, keyed by their linearized
+ * form.
+ *
+ * The same few DNs (partition and schema bases, well known containers
+ * and the base DN of common searches) are exploded and casefolded
+ * over and over by different modules.  A DN found here is given copies
+ * of the cached components, already casefolded, instead of being
+ * parsed and casefolded again.
+ *
+ * To keep one-off DNs (such as those of each record returned by a
+ * search) from pushing the useful ones out, a DN is only added the
+ * second time in a row it is casefolded for its slot.
+ *
+ * The casefolded values depend on the schema, so the cache is flushed
+ * whenever the attribute handlers change.
+ */
+#define LDB_DN_CACHE_SIZE 256
+
+struct ldb_dn_cache_entry {
+	/* the talloc parent of the components */
+	char *linearized;
+	unsigned int comp_num;
+	struct ldb_dn_component *components;
 };
 
+struct ldb_dn_cache {
+	struct ldb_dn_cache_entry entries[LDB_DN_CACHE_SIZE];
+	/* the hash of the last DN not cached seen for each slot */
+	uint32_t seen[LDB_DN_CACHE_SIZE];
+};
+
+static struct ldb_dn_component ldb_dn_copy_component(
+						TALLOC_CTX *mem_ctx,
+						struct ldb_dn_component *src);
+
+static uint32_t ldb_dn_cache_hash(const char *s)
+{
+	uint32_t h = 2166136261U;
+
+	/* FNV-1a */
+	while (*s != '\0') {
+		h ^= (uint8_t)*s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+  fill in the components of a DN from the DN cache, if it is there
+*/
+static bool ldb_dn_cache_lookup(struct ldb_dn *dn)
+{
+	struct ldb_dn_cache *cache = dn->ldb->dn_cache;
+	struct ldb_dn_cache_entry *e = NULL;
+	struct ldb_dn_component *components = NULL;
+	unsigned int i;
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	e = &cache->entries[ldb_dn_cache_hash(dn->linearized) %
+			    LDB_DN_CACHE_SIZE];
+	if (e->linearized == NULL ||
+	    strcmp(e->linearized, dn->linearized) != 0) {
+		return false;
+	}
+
+	components = talloc_zero_array(dn,
+				       struct ldb_dn_component,
+				       e->comp_num);
+	if (components == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < e->comp_num; i++) {
+		components[i] = ldb_dn_copy_component(components,
+						      &e->components[i]);
+		if (components[i].cf_value.data == NULL) {
+			talloc_free(components);
+			return false;
+		}
+	}
+
+	dn->components = components;
+	dn->comp_num = e->comp_num;
+	dn->valid_case = true;
+	dn->cacheable = true;
+	return true;
+}
+
+/*
+  add a freshly casefolded DN to the DN cache, if it has been seen
+  for this slot just before
+*/
+static void ldb_dn_cache_add(struct ldb_dn *dn)
+{
+	struct ldb_context *ldb = dn->ldb;
+	struct ldb_dn_cache_entry *e = NULL;
+	char *linearized = NULL;
+	struct ldb_dn_component *components = NULL;
+	uint32_t hash;
+	unsigned int slot;
+	unsigned int i;
+
+	if (!dn->cacheable || dn->linearized == NULL || dn->comp_num == 0) {
+		return;
+	}
+
+	hash = ldb_dn_cache_hash(dn->linearized);
+	slot = hash % LDB_DN_CACHE_SIZE;
+
+	if (ldb->dn_cache == NULL) {
+		ldb->dn_cache = talloc_zero(ldb, struct ldb_dn_cache);
+		if (ldb->dn_cache == NULL) {
+			return;
+		}
+	}
+
+	if (ldb->dn_cache->seen[slot] != hash) {
+		ldb->dn_cache->seen[slot] = hash;
+		return;
+	}
+
+	linearized = talloc_strdup(ldb->dn_cache, dn->linearized);
+	if (linearized == NULL) {
+		return;
+	}
+	components = talloc_zero_array(linearized,
+				       struct ldb_dn_component,
+				       dn->comp_num);
+	if (components == NULL) {
+		talloc_free(linearized);
+		return;
+	}
+	for (i = 0; i < dn->comp_num; i++) {
+		components[i] = ldb_dn_copy_component(components,
+						      &dn->components[i]);
+		if (components[i].cf_value.data == NULL) {
+			talloc_free(linearized);
+			return;
+		}
+	}
+
+	e = &ldb->dn_cache->entries[slot];
+	TALLOC_FREE(e->linearized);
+	e->linearized = linearized;
+	e->comp_num = dn->comp_num;
+	e->components = components;
+}
+
+/*
+  forget all the cached DNs, as the way they are casefolded may have
+  changed
+*/
+_PRIVATE_ void ldb_dn_cache_flush(struct ldb_context *ldb)
+{
+	TALLOC_FREE(ldb->dn_cache);
+}
+
 /* it is helpful to be able to break on this in gdb */
 static void ldb_dn_mark_invalid(struct ldb_dn *dn)
 {
@@ -328,6 +495,11 @@ static bool ldb_dn_explode(struct ldb_dn *dn)
 		return true;
 	}
 
+	if (dn->ext_linearized == NULL && !is_index &&
+	    ldb_dn_cache_lookup(dn)) {
+		return true;
+	}
+
 	LDB_FREE(dn->ext_components);
 	dn->ext_comp_num = 0;
 	dn->comp_num = 0;
@@ -738,6 +910,7 @@ static bool ldb_dn_explode(struct ldb_dn *dn)
 		dn->comp_num++;
 	}
 	talloc_free(data);
+	dn->cacheable = !is_index;
 	return true;
 
 failed:
@@ -965,6 +1138,8 @@ static bool ldb_dn_casefold_internal(struct ldb_dn *dn)
 
 	dn->valid_case = true;
 
+	ldb_dn_cache_add(dn);
+
 	return true;
 
 failed:
@@ -1385,6 +1560,8 @@ bool ldb_dn_add_base(struct ldb_dn *dn, struct ldb_dn *base)
 		return false; /* or we will visit infinity */
 	}
 
+	dn->cacheable = false;
+
 	if (dn->components) {
 		unsigned int i;
 
@@ -1507,6 +1684,8 @@ bool ldb_dn_add_child(struct ldb_dn *dn, struct ldb_dn *child)
 		return false;
 	}
 
+	dn->cacheable = false;
+
 	if (dn->components) {
 		unsigned int n;
 		unsigned int i, j;
@@ -1669,6 +1848,8 @@ bool ldb_dn_remove_base_components(struct ldb_dn *dn, unsigned int num)
 		return false;
 	}
 
+	dn->cacheable = false;
+
 	/* free components */
 	for (i = dn->comp_num - num; i < dn->comp_num; i++) {
 		LDB_FREE(dn->components[i].name);
@@ -1711,6 +1892,8 @@ bool ldb_dn_remove_child_components(struct ldb_dn *dn, unsigned int num)
 		return false;
 	}
 
+	dn->cacheable = false;
+
 	for (i = 0, j = num; j < dn->comp_num; i++, j++) {
 		if (i < num) {
 			LDB_FREE(dn->components[i].name);
@@ -1758,6 +1941,8 @@ bool ldb_dn_replace_components(struct ldb_dn *dn, struct ldb_dn *new_dn)
 		return false;
 	}
 
+	dn->cacheable = false;
+
 	/* free components */
 	for (i = 0; i < dn->comp_num; i++) {
 		LDB_FREE(dn->components[i].name);
@@ -1961,6 +2146,8 @@ int ldb_dn_set_component(struct ldb_dn *dn, int num,
 		return LDB_ERR_OTHER;
 	}
 
+	dn->cacheable = false;
+
 	if ((unsigned)num >= dn->comp_num) {
 		return LDB_ERR_OTHER;
 	}
@@ -2165,6 +2352,8 @@ bool ldb_dn_is_null(struct ldb_dn *dn)
  */
 int ldb_dn_update_components(struct ldb_dn *dn, const struct ldb_dn *ref_dn)
 {
+	dn->cacheable = false;
+
 	dn->components = talloc_realloc(dn, dn->components,
 					struct ldb_dn_component, ref_dn->comp_num);
 	if (!dn->components) {
@@ -2200,6 +2389,8 @@ bool ldb_dn_minimise(struct ldb_dn *dn)
 		return true;
 	}
 
+	dn->cacheable = false;
+
 	/* free components */
 	for (i = 0; i < dn->comp_num; i++) {
 		LDB_FREE(dn->components[i].name);
@@ -76,10 +76,37 @@ static int ldb_match_scope(struct ldb_context *ldb,
 }
 
 
+/*
+  match if node is present, given the element found for it
+*/
+static int ldb_match_present_el(struct ldb_context *ldb,
+				const struct ldb_schema_attribute *a,
+				const struct ldb_message_element *el,
+				bool *matched)
+{
+	if (!a) {
+		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	}
+
+	if (a->syntax->operator_fn) {
+		unsigned int i;
+		for (i = 0; i < el->num_values; i++) {
+			int ret = a->syntax->operator_fn(ldb, LDB_OP_PRESENT, a, &el->values[i], NULL, matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (*matched) return LDB_SUCCESS;
+		}
+		*matched = false;
+		return LDB_SUCCESS;
+	}
+
+	*matched = true;
+	return LDB_SUCCESS;
+}
+
 /*
   match if node is present
 */
-static int ldb_match_present(struct ldb_context *ldb, 
+static int ldb_match_present(struct ldb_context *ldb,
 			     const struct ldb_message *msg,
 			     const struct ldb_parse_tree *tree,
 			     enum ldb_scope scope, bool *matched)
@@ -99,32 +126,59 @@ static int ldb_match_present(struct ldb_context *ldb,
 	}
 
 	a = ldb_schema_attribute_by_name(ldb, el->name);
+	return ldb_match_present_el(ldb, a, el, matched);
+}
+
+/*
+  compare the values of an element with a value, given the element
+  found for the attribute
+*/
+static int ldb_match_comparison_el(struct ldb_context *ldb,
+				   const struct ldb_schema_attribute *a,
+				   const struct ldb_message_element *el,
+				   const struct ldb_val *value,
+				   enum ldb_parse_op comp_op, bool *matched)
+{
+	unsigned int i;
+
 	if (!a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
-	if (a->syntax->operator_fn) {
-		unsigned int i;
-		for (i = 0; i < el->num_values; i++) {
-			int ret = a->syntax->operator_fn(ldb, LDB_OP_PRESENT, a, &el->values[i], NULL, matched);
+	for (i = 0; i < el->num_values; i++) {
+		if (a->syntax->operator_fn) {
+			int ret;
+			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], value, matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
+		} else {
+			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], value);
+
+			if (ret == 0) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
+			if (ret > 0 && comp_op == LDB_OP_GREATER) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
+			if (ret < 0 && comp_op == LDB_OP_LESS) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
 		}
-		*matched = false;
-		return LDB_SUCCESS;
 	}
 
-	*matched = true;
+	*matched = false;
 	return LDB_SUCCESS;
 }
 
-static int ldb_match_comparison(struct ldb_context *ldb, 
+static int ldb_match_comparison(struct ldb_context *ldb,
 				const struct ldb_message *msg,
 				const struct ldb_parse_tree *tree,
 				enum ldb_scope scope,
 				enum ldb_parse_op comp_op, bool *matched)
 {
-	unsigned int i;
 	struct ldb_message_element *el;
 	const struct ldb_schema_attribute *a;
 
@@ -140,28 +194,36 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 	}
 
 	a = ldb_schema_attribute_by_name(ldb, el->name);
-	if (!a) {
+	return ldb_match_comparison_el(ldb, a, el,
+				       &tree->u.comparison.value,
+				       comp_op, matched);
+}
+
+/*
+  match a simple leaf node, given the element found for the attribute
+*/
+static int ldb_match_equality_el(struct ldb_context *ldb,
+				 const struct ldb_schema_attribute *a,
+				 const struct ldb_message_element *el,
+				 const struct ldb_val *value,
+				 bool *matched)
+{
+	unsigned int i;
+	int ret;
+
+	if (a == NULL) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
-	for (i = 0; i < el->num_values; i++) {
+	for (i=0;i<el->num_values;i++) {
 		if (a->syntax->operator_fn) {
-			int ret;
-			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], &tree->u.comparison.value, matched);
+			ret = a->syntax->operator_fn(ldb, LDB_OP_EQUALITY, a,
+						     value, &el->values[i], matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
 		} else {
-			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], &tree->u.comparison.value);
-
-			if (ret == 0) {
-				*matched = true;
-				return LDB_SUCCESS;
-			}
-			if (ret > 0 && comp_op == LDB_OP_GREATER) {
-				*matched = true;
-				return LDB_SUCCESS;
-			}
-			if (ret < 0 && comp_op == LDB_OP_LESS) {
+			if (a->syntax->comparison_fn(ldb, ldb, value,
+						     &el->values[i]) == 0) {
 				*matched = true;
 				return LDB_SUCCESS;
 			}
@@ -175,13 +237,12 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 /*
   match a simple leaf node
 */
-static int ldb_match_equality(struct ldb_context *ldb, 
+static int ldb_match_equality(struct ldb_context *ldb,
 			      const struct ldb_message *msg,
 			      const struct ldb_parse_tree *tree,
 			      enum ldb_scope scope,
 			      bool *matched)
 {
-	unsigned int i;
 	struct ldb_message_element *el;
 	const struct ldb_schema_attribute *a;
 	struct ldb_dn *valuedn;
@@ -210,98 +271,126 @@ static int ldb_match_equality(struct ldb_context *ldb,
 	}
 
 	a = ldb_schema_attribute_by_name(ldb, el->name);
-	if (a == NULL) {
-		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	return ldb_match_equality_el(ldb, a, el,
+				     &tree->u.equality.value,
+				     matched);
+}
+
+/*
+  the chunks of a substring match, canonicalised with the attribute
+  syntax
+*/
+struct ldb_match_substring {
+	const struct ldb_schema_attribute *a;
+	struct ldb_val *chunks;
+	unsigned int num_chunks;
+	/* a chunk could not be canonicalised, so nothing can match */
+	bool invalid;
+	bool start_with_wildcard;
+	bool end_with_wildcard;
+};
+
+static int ldb_match_substring_prepare(struct ldb_context *ldb,
+				       TALLOC_CTX *mem_ctx,
+				       const struct ldb_parse_tree *tree,
+				       struct ldb_match_substring *s)
+{
+	unsigned int c;
+
+	*s = (struct ldb_match_substring) {
+		.start_with_wildcard = tree->u.substring.start_with_wildcard,
+		.end_with_wildcard = tree->u.substring.end_with_wildcard,
+	};
+
+	s->a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
+	if (s->a == NULL || tree->u.substring.chunks == NULL) {
+		return LDB_SUCCESS;
 	}
 
-	for (i=0;i<el->num_values;i++) {
-		if (a->syntax->operator_fn) {
-			ret = a->syntax->operator_fn(ldb, LDB_OP_EQUALITY, a,
-						     &tree->u.equality.value, &el->values[i], matched);
-			if (ret != LDB_SUCCESS) return ret;
-			if (*matched) return LDB_SUCCESS;
-		} else {
-			if (a->syntax->comparison_fn(ldb, ldb, &tree->u.equality.value,
-						     &el->values[i]) == 0) {
-				*matched = true;
-				return LDB_SUCCESS;
-			}
+	for (c = 0; tree->u.substring.chunks[c] != NULL; c++) {
+		/* count the chunks */
+	}
+
+	s->chunks = talloc_zero_array(mem_ctx, struct ldb_val, c);
+	if (s->chunks == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	s->num_chunks = c;
+
+	for (c = 0; c < s->num_chunks; c++) {
+		if (s->a->syntax->canonicalise_fn(ldb, s->chunks,
+						  tree->u.substring.chunks[c],
+						  &s->chunks[c]) != 0) {
+			s->invalid = true;
+			break;
 		}
 	}
 
-	*matched = false;
 	return LDB_SUCCESS;
 }
 
-static int ldb_wildcard_compare(struct ldb_context *ldb,
-				const struct ldb_parse_tree *tree,
-				const struct ldb_val value, bool *matched)
+/*
+  compare a value with the canonicalised chunks of a substring match
+*/
+static int ldb_wildcard_compare_chunks(struct ldb_context *ldb,
+				       const struct ldb_match_substring *s,
+				       const struct ldb_val value,
+				       bool *matched)
 {
-	const struct ldb_schema_attribute *a;
 	struct ldb_val val;
-	struct ldb_val cnk;
-	struct ldb_val *chunk;
+	const struct ldb_val *cnk;
 	uint8_t *save_p = NULL;
 	unsigned int c = 0;
 
-	if (tree->operation != LDB_OP_SUBSTRING) {
-		*matched = false;
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
-
-	a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
-	if (!a) {
+	if (!s->a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
-	if (tree->u.substring.chunks == NULL) {
+	if (s->num_chunks == 0) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	if (a->syntax->canonicalise_fn(ldb, ldb, &value, &val) != 0) {
+	if (s->a->syntax->canonicalise_fn(ldb, ldb, &value, &val) != 0) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
 	save_p = val.data;
-	cnk.data = NULL;
 
-	if ( ! tree->u.substring.start_with_wildcard ) {
+	if (s->invalid) goto mismatch;
+
+	if ( ! s->start_with_wildcard ) {
 
-		chunk = tree->u.substring.chunks[c];
-		if (a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) goto mismatch;
+		cnk = &s->chunks[c];
 
 		/* This deals with wildcard prefix searches on binary attributes (eg objectGUID) */
-		if (cnk.length > val.length) {
+		if (cnk->length > val.length) {
 			goto mismatch;
 		}
 		/*
 		 * Empty strings are returned as length 0. Ensure
 		 * we can cope with this.
 		 */
-		if (cnk.length == 0) {
+		if (cnk->length == 0) {
 			goto mismatch;
 		}
 
-		if (memcmp((char *)val.data, (char *)cnk.data, cnk.length) != 0) goto mismatch;
-		val.length -= cnk.length;
-		val.data += cnk.length;
+		if (memcmp((char *)val.data, (char *)cnk->data, cnk->length) != 0) goto mismatch;
+		val.length -= cnk->length;
+		val.data += cnk->length;
 		c++;
-		talloc_free(cnk.data);
-		cnk.data = NULL;
 	}
 
-	while (tree->u.substring.chunks[c]) {
+	while (c < s->num_chunks) {
 		uint8_t *p;
 
-		chunk = tree->u.substring.chunks[c];
-		if(a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) goto mismatch;
+		cnk = &s->chunks[c];
 
 		/*
 		 * Empty strings are returned as length 0. Ensure
 		 * we can cope with this.
 		 */
-		if (cnk.length == 0) {
+		if (cnk->length == 0) {
 			goto mismatch;
 		}
 		/*
@@ -309,15 +398,15 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 		 * search, but memory search instead.
 		 */
 		p = memmem((const void *)val.data,val.length,
-			   (const void *)cnk.data, cnk.length);
+			   (const void *)cnk->data, cnk->length);
 		if (p == NULL) goto mismatch;
 
 		/*
-		 * At this point we know cnk.length <= val.length as
+		 * At this point we know cnk->length <= val.length as
 		 * otherwise there could be no match
 		 */
 
-		if ( (! tree->u.substring.chunks[c + 1]) && (! tree->u.substring.end_with_wildcard) ) {
+		if ( (c + 1 == s->num_chunks) && (! s->end_with_wildcard) ) {
 			uint8_t *g;
 			uint8_t *end = val.data + val.length;
 			do { /* greedy */
@@ -325,35 +414,33 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 				/*
 				 * haystack is a valid pointer in val
 				 * because the memmem() can only
-				 * succeed if the needle (cnk.length)
+				 * succeed if the needle (cnk->length)
 				 * is <= haystacklen
 				 *
 				 * p will be a pointer at least
-				 * cnk.length from the end of haystack
+				 * cnk->length from the end of haystack
 				 */
 				uint8_t *haystack
-					= p + cnk.length;
+					= p + cnk->length;
 				size_t haystacklen
 					= end - (haystack);
 
 				g = memmem(haystack,
 					   haystacklen,
-					   (const uint8_t *)cnk.data,
-					   cnk.length);
+					   (const uint8_t *)cnk->data,
+					   cnk->length);
 				if (g) {
 					p = g;
 				}
 			} while(g);
 		}
-		val.length = val.length - (p - (uint8_t *)(val.data)) - cnk.length;
-		val.data = (uint8_t *)(p + cnk.length);
+		val.length = val.length - (p - (uint8_t *)(val.data)) - cnk->length;
+		val.data = (uint8_t *)(p + cnk->length);
 		c++;
-		talloc_free(cnk.data);
-		cnk.data = NULL;
 	}
 
 	/* last chunk may not have reached end of string */
-	if ( (! tree->u.substring.end_with_wildcard) && (val.length != 0) ) goto mismatch;
+	if ( (! s->end_with_wildcard) && (val.length != 0) ) goto mismatch;
 	talloc_free(save_p);
 	*matched = true;
 	return LDB_SUCCESS;
@@ -361,38 +448,90 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 mismatch:
 	*matched = false;
 	talloc_free(save_p);
-	talloc_free(cnk.data);
+	return LDB_SUCCESS;
+}
+
+static int ldb_wildcard_compare(struct ldb_context *ldb,
+				const struct ldb_parse_tree *tree,
+				const struct ldb_val value, bool *matched)
+{
+	struct ldb_match_substring s;
+	TALLOC_CTX *tmp_ctx = NULL;
+	int ret;
+
+	if (tree->operation != LDB_OP_SUBSTRING) {
+		*matched = false;
+		return LDB_ERR_INAPPROPRIATE_MATCHING;
+	}
+
+	tmp_ctx = talloc_new(ldb);
+	if (tmp_ctx == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_match_substring_prepare(ldb, tmp_ctx, tree, &s);
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_wildcard_compare_chunks(ldb, &s, value, matched);
+	}
+
+	talloc_free(tmp_ctx);
+	return ret;
+}
+
+/*
+  match a substring against the values of an element
+*/
+static int ldb_match_substring_el(struct ldb_context *ldb,
+				  const struct ldb_match_substring *s,
+				  const struct ldb_message_element *el,
+				  bool *matched)
+{
+	unsigned int i;
+
+	for (i = 0; i < el->num_values; i++) {
+		int ret;
+		ret = ldb_wildcard_compare_chunks(ldb, s, el->values[i], matched);
+		if (ret != LDB_SUCCESS) return ret;
+		if (*matched) return LDB_SUCCESS;
+	}
+
+	*matched = false;
 	return LDB_SUCCESS;
 }
 
 /*
   match a simple leaf node
 */
-static int ldb_match_substring(struct ldb_context *ldb, 
+static int ldb_match_substring(struct ldb_context *ldb,
 			       const struct ldb_message *msg,
 			       const struct ldb_parse_tree *tree,
 			       enum ldb_scope scope, bool *matched)
 {
-	unsigned int i;
 	struct ldb_message_element *el;
+	struct ldb_match_substring s;
+	TALLOC_CTX *tmp_ctx = NULL;
+	int ret;
 
 	el = ldb_msg_find_element(msg, tree->u.substring.attr);
-	if (el == NULL) {
+	if (el == NULL || el->num_values == 0) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	for (i = 0; i < el->num_values; i++) {
-		int ret;
-		ret = ldb_wildcard_compare(ldb, tree, el->values[i], matched);
-		if (ret != LDB_SUCCESS) return ret;
-		if (*matched) return LDB_SUCCESS;
+	tmp_ctx = talloc_new(ldb);
+	if (tmp_ctx == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	*matched = false;
-	return LDB_SUCCESS;
-}
+	/* canonicalise the chunks once for all the values */
+	ret = ldb_match_substring_prepare(ldb, tmp_ctx, tree, &s);
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_match_substring_el(ldb, &s, el, matched);
+	}
 
+	talloc_free(tmp_ctx);
+	return ret;
+}
 
 /*
   bitwise and/or comparator depending on oid
@@ -661,6 +800,358 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 	return ldb_match_message(ldb, msg, tree, scope, matched);
 }
 
+/*
+  A parse tree compiled by ldb_match_compile() into a flat array of
+  operations, in the order the tree would be walked.
+
+  Attribute handlers, extended match rules, DN values and substring
+  chunks are all resolved once here rather than for every message
+  tested against the filter.
+*/
+enum ldb_match_op_type {
+	LDB_MATCH_OP_AND,
+	LDB_MATCH_OP_OR,
+	LDB_MATCH_OP_NOT,
+	LDB_MATCH_OP_CONSTANT,
+	LDB_MATCH_OP_ERROR,
+	LDB_MATCH_OP_DN_EQUALITY,
+	LDB_MATCH_OP_EQUALITY,
+	LDB_MATCH_OP_SUBSTRING,
+	LDB_MATCH_OP_GREATER,
+	LDB_MATCH_OP_LESS,
+	LDB_MATCH_OP_PRESENT,
+	LDB_MATCH_OP_EXTENDED,
+};
+
+struct ldb_match_op {
+	enum ldb_match_op_type type;
+	/*
+	 * The index of the operation following this one and all of
+	 * its children, so AND and OR can skip the rest of their
+	 * children once the result is known
+	 */
+	unsigned int next;
+	const char *attr;
+	const struct ldb_val *value;
+	const struct ldb_schema_attribute *a;
+	struct ldb_dn *dn;
+	struct ldb_match_substring substring;
+	const struct ldb_extended_match_rule *rule;
+	/* the result of LDB_MATCH_OP_CONSTANT and LDB_MATCH_OP_ERROR */
+	bool matched;
+	int error;
+};
+
+struct ldb_match_program {
+	struct ldb_match_op *ops;
+	unsigned int num_ops;
+};
+
+static unsigned int ldb_match_tree_count(const struct ldb_parse_tree *tree)
+{
+	unsigned int i;
+	unsigned int count = 1;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			count += ldb_match_tree_count(tree->u.list.elements[i]);
+		}
+		break;
+	case LDB_OP_NOT:
+		count += ldb_match_tree_count(tree->u.isnot.child);
+		break;
+	default:
+		break;
+	}
+
+	return count;
+}
+
+static int ldb_match_compile_extended(struct ldb_context *ldb,
+				      const struct ldb_parse_tree *tree,
+				      struct ldb_match_op *op)
+{
+	if (tree->u.extended.dnAttributes) {
+		/* See ldb_match_extended() */
+		ldb_debug(ldb, LDB_DEBUG_WARNING, "ldb: dnAttributes extended match not supported yet");
+	}
+	if (tree->u.extended.rule_id == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-rule extended matches not supported yet");
+		op->type = LDB_MATCH_OP_ERROR;
+		op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		return LDB_SUCCESS;
+	}
+	if (tree->u.extended.attr == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-attribute extended matches not supported yet");
+		op->type = LDB_MATCH_OP_ERROR;
+		op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		return LDB_SUCCESS;
+	}
+
+	op->rule = ldb_find_extended_match_rule(ldb, tree->u.extended.rule_id);
+	if (op->rule == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: unknown extended rule_id %s",
+			  tree->u.extended.rule_id);
+		op->type = LDB_MATCH_OP_CONSTANT;
+		op->matched = false;
+		return LDB_SUCCESS;
+	}
+
+	op->type = LDB_MATCH_OP_EXTENDED;
+	op->attr = tree->u.extended.attr;
+	op->value = &tree->u.extended.value;
+	return LDB_SUCCESS;
+}
+
+/*
+  compile a subtree into the program, starting at *pos
+*/
+static int ldb_match_compile_tree(struct ldb_context *ldb,
+				  struct ldb_match_program *program,
+				  const struct ldb_parse_tree *tree,
+				  unsigned int *pos)
+{
+	struct ldb_match_op *op = &program->ops[(*pos)++];
+	unsigned int i;
+	int ret = LDB_SUCCESS;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		op->type = tree->operation == LDB_OP_AND ?
+			LDB_MATCH_OP_AND : LDB_MATCH_OP_OR;
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			ret = ldb_match_compile_tree(ldb, program,
+						     tree->u.list.elements[i],
+						     pos);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+		break;
+
+	case LDB_OP_NOT:
+		op->type = LDB_MATCH_OP_NOT;
+		ret = ldb_match_compile_tree(ldb, program,
+					     tree->u.isnot.child, pos);
+		break;
+
+	case LDB_OP_EQUALITY:
+		op->attr = tree->u.equality.attr;
+		op->value = &tree->u.equality.value;
+		if (ldb_attr_dn(op->attr) == 0) {
+			op->type = LDB_MATCH_OP_DN_EQUALITY;
+			op->dn = ldb_dn_from_ldb_val(program, ldb, op->value);
+			if (op->dn == NULL) {
+				op->type = LDB_MATCH_OP_ERROR;
+				op->error = LDB_ERR_INVALID_DN_SYNTAX;
+			}
+			break;
+		}
+		op->type = LDB_MATCH_OP_EQUALITY;
+		op->a = ldb_schema_attribute_by_name(ldb, op->attr);
+		break;
+
+	case LDB_OP_SUBSTRING:
+		op->type = LDB_MATCH_OP_SUBSTRING;
+		op->attr = tree->u.substring.attr;
+		ret = ldb_match_substring_prepare(ldb, program, tree,
+						  &op->substring);
+		break;
+
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+		op->type = tree->operation == LDB_OP_GREATER ?
+			LDB_MATCH_OP_GREATER : LDB_MATCH_OP_LESS;
+		op->attr = tree->u.comparison.attr;
+		op->value = &tree->u.comparison.value;
+		op->a = ldb_schema_attribute_by_name(ldb, op->attr);
+		break;
+
+	case LDB_OP_APPROX:
+		/* FIXME: APPROX comparison not handled yet */
+		op->type = LDB_MATCH_OP_ERROR;
+		op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		break;
+
+	case LDB_OP_PRESENT:
+		op->attr = tree->u.present.attr;
+		if (ldb_attr_dn(op->attr) == 0) {
+			op->type = LDB_MATCH_OP_CONSTANT;
+			op->matched = true;
+			break;
+		}
+		op->type = LDB_MATCH_OP_PRESENT;
+		op->a = ldb_schema_attribute_by_name(ldb, op->attr);
+		break;
+
+	case LDB_OP_EXTENDED:
+		ret = ldb_match_compile_extended(ldb, tree, op);
+		break;
+
+	default:
+		op->type = LDB_MATCH_OP_ERROR;
+		op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		break;
+	}
+
+	op->next = *pos;
+	return ret;
+}
+
+/*
+  compile a parse tree for repeated matching with
+  ldb_match_msg_program()
+
+  The program refers to the tree, which must stay around (and
+  unchanged) for as long as the program is used.
+*/
+int ldb_match_compile(struct ldb_context *ldb,
+		      TALLOC_CTX *mem_ctx,
+		      const struct ldb_parse_tree *tree,
+		      struct ldb_match_program **_program)
+{
+	struct ldb_match_program *program = NULL;
+	unsigned int pos = 0;
+	int ret;
+
+	program = talloc_zero(mem_ctx, struct ldb_match_program);
+	if (program == NULL) {
+		return ldb_oom(ldb);
+	}
+
+	program->num_ops = ldb_match_tree_count(tree);
+	program->ops = talloc_zero_array(program,
+					 struct ldb_match_op,
+					 program->num_ops);
+	if (program->ops == NULL) {
+		talloc_free(program);
+		return ldb_oom(ldb);
+	}
+
+	ret = ldb_match_compile_tree(ldb, program, tree, &pos);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(program);
+		return ret;
+	}
+
+	*_program = program;
+	return LDB_SUCCESS;
+}
+
+/*
+  run one operation of a compiled filter, and any children it has
+*/
+static int ldb_match_program_op(struct ldb_context *ldb,
+				const struct ldb_message *msg,
+				const struct ldb_match_program *program,
+				unsigned int pos,
+				bool *matched)
+{
+	const struct ldb_match_op *op = &program->ops[pos];
+	struct ldb_message_element *el = NULL;
+	unsigned int i;
+	int ret;
+
+	switch (op->type) {
+	case LDB_MATCH_OP_AND:
+		for (i = pos + 1; i < op->next; i = program->ops[i].next) {
+			ret = ldb_match_program_op(ldb, msg, program, i, matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (!*matched) return LDB_SUCCESS;
+		}
+		*matched = true;
+		return LDB_SUCCESS;
+
+	case LDB_MATCH_OP_OR:
+		for (i = pos + 1; i < op->next; i = program->ops[i].next) {
+			ret = ldb_match_program_op(ldb, msg, program, i, matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (*matched) return LDB_SUCCESS;
+		}
+		*matched = false;
+		return LDB_SUCCESS;
+
+	case LDB_MATCH_OP_NOT:
+		ret = ldb_match_program_op(ldb, msg, program, pos + 1, matched);
+		if (ret != LDB_SUCCESS) return ret;
+		*matched = ! *matched;
+		return LDB_SUCCESS;
+
+	case LDB_MATCH_OP_CONSTANT:
+		*matched = op->matched;
+		return LDB_SUCCESS;
+
+	case LDB_MATCH_OP_ERROR:
+		*matched = false;
+		return op->error;
+
+	case LDB_MATCH_OP_DN_EQUALITY:
+		*matched = (ldb_dn_compare(msg->dn, op->dn) == 0);
+		return LDB_SUCCESS;
+
+	case LDB_MATCH_OP_EXTENDED:
+		return op->rule->callback(ldb, op->rule->oid, msg,
+					  op->attr, op->value, matched);
+
+	default:
+		break;
+	}
+
+	el = ldb_msg_find_element(msg, op->attr);
+	if (el == NULL) {
+		*matched = false;
+		return LDB_SUCCESS;
+	}
+
+	switch (op->type) {
+	case LDB_MATCH_OP_EQUALITY:
+		return ldb_match_equality_el(ldb, op->a, el, op->value, matched);
+	case LDB_MATCH_OP_SUBSTRING:
+		return ldb_match_substring_el(ldb, &op->substring, el, matched);
+	case LDB_MATCH_OP_GREATER:
+		return ldb_match_comparison_el(ldb, op->a, el, op->value,
+					       LDB_OP_GREATER, matched);
+	case LDB_MATCH_OP_LESS:
+		return ldb_match_comparison_el(ldb, op->a, el, op->value,
+					       LDB_OP_LESS, matched);
+	case LDB_MATCH_OP_PRESENT:
+		return ldb_match_present_el(ldb, op->a, el, matched);
+	default:
+		break;
+	}
+
+	*matched = false;
+	return LDB_ERR_INAPPROPRIATE_MATCHING;
+}
+
+/*
+  as ldb_match_msg_error(), but with a filter compiled by
+  ldb_match_compile()
+*/
+int ldb_match_msg_program(struct ldb_context *ldb,
+			  const struct ldb_message *msg,
+			  const struct ldb_match_program *program,
+			  struct ldb_dn *base,
+			  enum ldb_scope scope,
+			  bool *matched)
+{
+	*matched = false;
+
+	if ( ! ldb_match_scope(ldb, base, msg->dn, scope) ) {
+		return LDB_SUCCESS;
+	}
+
+	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
+		/* don't match special records except on base searches */
+		return LDB_SUCCESS;
+	}
+
+	return ldb_match_program_op(ldb, msg, program, 0, matched);
+}
+
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
 			      const char *objectclass)
 {
@@ -760,13 +760,38 @@ failed:
 	return -1;
 }
 
+/*
+ * Is the attribute name in the list passed to
+ * ldb_unpack_data_flags_attrs()?  A NULL list means every attribute.
+ */
+static bool ldb_unpack_attr_wanted(const char *attr,
+				   const char * const *attrs)
+{
+	unsigned int i;
+
+	if (attrs == NULL) {
+		return true;
+	}
+
+	for (i = 0; attrs[i] != NULL; i++) {
+		if (ldb_attr_cmp(attr, attrs[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Unpack a ldb message from a linear buffer in ldb_val
+ *
+ * Elements not named in attrs (if not NULL) are stepped over without
+ * being unpacked.
  */
 static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 				    const struct ldb_val *data,
 				    struct ldb_message *message,
-				    unsigned int flags)
+				    unsigned int flags,
+				    const char * const *attrs)
 {
 	uint8_t *p, *q, *end_p, *value_section_p;
 	unsigned int i, j;
@@ -923,6 +948,52 @@ static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 			goto failed;
 		}
 
+		if (!ldb_unpack_attr_wanted(attr, attrs)) {
+			uint32_t num_values = PULL_LE_U32(p, 0);
+			p += U32_LEN;
+
+			/*
+			 * Step over the value lengths, moving q past
+			 * the values they describe
+			 */
+			val_len_width = *p;
+			p += U8_LEN;
+
+			if (val_len_width != U8_LEN &&
+			    val_len_width != U16_LEN &&
+			    val_len_width != U32_LEN) {
+				errno = ERANGE;
+				goto failed;
+			}
+			if (p + val_len_width * num_values >
+			    value_section_p) {
+				errno = EIO;
+				goto failed;
+			}
+
+			for (j = 0; j < num_values; j++) {
+				if (val_len_width == U8_LEN) {
+					len = PULL_LE_U8(p, 0);
+				} else if (val_len_width == U16_LEN) {
+					len = PULL_LE_U16(p, 0);
+				} else {
+					len = PULL_LE_U32(p, 0);
+				}
+				p += val_len_width;
+
+				if (len + NULL_PAD_BYTE_LEN < len) {
+					errno = EIO;
+					goto failed;
+				}
+				if (q + len + NULL_PAD_BYTE_LEN > end_p) {
+					errno = EIO;
+					goto failed;
+				}
+				q += len + NULL_PAD_BYTE_LEN;
+			}
+			continue;
+		}
+
 		element = &message->elements[nelem];
 		element->name = attr;
 		element->flags = 0;
@@ -1058,6 +1129,19 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 			  const struct ldb_val *data,
 			  struct ldb_message *message,
 			  unsigned int flags)
+{
+	return ldb_unpack_data_flags_attrs(ldb, data, message, flags, NULL);
+}
+
+/*
+ * Unpack a ldb message from a linear buffer in ldb_val, only unpacking
+ * the elements named in attrs
+ */
+int ldb_unpack_data_flags_attrs(struct ldb_context *ldb,
+				const struct ldb_val *data,
+				struct ldb_message *message,
+				unsigned int flags,
+				const char * const *attrs)
 {
 	unsigned format;
 
@@ -1068,7 +1152,11 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 
 	format = PULL_LE_U32(data->data, 0);
 	if (format == LDB_PACKING_FORMAT_V2) {
-		return ldb_unpack_data_flags_v2(ldb, data, message, flags);
+		return ldb_unpack_data_flags_v2(ldb,
+						data,
+						message,
+						flags,
+						attrs);
 	}
 
 	/*
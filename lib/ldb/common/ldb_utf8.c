@@ -47,6 +47,7 @@ void ldb_set_utf8_fns(struct ldb_context *ldb,
 		ldb->utf8_fns.context = context;
 	if (casefold)
 		ldb->utf8_fns.casefold = casefold;
+	ldb_dn_cache_flush(ldb);
 }
 
 /*
@@ -577,6 +577,16 @@ typedef int (*ldb_qsort_cmp_fn_t) (void *v1, void *v2, void *opaque);
 #define LDB_CONTROL_PROVISION_OID "1.3.6.1.4.1.7165.4.3.16"
 #define LDB_CONTROL_PROVISION_NAME	"provision"
 
+/**
+   LDB_CONTROL_SEARCH_EXPLAIN_OID asks the key value backends to
+   describe how a search was evaluated: the index terms considered,
+   their estimated sizes and the order they were used in, or why a full
+   scan was chosen.  The description is returned in a reply control
+   with the same OID, holding a struct ldb_search_explain_control.
+*/
+#define LDB_CONTROL_SEARCH_EXPLAIN_OID "1.3.6.1.4.1.7165.4.3.35"
+#define LDB_CONTROL_SEARCH_EXPLAIN_NAME	"search_explain"
+
 /* AD controls */
 
 /**
@@ -915,6 +925,10 @@ struct ldb_verify_name_control {
 	char *gc;
 };
 
+struct ldb_search_explain_control {
+	char *plan;
+};
+
 struct ldb_control {
 	const char *oid;
 	int critical;
@@ -246,6 +246,30 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 			enum ldb_scope scope,
 			bool *matched);
 
+/*
+ * A search filter compiled by ldb_match_compile() for matching against
+ * many messages.  The schema attribute handlers and extended match
+ * rules are looked up, and the constant parts of the filter prepared,
+ * once when the filter is compiled.
+ */
+struct ldb_match_program;
+
+int ldb_match_compile(struct ldb_context *ldb,
+		      TALLOC_CTX *mem_ctx,
+		      const struct ldb_parse_tree *tree,
+		      struct ldb_match_program **program);
+
+/*
+ * As ldb_match_msg_error(), with a filter compiled by
+ * ldb_match_compile().  A NULL base skips the scope check.
+ */
+int ldb_match_msg_program(struct ldb_context *ldb,
+			  const struct ldb_message *msg,
+			  const struct ldb_match_program *program,
+			  struct ldb_dn *base,
+			  enum ldb_scope scope,
+			  bool *matched);
+
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
 			      const char *objectclass);
 
@@ -550,6 +574,21 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 			  struct ldb_message *message,
 			  unsigned int flags);
 
+/*
+ * Unpack a ldb message from a linear buffer in ldb_val, as
+ * ldb_unpack_data_flags(), but only unpack the elements named in the
+ * NULL terminated attrs list.  The others are stepped over without
+ * allocating anything for them.  If attrs is NULL every element is
+ * unpacked.
+ *
+ * Records in the older (v1) pack formats are always unpacked in full.
+ */
+int ldb_unpack_data_flags_attrs(struct ldb_context *ldb,
+				const struct ldb_val *data,
+				struct ldb_message *message,
+				unsigned int flags,
+				const char * const *attrs);
+
 int ldb_unpack_get_format(const struct ldb_val *data,
 			  uint32_t *pack_format_version);
 
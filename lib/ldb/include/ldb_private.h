@@ -161,6 +161,9 @@ struct ldb_context {
 	 * A NULL terminated array of zero terminated strings
 	 */
 	const char **options;
+
+	/* recently casefolded DNs, see ldb_dn.c */
+	struct ldb_dn_cache *dn_cache;
 };
 
 /* The following definitions come from lib/ldb/common/ldb.c  */
@@ -206,6 +209,9 @@ const char **ldb_subclass_list(struct ldb_context *ldb, const char *classname);
 void ldb_subclass_remove(struct ldb_context *ldb, const char *classname);
 int ldb_subclass_add(struct ldb_context *ldb, const char *classname, const char *subclass);
 
+/* The following definitions come from lib/ldb/common/ldb_dn.c */
+void ldb_dn_cache_flush(struct ldb_context *ldb);
+
 /* The following definitions come from lib/ldb/common/ldb_utf8.c */
 char *ldb_casefold_default(void *context, TALLOC_CTX *mem_ctx, const char *s, size_t n);
 
@@ -1885,6 +1885,7 @@ static void ldb_kv_request_done(struct ldb_kv_context *ctx, int error)
 	}
 	ares->type = LDB_REPLY_DONE;
 	ares->error = error;
+	ares->controls = talloc_steal(ares, ctx->controls);
 
 	req->callback(req, ares);
 }
@@ -2026,6 +2027,7 @@ static int ldb_kv_handle_request(struct ldb_module *module,
 				 struct ldb_request *req)
 {
 	struct ldb_control *control_permissive;
+	struct ldb_control *control_explain;
 	struct ldb_context *ldb;
 	struct tevent_context *ev;
 	struct ldb_kv_context *ac;
@@ -2037,10 +2039,13 @@ static int ldb_kv_handle_request(struct ldb_module *module,
 
 	control_permissive = ldb_request_get_control(req,
 					LDB_CONTROL_PERMISSIVE_MODIFY_OID);
+	control_explain = ldb_request_get_control(req,
+					LDB_CONTROL_SEARCH_EXPLAIN_OID);
 
 	for (i = 0; req->controls && req->controls[i]; i++) {
 		if (req->controls[i]->critical &&
-		    req->controls[i] != control_permissive) {
+		    req->controls[i] != control_permissive &&
+		    req->controls[i] != control_explain) {
 			ldb_asprintf_errstring(ldb, "Unsupported critical extension %s",
 					       req->controls[i]->oid);
 			return LDB_ERR_UNSUPPORTED_CRITICAL_EXTENSION;
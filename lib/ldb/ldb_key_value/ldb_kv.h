@@ -146,6 +146,13 @@ struct ldb_kv_private {
 	 * The size to be used for the index transaction cache
 	 */
 	size_t index_transaction_cache_size;
+
+	/*
+	 * If not NULL, the indexing code appends a description of the
+	 * plan chosen for the current search here.  This is set up by
+	 * ldb_kv_search() for LDB_CONTROL_SEARCH_EXPLAIN_OID.
+	 */
+	char *explain;
 };
 
 struct ldb_kv_context {
@@ -160,15 +167,24 @@ struct ldb_kv_context {
 	struct ldb_dn *base;
 	enum ldb_scope scope;
 	const char * const *attrs;
+	/* attributes to unpack from each record, NULL for all */
+	const char **unpack_attrs;
+	/* the search filter, compiled for matching each candidate */
+	struct ldb_match_program *match_program;
 	struct tevent_timer *timeout_event;
 
 	/* error handling */
 	int error;
+
+	/* controls for the final reply */
+	struct ldb_control **controls;
 };
 
 struct ldb_kv_reindex_context {
 	int error;
 	uint32_t count;
+	/* when the current pass started, for the progress messages */
+	struct timeval start;
 };
 
 struct ldb_kv_repack_context {
@@ -176,6 +192,7 @@ struct ldb_kv_repack_context {
 	uint32_t count;
 	bool normal_record_seen;
 	uint32_t old_version;
+	struct timeval start;
 };
 
 
@@ -291,6 +308,12 @@ int ldb_kv_search_key(struct ldb_module *module,
 		      const struct ldb_val ldb_key,
 		      struct ldb_message *msg,
 		      unsigned int unpack_flags);
+int ldb_kv_search_key_attrs(struct ldb_module *module,
+			    struct ldb_kv_private *ldb_kv,
+			    const struct ldb_val ldb_key,
+			    struct ldb_message *msg,
+			    unsigned int unpack_flags,
+			    const char * const *attrs);
 int ldb_kv_filter_attrs(struct ldb_context *ldb,
 			const struct ldb_message *msg,
 			const char *const *attrs,
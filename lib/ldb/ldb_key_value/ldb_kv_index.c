@@ -170,6 +170,13 @@ struct ldb_kv_idxptr {
 	 */
 	struct tdb_context *itdb;
 	int error;
+	/*
+	 * Set while a re-index builds the index from scratch.  GUID
+	 * index values are then appended to the cached lists rather
+	 * than inserted in order, and each list is sorted once by
+	 * ldb_kv_index_bulk_load_finish() at the end of the pass.
+	 */
+	bool bulk_load;
 };
 
 enum key_truncation {
@@ -196,6 +203,29 @@ static void ldb_kv_dn_list_sort(struct ldb_kv_private *ldb_kv,
 
 #define LDB_KV_GUID_INDEXING_VERSION 3
 
+/*
+  append to the description of the search plan, if one was asked for
+  with LDB_CONTROL_SEARCH_EXPLAIN_OID
+ */
+static void ldb_kv_explain(struct ldb_kv_private *ldb_kv,
+			   const char *fmt, ...) PRINTF_ATTRIBUTE(2, 3);
+
+static void ldb_kv_explain(struct ldb_kv_private *ldb_kv,
+			   const char *fmt, ...)
+{
+	va_list ap;
+
+	if (ldb_kv->explain == NULL) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	ldb_kv->explain = talloc_vasprintf_append_buffer(ldb_kv->explain,
+							 fmt,
+							 ap);
+	va_end(ap);
+}
+
 static unsigned ldb_kv_max_key_length(struct ldb_kv_private *ldb_kv)
 {
 	if (ldb_kv->max_key_length == 0) {
@@ -324,6 +354,85 @@ static int ldb_kv_dn_list_find_msg(struct ldb_kv_private *ldb_kv,
 	return ldb_kv_dn_list_find_val(ldb_kv, list, &v);
 }
 
+/*
+  find the first entry in a sorted (GUID index) dn_list that is not
+  less than v, starting at index start.
+
+  This gallops forward before doing the binary search, so walking a
+  sorted list of m values over a list of n costs O(m log(n/m)) rather
+  than O(m log n) comparisons.
+ */
+static unsigned int ldb_kv_dn_list_gallop(const struct dn_list *list,
+					  unsigned int start,
+					  const struct ldb_val *v)
+{
+	unsigned int lo = start;
+	unsigned int hi = start;
+	unsigned int step = 1;
+
+	while (hi < list->count &&
+	       ldb_val_equal_exact_ordered(list->dn[hi], v) < 0) {
+		lo = hi + 1;
+		if (list->count - hi <= step) {
+			hi = list->count;
+			break;
+		}
+		hi += step;
+		step *= 2;
+	}
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (ldb_val_equal_exact_ordered(list->dn[mid], v) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/*
+  the same as ldb_kv_dn_list_gallop() but over the packed array of
+  GUIDs as stored in the @IDX attribute of a GUID index record
+ */
+static unsigned int ldb_kv_guid_array_gallop(const uint8_t *guids,
+					     unsigned int count,
+					     unsigned int start,
+					     const uint8_t *guid)
+{
+	unsigned int lo = start;
+	unsigned int hi = start;
+	unsigned int step = 1;
+
+	while (hi < count &&
+	       memcmp(&guids[hi * LDB_KV_GUID_SIZE],
+		      guid,
+		      LDB_KV_GUID_SIZE) < 0) {
+		lo = hi + 1;
+		if (count - hi <= step) {
+			hi = count;
+			break;
+		}
+		hi += step;
+		step *= 2;
+	}
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (memcmp(&guids[mid * LDB_KV_GUID_SIZE],
+			   guid,
+			   LDB_KV_GUID_SIZE) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
 /*
   this is effectively a cast function, but with lots of paranoia
   checks and also copes with CPUs that are fussy about pointer
@@ -1451,12 +1560,34 @@ static bool list_intersect(struct ldb_kv_private *ldb_kv,
 	}
 	list3->count = 0;
 
-	for (i=0;i<short_list->count;i++) {
-		/* For the GUID index case, this is a binary search */
-		if (ldb_kv_dn_list_find_val(
-			ldb_kv, long_list, &short_list->dn[i]) != -1) {
-			list3->dn[list3->count] = short_list->dn[i];
-			list3->count++;
+	if (ldb_kv->cache->GUID_index_attribute != NULL) {
+		/*
+		 * Both lists are sorted, so walk the short list and
+		 * gallop through the long one from the last match
+		 */
+		unsigned int j = 0;
+
+		for (i = 0; i < short_list->count; i++) {
+			j = ldb_kv_dn_list_gallop(long_list,
+						  j,
+						  &short_list->dn[i]);
+			if (j == long_list->count) {
+				break;
+			}
+			if (ldb_val_equal_exact_ordered(
+				short_list->dn[i], &long_list->dn[j]) == 0) {
+				list3->dn[list3->count] = short_list->dn[i];
+				list3->count++;
+				j++;
+			}
+		}
+	} else {
+		for (i = 0; i < short_list->count; i++) {
+			if (ldb_kv_dn_list_find_val(
+				ldb_kv, long_list, &short_list->dn[i]) != -1) {
+				list3->dn[list3->count] = short_list->dn[i];
+				list3->count++;
+			}
 		}
 	}
 
@@ -1654,6 +1785,473 @@ static bool ldb_kv_index_unique(struct ldb_context *ldb,
 	return false;
 }
 
+struct ldb_kv_index_probe_context {
+	struct ldb_module *module;
+	struct dn_list *list;
+	struct ldb_val *dn;
+	unsigned int count;
+};
+
+/*
+  parse a GUID index record in place and intersect the packed @IDX
+  value with the list in the context, without building a dn_list for
+  the stored record
+ */
+static int ldb_kv_index_probe_parser(struct ldb_val key,
+				     struct ldb_val data,
+				     void *private_data)
+{
+	struct ldb_kv_index_probe_context *ctx = private_data;
+	struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+	struct dn_list *list = ctx->list;
+	struct ldb_message *msg = NULL;
+	struct ldb_message_element *el = NULL;
+	const uint8_t *guids = NULL;
+	unsigned int num_guids;
+	unsigned int i;
+	unsigned int j;
+	int version;
+	int ret;
+
+	msg = ldb_msg_new(list);
+	if (msg == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_unpack_data_flags(ldb, &data, msg,
+				    LDB_UNPACK_DATA_FLAG_NO_DN |
+				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+	if (ret != LDB_SUCCESS) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid data for index %*.*s\n",
+			  (int)key.length, (int)key.length, key.data);
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	el = ldb_msg_find_element(msg, LDB_KV_IDX);
+	if (el == NULL) {
+		talloc_free(msg);
+		ctx->count = 0;
+		return LDB_SUCCESS;
+	}
+
+	version = ldb_msg_find_attr_as_int(msg, LDB_KV_IDXVERSION, 0);
+	if (version != LDB_KV_GUID_INDEXING_VERSION) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (el->num_values == 0 ||
+	    (el->values[0].length % LDB_KV_GUID_SIZE) != 0) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	guids = el->values[0].data;
+	num_guids = el->values[0].length / LDB_KV_GUID_SIZE;
+
+	ctx->dn = talloc_array(list,
+			       struct ldb_val,
+			       MIN(list->count, num_guids));
+	if (ctx->dn == NULL) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	ctx->count = 0;
+
+	/*
+	 * Both sides are sorted. Walk the shorter one and gallop
+	 * through the longer one, keeping the values of list (which
+	 * outlive this callback) for the result.
+	 */
+	if (list->count <= num_guids) {
+		j = 0;
+		for (i = 0; i < list->count; i++) {
+			if (list->dn[i].length != LDB_KV_GUID_SIZE) {
+				continue;
+			}
+			j = ldb_kv_guid_array_gallop(guids,
+						     num_guids,
+						     j,
+						     list->dn[i].data);
+			if (j == num_guids) {
+				break;
+			}
+			if (memcmp(&guids[j * LDB_KV_GUID_SIZE],
+				   list->dn[i].data,
+				   LDB_KV_GUID_SIZE) == 0) {
+				ctx->dn[ctx->count++] = list->dn[i];
+				j++;
+			}
+		}
+	} else {
+		struct ldb_val v = {
+			.length = LDB_KV_GUID_SIZE
+		};
+		j = 0;
+		for (i = 0; i < num_guids; i++) {
+			v.data = discard_const_p(uint8_t,
+						 &guids[i * LDB_KV_GUID_SIZE]);
+			j = ldb_kv_dn_list_gallop(list, j, &v);
+			if (j == list->count) {
+				break;
+			}
+			if (ldb_val_equal_exact_ordered(v, &list->dn[j]) == 0) {
+				ctx->dn[ctx->count++] = list->dn[j];
+				j++;
+			}
+		}
+	}
+
+	talloc_free(msg);
+	return LDB_SUCCESS;
+}
+
+/*
+  can the index record for this subtree be intersected with an
+  existing result by ldb_kv_index_dn_probe()?
+
+  This is only the case for a plain equality match in a GUID indexed
+  database outside a transaction, where the index record on disk is
+  current and in the packed GUID format.
+ */
+static bool ldb_kv_index_dn_can_probe(struct ldb_module *module,
+				      struct ldb_kv_private *ldb_kv,
+				      const struct ldb_parse_tree *tree)
+{
+	if (ldb_kv->cache->GUID_index_attribute == NULL) {
+		return false;
+	}
+	if (ldb_kv->idxptr != NULL) {
+		return false;
+	}
+	if (tree->operation != LDB_OP_EQUALITY) {
+		return false;
+	}
+	if (tree->u.equality.attr[0] == '@') {
+		return false;
+	}
+	if (ldb_attr_dn(tree->u.equality.attr) == 0) {
+		return false;
+	}
+	return ldb_kv_is_indexed(module, ldb_kv, tree->u.equality.attr);
+}
+
+/*
+  intersect list with the index record for an equality match, reading
+  the stored GUIDs in place.
+
+  This avoids loading a large index record (for example the
+  objectClass=user index of a big domain) into a dn_list only to
+  throw nearly all of it away in list_intersect().
+
+  The return values are those of ldb_kv_index_dn(), with
+  LDB_ERR_OPERATIONS_ERROR meaning the caller should load the index
+  the normal way.
+ */
+static int ldb_kv_index_dn_probe(struct ldb_module *module,
+				 struct ldb_kv_private *ldb_kv,
+				 const struct ldb_parse_tree *tree,
+				 struct dn_list *list)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_kv_index_probe_context ctx = {
+		.module = module,
+		.list = list,
+	};
+	enum key_truncation truncation = KEY_NOT_TRUNCATED;
+	struct ldb_dn *dn = NULL;
+	struct ldb_val key;
+	int ret;
+
+	dn = ldb_kv_index_key(ldb,
+			      ldb_kv,
+			      tree->u.equality.attr,
+			      &tree->u.equality.value,
+			      NULL,
+			      &truncation);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	key = ldb_kv_key_dn(dn, dn);
+	if (key.data == NULL) {
+		talloc_free(dn);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_kv->kv_ops->fetch_and_parse(
+	    ldb_kv, key, ldb_kv_index_probe_parser, &ctx);
+	talloc_free(dn);
+	if (ret == -1) {
+		ret = ldb_kv->kv_ops->error(ldb_kv);
+		if (ret == LDB_SUCCESS) {
+			ret = LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		/* no index record, so nothing matches */
+		ctx.count = 0;
+	} else if (ret != LDB_SUCCESS) {
+		TALLOC_FREE(ctx.dn);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (ctx.count == 0) {
+		TALLOC_FREE(ctx.dn);
+		list->dn = NULL;
+		list->count = 0;
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+
+	list->dn = ctx.dn;
+	list->count = ctx.count;
+	return LDB_SUCCESS;
+}
+
+struct ldb_kv_index_estimate_context {
+	struct ldb_module *module;
+	struct ldb_kv_private *ldb_kv;
+	unsigned int count;
+};
+
+/*
+  count the values in an index record without building a dn_list
+ */
+static int ldb_kv_index_estimate_parser(struct ldb_val key,
+					struct ldb_val data,
+					void *private_data)
+{
+	struct ldb_kv_index_estimate_context *ctx = private_data;
+	struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+	struct ldb_message *msg = NULL;
+	struct ldb_message_element *el = NULL;
+	int ret;
+
+	msg = ldb_msg_new(ctx->module);
+	if (msg == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_unpack_data_flags(ldb, &data, msg,
+				    LDB_UNPACK_DATA_FLAG_NO_DN |
+				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+	if (ret != LDB_SUCCESS) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid data for index %*.*s\n",
+			  (int)key.length, (int)key.length, key.data);
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ctx->count = 0;
+	el = ldb_msg_find_element(msg, LDB_KV_IDX);
+	if (el != NULL) {
+		if (ctx->ldb_kv->cache->GUID_index_attribute == NULL) {
+			ctx->count = el->num_values;
+		} else if (el->num_values > 0) {
+			ctx->count = el->values[0].length / LDB_KV_GUID_SIZE;
+		}
+	}
+
+	talloc_free(msg);
+	return LDB_SUCCESS;
+}
+
+/*
+  estimate the number of entries matching a simple equality test from
+  the size of its index record.
+
+  The index record holds one value per matching entry, so this is
+  exact (apart from truncated keys) but avoids loading the record into
+  a dn_list.  Inside a transaction the index transaction cache is
+  consulted first, as ldb_kv_dn_list_load() would.
+
+  Returns LDB_ERR_OPERATIONS_ERROR if the test can't be answered by a
+  single index record.
+ */
+static int ldb_kv_index_dn_estimate(struct ldb_module *module,
+				    struct ldb_kv_private *ldb_kv,
+				    const struct ldb_parse_tree *tree,
+				    unsigned int *estimate)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_kv_index_estimate_context ctx = {
+		.module = module,
+		.ldb_kv = ldb_kv,
+	};
+	enum key_truncation truncation = KEY_NOT_TRUNCATED;
+	struct ldb_dn *dn = NULL;
+	struct ldb_val key;
+	int ret;
+
+	if (tree->operation != LDB_OP_EQUALITY) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	if (tree->u.equality.attr[0] == '@') {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	if (ldb_attr_dn(tree->u.equality.attr) == 0) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	if (!ldb_kv_is_indexed(module, ldb_kv, tree->u.equality.attr)) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	dn = ldb_kv_index_key(ldb,
+			      ldb_kv,
+			      tree->u.equality.attr,
+			      &tree->u.equality.value,
+			      NULL,
+			      &truncation);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (ldb_kv->idxptr != NULL) {
+		TDB_DATA rec = {0};
+		TDB_DATA idx_key = {0};
+		struct dn_list *list = NULL;
+
+		idx_key.dptr = discard_const_p(unsigned char,
+					       ldb_dn_get_linearized(dn));
+		if (idx_key.dptr == NULL) {
+			talloc_free(dn);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		idx_key.dsize = strlen((char *)idx_key.dptr);
+
+		if (ldb_kv->nested_idx_ptr != NULL) {
+			rec = tdb_fetch(ldb_kv->nested_idx_ptr->itdb, idx_key);
+		}
+		if (rec.dptr == NULL) {
+			rec = tdb_fetch(ldb_kv->idxptr->itdb, idx_key);
+		}
+		if (rec.dptr != NULL) {
+			list = ldb_kv_index_idxptr(module, rec);
+			free(rec.dptr);
+			talloc_free(dn);
+			if (list == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+			*estimate = list->count;
+			return LDB_SUCCESS;
+		}
+	}
+
+	key = ldb_kv_key_dn(dn, dn);
+	if (key.data == NULL) {
+		talloc_free(dn);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_kv->kv_ops->fetch_and_parse(
+	    ldb_kv, key, ldb_kv_index_estimate_parser, &ctx);
+	talloc_free(dn);
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		/* no index record, so nothing matches */
+		*estimate = 0;
+		return LDB_SUCCESS;
+	}
+	if (ret != LDB_SUCCESS) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	*estimate = ctx.count;
+	return LDB_SUCCESS;
+}
+
+/*
+ * The estimate for an AND term that can't be answered from a single
+ * index record
+ */
+#define LDB_KV_PLAN_UNKNOWN UINT_MAX
+
+/*
+ * A term whose index record is more than this many times longer than
+ * the candidate list built so far isn't worth intersecting, as the
+ * candidates are filtered against the full expression anyway.
+ */
+#define LDB_KV_PLAN_SKIP_RATIO 100
+
+/*
+ * If even the most selective term of an AND is expected to match more
+ * than 1/LDB_KV_PLAN_FULL_SCAN_FRACTION of the records in the
+ * database, fetching each candidate costs more than a full scan.
+ */
+#define LDB_KV_PLAN_FULL_SCAN_FRACTION 4
+
+struct ldb_kv_plan_term {
+	const struct ldb_parse_tree *tree;
+	unsigned int estimate;
+	unsigned int position;
+};
+
+/*
+  order AND terms by estimate, keeping the filter order for equal (or
+  unknown) estimates
+ */
+static int ldb_kv_plan_term_cmp(const struct ldb_kv_plan_term *t1,
+				const struct ldb_kv_plan_term *t2)
+{
+	if (t1->estimate != t2->estimate) {
+		return t1->estimate < t2->estimate ? -1 : 1;
+	}
+	if (t1->position != t2->position) {
+		return t1->position < t2->position ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+  would a full scan be cheaper than fetching this many candidates?
+ */
+static bool ldb_kv_plan_full_scan(struct ldb_kv_private *ldb_kv,
+				  unsigned int estimate)
+{
+	size_t size;
+
+	if (ldb_kv->disable_full_db_scan) {
+		return false;
+	}
+	if (ldb_kv->kv_ops->get_size == NULL) {
+		return false;
+	}
+
+	size = ldb_kv->kv_ops->get_size(ldb_kv);
+	if (size == 0) {
+		return false;
+	}
+
+	return estimate > size / LDB_KV_PLAN_FULL_SCAN_FRACTION;
+}
+
+/*
+  describe what was done with an AND term in the search plan
+ */
+static void ldb_kv_explain_term(struct ldb_kv_private *ldb_kv,
+				const struct ldb_kv_plan_term *term,
+				const char *action,
+				unsigned int count)
+{
+	char *expression = NULL;
+
+	if (ldb_kv->explain == NULL) {
+		return;
+	}
+
+	expression = ldb_filter_from_tree(ldb_kv, term->tree);
+	if (term->estimate == LDB_KV_PLAN_UNKNOWN) {
+		ldb_kv_explain(ldb_kv,
+			       "  %s estimate unknown: %s, %u candidates\n",
+			       expression, action, count);
+	} else {
+		ldb_kv_explain(ldb_kv,
+			       "  %s estimate %u: %s, %u candidates\n",
+			       expression, term->estimate, action, count);
+	}
+	TALLOC_FREE(expression);
+}
+
 /*
   process an AND expression (intersection)
  */
@@ -1663,14 +2261,22 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			       struct dn_list *list)
 {
 	struct ldb_context *ldb;
+	struct ldb_kv_plan_term *terms = NULL;
 	unsigned int i;
 	bool found;
+	bool all_estimated = true;
 
 	ldb = ldb_module_get_ctx(module);
 
 	list->dn = NULL;
 	list->count = 0;
 
+	if (ldb_kv->explain != NULL) {
+		char *expression = ldb_filter_from_tree(ldb_kv, tree);
+		ldb_kv_explain(ldb_kv, "%s\n", expression);
+		TALLOC_FREE(expression);
+	}
+
 	/* in the first pass we only look for unique simple
 	   equality tests, in the hope of avoiding having to look
 	   at any others */
@@ -1694,20 +2300,109 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			 * stop. Note that we don't care if we return
 			 * a few too many objects, due to later
 			 * filtering */
+			if (ldb_kv->explain != NULL) {
+				struct ldb_kv_plan_term term = {
+					.tree = subtree,
+					.estimate = list->count,
+				};
+				ldb_kv_explain_term(ldb_kv,
+						    &term,
+						    "unique index",
+						    list->count);
+			}
 			return LDB_SUCCESS;
 		}
 	}
 
-	/* now do a full intersection */
-	found = false;
+	/*
+	 * now do a full intersection, starting with the smallest index
+	 * records and skipping those that would barely narrow the
+	 * candidates down
+	 */
+	terms = talloc_array(list,
+			     struct ldb_kv_plan_term,
+			     tree->u.list.num_elements);
+	if (terms == NULL) {
+		return ldb_module_oom(module);
+	}
 
 	for (i=0; i<tree->u.list.num_elements; i++) {
 		const struct ldb_parse_tree *subtree = tree->u.list.elements[i];
+		int ret;
+
+		terms[i].tree = subtree;
+		terms[i].position = i;
+		ret = ldb_kv_index_dn_estimate(module,
+					       ldb_kv,
+					       subtree,
+					       &terms[i].estimate);
+		if (ret != LDB_SUCCESS) {
+			terms[i].estimate = LDB_KV_PLAN_UNKNOWN;
+			all_estimated = false;
+			continue;
+		}
+		if (terms[i].estimate == 0) {
+			/* X && 0 == 0 */
+			ldb_kv_explain_term(ldb_kv, &terms[i], "no match", 0);
+			talloc_free(terms);
+			return LDB_ERR_NO_SUCH_OBJECT;
+		}
+	}
+
+	TYPESAFE_QSORT(terms, tree->u.list.num_elements, ldb_kv_plan_term_cmp);
+
+	if (all_estimated &&
+	    ldb_kv_plan_full_scan(ldb_kv, terms[0].estimate)) {
+		ldb_kv_explain(ldb_kv,
+			       "  full scan is cheaper than %u candidates\n",
+			       terms[0].estimate);
+		talloc_free(terms);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	found = false;
+
+	for (i=0; i<tree->u.list.num_elements; i++) {
+		const struct ldb_kv_plan_term *term = &terms[i];
+		const struct ldb_parse_tree *subtree = term->tree;
 		struct dn_list *list2;
 		int ret;
 
+		if (found &&
+		    term->estimate != LDB_KV_PLAN_UNKNOWN &&
+		    term->estimate / LDB_KV_PLAN_SKIP_RATIO > list->count) {
+			ldb_kv_explain_term(ldb_kv, term, "skipped", list->count);
+			continue;
+		}
+
+		if (found &&
+		    ldb_kv_index_dn_can_probe(module, ldb_kv, subtree)) {
+			ret = ldb_kv_index_dn_probe(module,
+						    ldb_kv,
+						    subtree,
+						    list);
+			if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+				/* X && 0 == 0 */
+				ldb_kv_explain_term(ldb_kv, term, "probed", 0);
+				talloc_free(terms);
+				return LDB_ERR_NO_SUCH_OBJECT;
+			}
+			if (ret == LDB_SUCCESS) {
+				ldb_kv_explain_term(ldb_kv,
+						    term,
+						    "probed",
+						    list->count);
+				if (list->count < 2) {
+					talloc_free(terms);
+					return LDB_SUCCESS;
+				}
+				continue;
+			}
+		}
+
 		list2 = talloc_zero(list, struct dn_list);
 		if (list2 == NULL) {
+			talloc_free(terms);
 			return ldb_module_oom(module);
 		}
 
@@ -1715,14 +2410,20 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/* X && 0 == 0 */
+			ldb_kv_explain_term(ldb_kv, term, "loaded", 0);
 			list->dn = NULL;
 			list->count = 0;
 			talloc_free(list2);
+			talloc_free(terms);
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
 
 		if (ret != LDB_SUCCESS) {
 			/* this didn't adding anything */
+			ldb_kv_explain_term(ldb_kv,
+					    term,
+					    "not indexed",
+					    list->count);
 			talloc_free(list2);
 			continue;
 		}
@@ -1734,20 +2435,26 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			found = true;
 		} else if (!list_intersect(ldb_kv, list, list2)) {
 			talloc_free(list2);
+			talloc_free(terms);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
+		ldb_kv_explain_term(ldb_kv, term, "loaded", list->count);
 
 		if (list->count == 0) {
 			list->dn = NULL;
+			talloc_free(terms);
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
 
 		if (list->count < 2) {
 			/* it isn't worth loading the next part of the tree */
+			talloc_free(terms);
 			return LDB_SUCCESS;
 		}
 	}
 
+	talloc_free(terms);
+
 	if (!found) {
 		/* none of the attributes were indexed */
 		return LDB_ERR_OPERATIONS_ERROR;
@@ -2328,17 +3035,18 @@ static int ldb_kv_index_filter(struct ldb_kv_private *ldb_kv,
 		}
 
 		ret =
-		    ldb_kv_search_key(ac->module,
-				      ldb_kv,
-				      keys[i],
-				      msg,
-				      LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
-				      /*
-				       * The entry point ldb_kv_search_indexed is
-				       * only called from the read-locked
-				       * ldb_kv_search.
-				       */
-				      LDB_UNPACK_DATA_FLAG_READ_LOCKED);
+		    ldb_kv_search_key_attrs(ac->module,
+					    ldb_kv,
+					    keys[i],
+					    msg,
+					    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
+					    /*
+					     * The entry point ldb_kv_search_indexed
+					     * is only called from the read-locked
+					     * ldb_kv_search.
+					     */
+					    LDB_UNPACK_DATA_FLAG_READ_LOCKED,
+					    ac->unpack_attrs);
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/*
 			 * the record has disappeared? yes, this can
@@ -2366,12 +3074,15 @@ static int ldb_kv_index_filter(struct ldb_kv_private *ldb_kv,
 		if (ac->scope == LDB_SCOPE_ONELEVEL &&
 		    ldb_kv->cache->one_level_indexes &&
 		    scope_one_truncation == KEY_NOT_TRUNCATED) {
-			ret = ldb_match_message(ldb, msg, ac->tree,
-						ac->scope, &matched);
+			ret = ldb_match_msg_program(ldb, msg,
+						    ac->match_program,
+						    NULL, ac->scope,
+						    &matched);
 		} else {
-			ret = ldb_match_msg_error(ldb, msg,
-						  ac->tree, ac->base,
-						  ac->scope, &matched);
+			ret = ldb_match_msg_program(ldb, msg,
+						    ac->match_program,
+						    ac->base, ac->scope,
+						    &matched);
 		}
 
 		if (ret != LDB_SUCCESS) {
@@ -2605,6 +3316,8 @@ int ldb_kv_search_indexed(struct ldb_kv_context *ac, uint32_t *match_count)
 	 * processing as the truncation here refers only to the
 	 * SCOPE_ONELEVEL index.
 	 */
+	ldb_kv_explain(ldb_kv, "indexed: %u candidates\n", dn_list->count);
+
 	ret = ldb_kv_index_filter(
 	    ldb_kv, dn_list, ac, match_count, scope_one_truncation);
 	talloc_free(dn_list);
@@ -2644,6 +3357,7 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 	struct dn_list *list;
 	unsigned alloc_len;
 	enum key_truncation truncation = KEY_TRUNCATED;
+	bool bulk_load;
 
 
 	ldb = ldb_module_get_ctx(module);
@@ -2822,13 +3536,32 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 		return LDB_ERR_CONSTRAINT_VIOLATION;
 	}
 
-	/* overallocate the list a bit, to reduce the number of
-	 * realloc trigered copies */
-	alloc_len = ((list->count+1)+7) & ~7;
-	list->dn = talloc_realloc(list, list->dn, struct ldb_val, alloc_len);
-	if (list->dn == NULL) {
-		talloc_free(list);
-		return LDB_ERR_OPERATIONS_ERROR;
+	bulk_load = ldb_kv->idxptr != NULL &&
+		    ldb_kv->idxptr->bulk_load &&
+		    ldb_kv->nested_idx_ptr == NULL;
+
+	if (bulk_load) {
+		/*
+		 * During a re-index the list only ever grows, so grow
+		 * it geometrically rather than copying it every 8
+		 * values.
+		 */
+		alloc_len = talloc_array_length(list->dn);
+		if (list->count + 1 > alloc_len) {
+			alloc_len = MAX(8, alloc_len * 2);
+		}
+	} else {
+		/* overallocate the list a bit, to reduce the number of
+		 * realloc trigered copies */
+		alloc_len = ((list->count+1)+7) & ~7;
+	}
+	if (alloc_len != talloc_array_length(list->dn)) {
+		list->dn = talloc_realloc(list, list->dn, struct ldb_val,
+					  alloc_len);
+		if (list->dn == NULL) {
+			talloc_free(list);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
 	}
 
 	if (ldb_kv->cache->GUID_index_attribute == NULL) {
@@ -2855,9 +3588,24 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 			return ldb_module_operr(module);
 		}
 
-		BINARY_ARRAY_SEARCH_GTE(list->dn, list->count,
-					*key_val, ldb_val_equal_exact_ordered,
-					exact, next);
+		if (bulk_load) {
+			/*
+			 * Append, the list is sorted at the end of the
+			 * re-index.  All the values for one record are
+			 * added together, so a duplicate can only be
+			 * the last value in the list.
+			 */
+			if (list->count > 0 &&
+			    ldb_val_equal_exact(&list->dn[list->count - 1],
+						key_val)) {
+				exact = &list->dn[list->count - 1];
+			}
+		} else {
+			BINARY_ARRAY_SEARCH_GTE(list->dn, list->count,
+						*key_val,
+						ldb_val_equal_exact_ordered,
+						exact, next);
+		}
 
 		/*
 		 * Give a warning rather than fail, this could be a
@@ -3322,6 +4070,91 @@ int ldb_kv_index_delete(struct ldb_module *module,
 }
 
 
+/*
+  log the progress of a re-index or re-pack pass, with the rate it is
+  running at
+*/
+static void ldb_kv_reindex_progress(struct ldb_context *ldb,
+				    const char *what,
+				    uint32_t count,
+				    struct timeval start,
+				    bool done)
+{
+	struct timeval now = tevent_timeval_current();
+	struct timeval elapsed = tevent_timeval_until(&start, &now);
+	double secs = elapsed.tv_sec + elapsed.tv_usec / 1000000.0;
+	double rate = secs > 0 ? count / secs : 0;
+
+	if (done) {
+		ldb_debug(ldb, LDB_DEBUG_WARNING,
+			  "%s %u records in %.1f seconds (%.0f records/s)",
+			  what, count, secs, rate);
+	} else {
+		ldb_debug(ldb, LDB_DEBUG_WARNING,
+			  "%s %u records so far (%.0f records/s)",
+			  what, count, rate);
+	}
+}
+
+/*
+  traverse function sorting a GUID index list built by appending
+  during a re-index
+ */
+static int ldb_kv_index_bulk_load_traverse(_UNUSED_ struct tdb_context *tdb,
+					   _UNUSED_ TDB_DATA key,
+					   TDB_DATA data,
+					   void *state)
+{
+	struct ldb_module *module = state;
+	struct ldb_kv_private *ldb_kv = talloc_get_type(
+	    ldb_module_get_private(module), struct ldb_kv_private);
+	struct dn_list *list = NULL;
+
+	if (ldb_kv->cache->GUID_index_attribute == NULL) {
+		/* DN index lists are not kept in any order */
+		return 0;
+	}
+
+	list = ldb_kv_index_idxptr(module, data);
+	if (list == NULL) {
+		ldb_kv->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
+		return -1;
+	}
+
+	if (list->count > 1) {
+		TYPESAFE_QSORT(list->dn, list->count,
+			       ldb_val_equal_exact_for_qsort);
+	}
+	return 0;
+}
+
+/*
+  end the bulk load of the index cache started by a re-index, putting
+  every GUID index list back into sorted order
+ */
+static int ldb_kv_index_bulk_load_finish(struct ldb_module *module,
+					 struct ldb_kv_private *ldb_kv)
+{
+	int ret;
+
+	if (ldb_kv->idxptr == NULL || !ldb_kv->idxptr->bulk_load) {
+		return LDB_SUCCESS;
+	}
+	ldb_kv->idxptr->bulk_load = false;
+
+	ret = tdb_traverse(ldb_kv->idxptr->itdb,
+			   ldb_kv_index_bulk_load_traverse,
+			   module);
+	if (ret < 0) {
+		ret = ldb_kv->idxptr->error;
+		if (ret == LDB_SUCCESS) {
+			ret = LDB_ERR_OPERATIONS_ERROR;
+		}
+		return ret;
+	}
+	return LDB_SUCCESS;
+}
+
 /*
   traversal function that deletes all @INDEX records in the in-memory
   TDB.
@@ -3388,6 +4221,7 @@ static int re_key(struct ldb_kv_private *ldb_kv,
 	int ret;
 	struct ldb_val key2;
 	bool is_record;
+	const char *attrs[] = { ldb_kv->cache->GUID_index_attribute, NULL };
 
 	ldb = ldb_module_get_ctx(module);
 
@@ -3401,7 +4235,13 @@ static int re_key(struct ldb_kv_private *ldb_kv,
 		return -1;
 	}
 
-	ret = ldb_unpack_data(ldb, &val, msg);
+	/*
+	 * The key only depends on the DN and (in GUID index mode) the
+	 * GUID, so don't unpack or copy anything else.
+	 */
+	ret = ldb_unpack_data_flags_attrs(ldb, &val, msg,
+					  LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC,
+					  attrs);
 	if (ret != 0) {
 		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid data for index %s\n",
 						ldb_dn_get_linearized(msg->dn));
@@ -3442,9 +4282,8 @@ static int re_key(struct ldb_kv_private *ldb_kv,
 
 	ctx->count++;
 	if (ctx->count % 10000 == 0) {
-		ldb_debug(ldb, LDB_DEBUG_WARNING,
-			  "Reindexing: re-keyed %u records so far",
-			  ctx->count);
+		ldb_kv_reindex_progress(ldb, "Reindexing: re-keyed",
+					ctx->count, ctx->start, false);
 	}
 
 	return 0;
@@ -3478,7 +4317,13 @@ static int re_index(struct ldb_kv_private *ldb_kv,
 		return -1;
 	}
 
-	ret = ldb_unpack_data(ldb, &val, msg);
+	/*
+	 * The index code copies the values it keeps, so the single
+	 * values can share one preallocated ldb_val array rather than
+	 * an array each
+	 */
+	ret = ldb_unpack_data_flags(ldb, &val, msg,
+				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
 	if (ret != 0) {
 		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid data for index %s\n",
 						ldb_dn_get_linearized(msg->dn));
@@ -3518,9 +4363,8 @@ static int re_index(struct ldb_kv_private *ldb_kv,
 
 	ctx->count++;
 	if (ctx->count % 10000 == 0) {
-		ldb_debug(ldb, LDB_DEBUG_WARNING,
-			  "Reindexing: re-indexed %u records so far",
-			  ctx->count);
+		ldb_kv_reindex_progress(ldb, "Reindexing: re-indexed",
+					ctx->count, ctx->start, false);
 	}
 
 	return 0;
@@ -3594,9 +4438,8 @@ static int re_pack(struct ldb_kv_private *ldb_kv,
 
 	ctx->count++;
 	if (ctx->count % 10000 == 0) {
-		ldb_debug(ldb, LDB_DEBUG_WARNING,
-			  "Repack: re-packed %u records so far",
-			  ctx->count);
+		ldb_kv_reindex_progress(ldb, "Repack: re-packed",
+					ctx->count, ctx->start, false);
 	}
 
 	talloc_free(msg);
@@ -3615,6 +4458,7 @@ int ldb_kv_repack(struct ldb_module *module)
 	ctx.count = 0;
 	ctx.error = LDB_SUCCESS;
 	ctx.normal_record_seen = false;
+	ctx.start = tevent_timeval_current();
 
 	ldb_kv->pack_format_version = ldb_kv->target_pack_format_version;
 
@@ -3632,6 +4476,11 @@ int ldb_kv_repack(struct ldb_module *module)
 		return ctx.error;
 	}
 
+	if (ctx.count > 10000) {
+		ldb_kv_reindex_progress(ldb, "Repack: re-packed",
+					ctx.count, ctx.start, true);
+	}
+
 	return LDB_SUCCESS;
 }
 
@@ -3645,6 +4494,7 @@ int ldb_kv_reindex(struct ldb_module *module)
 	int ret;
 	struct ldb_kv_reindex_context ctx;
 	size_t index_cache_size = 0;
+	int bulk_ret;
 
 	/*
 	 * Only triggered after a modification, but make clear we do
@@ -3704,6 +4554,7 @@ int ldb_kv_reindex(struct ldb_module *module)
 
 	ctx.error = 0;
 	ctx.count = 0;
+	ctx.start = tevent_timeval_current();
 
 	ret = ldb_kv->kv_ops->iterate(ldb_kv, re_key, &ctx);
 	if (ret < 0) {
@@ -3719,11 +4570,26 @@ int ldb_kv_reindex(struct ldb_module *module)
 		return ctx.error;
 	}
 
+	if (ctx.count > 10000) {
+		ldb_kv_reindex_progress(ldb_module_get_ctx(module),
+					"Reindexing: re-keyed",
+					ctx.count, ctx.start, true);
+	}
+
 	ctx.error = 0;
 	ctx.count = 0;
+	ctx.start = tevent_timeval_current();
 
-	/* now traverse adding any indexes for normal LDB records */
+	/*
+	 * now traverse adding any indexes for normal LDB records.
+	 *
+	 * The index lists are built in memory by appending, and
+	 * sorted once when the traverse is over, rather than each
+	 * value being inserted in order.
+	 */
+	ldb_kv->idxptr->bulk_load = true;
 	ret = ldb_kv->kv_ops->iterate(ldb_kv, re_index, &ctx);
+	bulk_ret = ldb_kv_index_bulk_load_finish(module, ldb_kv);
 	if (ret < 0) {
 		struct ldb_context *ldb = ldb_module_get_ctx(module);
 		ldb_asprintf_errstring(ldb, "reindexing traverse failed: %s",
@@ -3737,7 +4603,17 @@ int ldb_kv_reindex(struct ldb_module *module)
 		return ctx.error;
 	}
 
+	if (bulk_ret != LDB_SUCCESS) {
+		struct ldb_context *ldb = ldb_module_get_ctx(module);
+		ldb_asprintf_errstring(ldb, "sorting rebuilt indexes failed: %s",
+				       ldb_errstring(ldb));
+		return bulk_ret;
+	}
+
 	if (ctx.count > 10000) {
+		ldb_kv_reindex_progress(ldb_module_get_ctx(module),
+					"Reindexing: re-indexed",
+					ctx.count, ctx.start, true);
 		ldb_debug(ldb_module_get_ctx(module),
 			  LDB_DEBUG_WARNING,
 			  "Reindexing: re_index successful on %s, "
@@ -102,6 +102,7 @@ struct ldb_kv_parse_data_unpack_ctx {
 	struct ldb_module *module;
 	struct ldb_kv_private *ldb_kv;
 	unsigned int unpack_flags;
+	const char * const *attrs;
 };
 
 static int ldb_kv_parse_data_unpack(struct ldb_val key,
@@ -151,8 +152,9 @@ static int ldb_kv_parse_data_unpack(struct ldb_val key,
 		}
 	}
 
-	ret = ldb_unpack_data_flags(ldb, &data_parse,
-				    ctx->msg, ctx->unpack_flags);
+	ret = ldb_unpack_data_flags_attrs(ldb, &data_parse,
+					  ctx->msg, ctx->unpack_flags,
+					  ctx->attrs);
 	if (ret == -1) {
 		if (data_parse.data != data.data) {
 			talloc_free(data_parse.data);
@@ -177,13 +179,33 @@ int ldb_kv_search_key(struct ldb_module *module,
 		      const struct ldb_val ldb_key,
 		      struct ldb_message *msg,
 		      unsigned int unpack_flags)
+{
+	return ldb_kv_search_key_attrs(module,
+				       ldb_kv,
+				       ldb_key,
+				       msg,
+				       unpack_flags,
+				       NULL);
+}
+
+/*
+  search the database for a single simple dn, as ldb_kv_search_key(),
+  but only unpacking the attributes in attrs (all if NULL)
+*/
+int ldb_kv_search_key_attrs(struct ldb_module *module,
+			    struct ldb_kv_private *ldb_kv,
+			    const struct ldb_val ldb_key,
+			    struct ldb_message *msg,
+			    unsigned int unpack_flags,
+			    const char * const *attrs)
 {
 	int ret;
 	struct ldb_kv_parse_data_unpack_ctx ctx = {
 		.msg = msg,
 		.module = module,
 		.unpack_flags = unpack_flags,
-		.ldb_kv = ldb_kv
+		.ldb_kv = ldb_kv,
+		.attrs = attrs
 	};
 
 	memset(msg, 0, sizeof(*msg));
@@ -347,9 +369,12 @@ static int search_func(_UNUSED_ struct ldb_kv_private *ldb_kv,
 		return -1;
 	}
 
-	/* unpack the record */
-	ret = ldb_unpack_data_flags(ldb, &val, msg,
-				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+	/* unpack the record, only as far as the search needs */
+	ret = ldb_unpack_data_flags_attrs(ldb,
+					  &val,
+					  msg,
+					  LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC,
+					  ac->unpack_attrs);
 	if (ret == -1) {
 		talloc_free(msg);
 		ac->error = LDB_ERR_OPERATIONS_ERROR;
@@ -367,8 +392,9 @@ static int search_func(_UNUSED_ struct ldb_kv_private *ldb_kv,
 	}
 
 	/* see if it matches the given expression */
-	ret = ldb_match_msg_error(ldb, msg,
-				  ac->tree, ac->base, ac->scope, &matched);
+	ret = ldb_match_msg_program(ldb, msg,
+				    ac->match_program,
+				    ac->base, ac->scope, &matched);
 	if (ret != LDB_SUCCESS) {
 		talloc_free(msg);
 		ac->error = LDB_ERR_OPERATIONS_ERROR;
@@ -408,6 +434,112 @@ static int search_func(_UNUSED_ struct ldb_kv_private *ldb_kv,
 	return 0;
 }
 
+/*
+  add the attributes a parse tree tests to a list of attribute names,
+  returning false if the tree can match against any attribute
+ */
+static bool ldb_kv_tree_attrs(TALLOC_CTX *mem_ctx,
+			      const struct ldb_parse_tree *tree,
+			      const char ***attrs,
+			      size_t *num_attrs)
+{
+	const char *attr = NULL;
+	const char **a = NULL;
+	unsigned int i;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			if (!ldb_kv_tree_attrs(mem_ctx,
+					       tree->u.list.elements[i],
+					       attrs,
+					       num_attrs)) {
+				return false;
+			}
+		}
+		return true;
+	case LDB_OP_NOT:
+		return ldb_kv_tree_attrs(mem_ctx,
+					 tree->u.isnot.child,
+					 attrs,
+					 num_attrs);
+	case LDB_OP_EQUALITY:
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		attr = tree->u.equality.attr;
+		break;
+	case LDB_OP_SUBSTRING:
+		attr = tree->u.substring.attr;
+		break;
+	case LDB_OP_PRESENT:
+		attr = tree->u.present.attr;
+		break;
+	case LDB_OP_EXTENDED:
+		attr = tree->u.extended.attr;
+		break;
+	}
+
+	if (attr == NULL) {
+		return false;
+	}
+
+	a = talloc_realloc(mem_ctx, *attrs, const char *, *num_attrs + 2);
+	if (a == NULL) {
+		return false;
+	}
+	a[(*num_attrs)++] = attr;
+	a[*num_attrs] = NULL;
+	*attrs = a;
+	return true;
+}
+
+/*
+  work out which attributes need to be unpacked from each record to
+  match the search filter and return the requested attributes.
+
+  Returns NULL (unpack everything) if all attributes are wanted.
+ */
+static const char **ldb_kv_search_unpack_attrs(struct ldb_kv_context *ctx)
+{
+	const char **attrs = NULL;
+	size_t num_attrs = 0;
+	unsigned int i;
+
+	if (ctx->attrs == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; ctx->attrs[i] != NULL; i++) {
+		if (strcmp(ctx->attrs[i], "*") == 0) {
+			TALLOC_FREE(attrs);
+			return NULL;
+		}
+		attrs = talloc_realloc(ctx, attrs, const char *, num_attrs + 2);
+		if (attrs == NULL) {
+			return NULL;
+		}
+		attrs[num_attrs++] = ctx->attrs[i];
+		attrs[num_attrs] = NULL;
+	}
+
+	if (!ldb_kv_tree_attrs(ctx, ctx->tree, &attrs, &num_attrs)) {
+		TALLOC_FREE(attrs);
+		return NULL;
+	}
+
+	if (attrs == NULL) {
+		/*
+		 * No attributes requested and none in the filter,
+		 * only the DN is needed
+		 */
+		attrs = talloc_zero_array(ctx, const char *, 1);
+	}
+
+	return attrs;
+}
+
 /*
  * Key pointing to just before the first GUID indexed record for
  * iterate_range
@@ -572,6 +704,42 @@ static int ldb_kv_search_and_return_base(struct ldb_kv_private *ldb_kv,
 	return LDB_SUCCESS;
 }
 
+/*
+  return the plan built up in ldb_kv->explain to the caller, as a
+  LDB_CONTROL_SEARCH_EXPLAIN_OID reply control
+*/
+static int ldb_kv_search_explain_done(struct ldb_kv_context *ctx,
+				      struct ldb_kv_private *ldb_kv)
+{
+	struct ldb_search_explain_control *explain = NULL;
+	char *plan = ldb_kv->explain;
+
+	ldb_kv->explain = NULL;
+	if (plan == NULL) {
+		return LDB_SUCCESS;
+	}
+
+	ctx->controls = talloc_zero_array(ctx, struct ldb_control *, 2);
+	if (ctx->controls == NULL) {
+		return ldb_module_oom(ctx->module);
+	}
+	ctx->controls[0] = talloc(ctx->controls, struct ldb_control);
+	if (ctx->controls[0] == NULL) {
+		return ldb_module_oom(ctx->module);
+	}
+	explain = talloc(ctx->controls[0], struct ldb_search_explain_control);
+	if (explain == NULL) {
+		return ldb_module_oom(ctx->module);
+	}
+	explain->plan = talloc_steal(explain, plan);
+
+	ctx->controls[0]->oid = LDB_CONTROL_SEARCH_EXPLAIN_OID;
+	ctx->controls[0]->critical = 0;
+	ctx->controls[0]->data = explain;
+
+	return LDB_SUCCESS;
+}
+
 /*
   search the database with a LDAP-like expression.
   choses a search method
@@ -584,6 +752,7 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 	void *data = ldb_module_get_private(module);
 	struct ldb_kv_private *ldb_kv =
 	    talloc_get_type(data, struct ldb_kv_private);
+	char *outer_explain = NULL;
 	int ret;
 
 	ldb = ldb_module_get_ctx(module);
@@ -672,6 +841,39 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 		ret = LDB_SUCCESS;
 	}
 
+	/*
+	 * A search may be nested inside the callbacks of another one,
+	 * so keep any plan being built for the outer search aside
+	 */
+	outer_explain = ldb_kv->explain;
+	ldb_kv->explain = NULL;
+	if (ret == LDB_SUCCESS &&
+	    ldb_request_get_control(req,
+				    LDB_CONTROL_SEARCH_EXPLAIN_OID) != NULL) {
+		ldb_kv->explain = talloc_strdup(ctx, "");
+		if (ldb_kv->explain == NULL) {
+			ldb_kv->explain = outer_explain;
+			ldb_kv->kv_ops->unlock_read(module);
+			return ldb_module_oom(module);
+		}
+	}
+
+	if (ret == LDB_SUCCESS) {
+		/*
+		 * Records are only unpacked as far as is needed to
+		 * match the filter and return the requested
+		 * attributes.
+		 */
+		ctx->unpack_attrs = ldb_kv_search_unpack_attrs(ctx);
+
+		/*
+		 * Every candidate is matched against the filter, so
+		 * prepare it once here
+		 */
+		ret = ldb_match_compile(ldb, ctx, ctx->tree,
+					&ctx->match_program);
+	}
+
 	if (ret == LDB_SUCCESS) {
 		uint32_t match_count = 0;
 
@@ -710,6 +912,7 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 				 * full search or we may return
 				 * duplicate entries
 				 */
+				ldb_kv->explain = outer_explain;
 				ldb_kv->kv_ops->unlock_read(module);
 				return LDB_ERR_OPERATIONS_ERROR;
 			}
@@ -717,10 +920,16 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 			if (ldb_kv->disable_full_db_scan) {
 				ldb_set_errstring(ldb,
 						  "ldb FULL SEARCH disabled");
+				ldb_kv->explain = outer_explain;
 				ldb_kv->kv_ops->unlock_read(module);
 				return LDB_ERR_INAPPROPRIATE_MATCHING;
 			}
 
+			if (ldb_kv->explain != NULL) {
+				ldb_kv->explain = talloc_asprintf_append_buffer(
+					ldb_kv->explain, "full scan\n");
+			}
+
 			ret = ldb_kv_search_full(ctx);
 			if (ret != LDB_SUCCESS) {
 				ldb_set_errstring(ldb, "Indexed and full searches both failed!\n");
@@ -728,6 +937,11 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 		}
 	}
 
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_kv_search_explain_done(ctx, ldb_kv);
+	}
+	ldb_kv->explain = outer_explain;
+
 	ldb_kv->kv_ops->unlock_read(module);
 
 	return ret;
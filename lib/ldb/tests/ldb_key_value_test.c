@@ -351,6 +351,111 @@ static void test_init_store_set_index_cache_size_range(void **state)
 	TALLOC_FREE(ldb);
 }
 
+/*
+ * Build a sorted GUID index dn_list holding every multiple of step
+ * below limit, encoded big endian so the memcmp order matches.
+ */
+static struct dn_list *guid_list(TALLOC_CTX *mem_ctx,
+				 unsigned int step,
+				 unsigned int limit)
+{
+	struct dn_list *list = talloc_zero(mem_ctx, struct dn_list);
+	unsigned int i;
+
+	assert_non_null(list);
+	list->dn = talloc_zero_array(list, struct ldb_val, limit / step + 1);
+	assert_non_null(list->dn);
+
+	for (i = 0; i < limit; i += step) {
+		uint8_t *guid = talloc_zero_array(list->dn,
+						  uint8_t,
+						  LDB_KV_GUID_SIZE);
+		assert_non_null(guid);
+		guid[12] = (i >> 24) & 0xff;
+		guid[13] = (i >> 16) & 0xff;
+		guid[14] = (i >> 8) & 0xff;
+		guid[15] = i & 0xff;
+		list->dn[list->count].data = guid;
+		list->dn[list->count].length = LDB_KV_GUID_SIZE;
+		list->count++;
+	}
+	return list;
+}
+
+static unsigned int guid_list_value(const struct ldb_val *v)
+{
+	return ((unsigned int)v->data[12] << 24) |
+	       ((unsigned int)v->data[13] << 16) |
+	       ((unsigned int)v->data[14] << 8) |
+	       (unsigned int)v->data[15];
+}
+
+/*
+ * Test that ldb_kv_dn_list_gallop finds the first value not less than
+ * the one searched for, from any starting point.
+ */
+static void test_dn_list_gallop(void **state)
+{
+	struct test_ctx *test_ctx = talloc_get_type_abort(
+		*state,
+		struct test_ctx);
+	struct dn_list *list = guid_list(test_ctx, 2, 200);
+	struct dn_list *probe = guid_list(test_ctx, 1, 202);
+	unsigned int start;
+	unsigned int i;
+
+	for (start = 0; start <= list->count; start += 7) {
+		for (i = 0; i < probe->count; i++) {
+			unsigned int expected = MIN(MAX((i + 1) / 2, start),
+						    list->count);
+			unsigned int j = ldb_kv_dn_list_gallop(
+				list, start, &probe->dn[i]);
+			assert_int_equal(expected, j);
+		}
+	}
+}
+
+/*
+ * Test that list_intersect on GUID index lists keeps exactly the
+ * common values, whichever of the two lists is the shorter.
+ */
+static void test_list_intersect_guid(void **state)
+{
+	struct test_ctx *test_ctx = talloc_get_type_abort(
+		*state,
+		struct test_ctx);
+	struct ldb_kv_private *ldb_kv = NULL;
+	struct dn_list *list = NULL;
+	struct dn_list *list2 = NULL;
+	unsigned int i;
+
+	ldb_kv = talloc_zero(test_ctx, struct ldb_kv_private);
+	ldb_kv->cache = talloc_zero(ldb_kv, struct ldb_kv_cache);
+	ldb_kv->cache->GUID_index_attribute = "objectGUID";
+
+	list = guid_list(test_ctx, 3, 3000);
+	list2 = guid_list(test_ctx, 7, 1000);
+	assert_true(list_intersect(ldb_kv, list, list2));
+	assert_int_equal(48, list->count);
+	for (i = 0; i < list->count; i++) {
+		assert_int_equal(i * 21, guid_list_value(&list->dn[i]));
+	}
+
+	list = guid_list(test_ctx, 7, 1000);
+	list2 = guid_list(test_ctx, 3, 3000);
+	assert_true(list_intersect(ldb_kv, list, list2));
+	assert_int_equal(48, list->count);
+	for (i = 0; i < list->count; i++) {
+		assert_int_equal(i * 21, guid_list_value(&list->dn[i]));
+	}
+
+	list = guid_list(test_ctx, 2, 100);
+	list2 = guid_list(test_ctx, 1, 0);
+	list2->count = 0;
+	assert_true(list_intersect(ldb_kv, list, list2));
+	assert_int_equal(0, list->count);
+}
+
 int main(int argc, const char **argv)
 {
 	const struct CMUnitTest tests[] = {
@@ -382,6 +487,14 @@ int main(int argc, const char **argv)
 			test_init_store_set_index_cache_size_range,
 			setup,
 			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_dn_list_gallop,
+			setup,
+			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_list_intersect_guid,
+			setup,
+			teardown),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -164,6 +164,79 @@ static void test_wildcard_match_end_condition(void **state)
 	assert_true(matched);
 }
 
+/*
+ * Check a compiled filter gives the same result as matching the
+ * parse tree directly
+ */
+static void test_match_program(void **state)
+{
+	struct ldbtest_ctx *ctx = *state;
+	struct ldb_message *msg = NULL;
+	unsigned int i;
+	int ret;
+	struct {
+		const char *filter;
+		bool matched;
+	} tests[] = {
+		{ "(s=*end)", true },
+		{ "(s=The*)", true },
+		{ "(s=*nothere*)", false },
+		{ "(&(s=*value*)(!(b=x)))", false },
+		{ "(&(s=*value*)(!(b=z)))", true },
+		{ "(|(c=1)(b=y))", true },
+		{ "(|(c=1)(b=z))", false },
+		{ "(b=*)", true },
+		{ "(c=*)", false },
+		{ "(b>=y)", true },
+		{ "(b<=w)", false },
+		{ "(distinguishedName=cn=foo,dc=example,dc=com)", true },
+		{ "(dn=cn=bar,dc=example,dc=com)", false },
+		{ "(num:1.2.840.113556.1.4.803:=3)", true },
+		{ "(num:1.2.840.113556.1.4.803:=8)", false },
+		{ "(num:1.2.840.113556.1.4.804:=12)", true },
+		{ "(num:1.3.6.1.4.1.7165.4.5.1:=7)", false },
+	};
+
+	msg = ldb_msg_new(ctx);
+	assert_non_null(msg);
+	msg->dn = ldb_dn_new(msg, ctx->ldb, "cn=foo,dc=example,dc=com");
+	assert_non_null(msg->dn);
+	ret = ldb_msg_add_string(msg, "s", "The value.......end");
+	assert_int_equal(LDB_SUCCESS, ret);
+	ret = ldb_msg_add_string(msg, "b", "x");
+	assert_int_equal(LDB_SUCCESS, ret);
+	ret = ldb_msg_add_string(msg, "b", "y");
+	assert_int_equal(LDB_SUCCESS, ret);
+	ret = ldb_msg_add_string(msg, "num", "7");
+	assert_int_equal(LDB_SUCCESS, ret);
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		struct ldb_parse_tree *tree = NULL;
+		struct ldb_match_program *program = NULL;
+		bool matched = false;
+
+		tree = ldb_parse_tree(ctx, tests[i].filter);
+		assert_non_null(tree);
+
+		ret = ldb_match_message(ctx->ldb, msg, tree,
+					LDB_SCOPE_SUBTREE, &matched);
+		assert_int_equal(LDB_SUCCESS, ret);
+		assert_int_equal(tests[i].matched, matched);
+
+		ret = ldb_match_compile(ctx->ldb, ctx, tree, &program);
+		assert_int_equal(LDB_SUCCESS, ret);
+
+		matched = !tests[i].matched;
+		ret = ldb_match_msg_program(ctx->ldb, msg, program, NULL,
+					    LDB_SCOPE_SUBTREE, &matched);
+		assert_int_equal(LDB_SUCCESS, ret);
+		assert_int_equal(tests[i].matched, matched);
+
+		TALLOC_FREE(program);
+		TALLOC_FREE(tree);
+	}
+}
+
 /*
  * Note: to run under valgrind use:
  *       valgrind \
@@ -185,6 +258,10 @@ int main(int argc, const char **argv)
 			test_wildcard_match_end_condition,
 			setup,
 			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_match_program,
+			setup,
+			teardown),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -981,6 +981,24 @@ class SearchTests(LdbBaseTest):
                               expression="(&(x=y)(|(y=b)(y=c)))")
         self.assertEqual(len(res11), 1)
 
+    def test_subtree_and_explain(self):
+        """Testing that the search_explain control describes the search"""
+
+        res11 = self.l.search(base="DC=SAMBA,DC=ORG",
+                              scope=ldb.SCOPE_SUBTREE,
+                              expression="(&(x=y)(|(y=b)(y=c)))",
+                              controls=["search_explain:0"])
+        self.assertEqual(len(res11), 1)
+        self.assertEqual(len(res11.controls), 1)
+        plan = str(res11.controls[0])
+        self.assertTrue(plan.startswith("search_explain:0:"))
+        if hasattr(self, 'IDX') or hasattr(self, 'IDXGUID'):
+            self.assertIn("(x=y) estimate ", plan)
+            self.assertIn("(|(y=b)(y=c)) estimate unknown", plan)
+            self.assertIn("indexed: ", plan)
+        else:
+            self.assertIn("full scan", plan)
+
     def test_subtree_or(self):
         """Testing a search"""
 
@@ -219,6 +219,52 @@ static void test_ldb_dn_explode(void **state)
 	}
 }
 
+static void test_ldb_dn_cache(void **state)
+{
+	struct ldb_context *ldb = ldb_init(NULL, NULL);
+	struct ldb_dn *dn = NULL;
+	unsigned int i;
+	int ret;
+
+	/*
+	 * The DN is only cached once it has been casefolded twice, so
+	 * this covers the first parse, the second and the cached copy
+	 */
+	for (i = 0; i < 4; i++) {
+		dn = ldb_dn_new(ldb, ldb, "cn=Foo Bar,DC=samba,dc=org");
+		assert_non_null(dn);
+
+		assert_string_equal("CN=FOO BAR,DC=SAMBA,DC=ORG",
+				    ldb_dn_get_casefold(dn));
+		assert_string_equal("cn=Foo Bar,DC=samba,dc=org",
+				    ldb_dn_get_linearized(dn));
+		assert_int_equal(3, ldb_dn_get_comp_num(dn));
+		assert_string_equal("cn", ldb_dn_get_rdn_name(dn));
+		assert_string_equal("Foo Bar",
+				    (const char *)ldb_dn_get_rdn_val(dn)->data);
+
+		/* changing a copy from the cache leaves the cache alone */
+		assert_true(ldb_dn_add_child_fmt(dn, "ou=x"));
+		assert_string_equal("OU=X,CN=FOO BAR,DC=SAMBA,DC=ORG",
+				    ldb_dn_get_casefold(dn));
+		TALLOC_FREE(dn);
+	}
+	assert_non_null(ldb->dn_cache);
+
+	/* The cache is flushed when the syntax of an attribute changes */
+	ret = ldb_schema_attribute_add(ldb, "cn", 0,
+				       LDB_SYNTAX_OCTET_STRING);
+	assert_int_equal(LDB_SUCCESS, ret);
+	assert_null(ldb->dn_cache);
+
+	dn = ldb_dn_new(ldb, ldb, "cn=Foo Bar,DC=samba,dc=org");
+	assert_non_null(dn);
+	assert_string_equal("CN=Foo Bar,DC=SAMBA,DC=ORG",
+			    ldb_dn_get_casefold(dn));
+
+	talloc_free(ldb);
+}
+
 int main(void) {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(test_ldb_dn_add_child_fmt),
@@ -226,6 +272,7 @@ int main(void) {
 		cmocka_unit_test(test_ldb_dn_add_child_val),
 		cmocka_unit_test(test_ldb_dn_add_child_val2),
 		cmocka_unit_test(test_ldb_dn_explode),
+		cmocka_unit_test(test_ldb_dn_cache),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -512,6 +512,28 @@ int handle_controls_reply(struct ldb_control **reply, struct ldb_control **reque
 			continue;
 		}
 
+		if (strcmp(LDB_CONTROL_SEARCH_EXPLAIN_OID, reply[i]->oid) == 0) {
+			struct ldb_search_explain_control *rep_control;
+			const char *p, *nl;
+
+			rep_control = talloc_get_type(reply[i]->data, struct ldb_search_explain_control);
+			if (rep_control == NULL || rep_control->plan == NULL) {
+				continue;
+			}
+
+			printf("# search plan:\n");
+			for (p = rep_control->plan; *p != '\0'; p = nl + 1) {
+				nl = strchr(p, '\n');
+				if (nl == NULL) {
+					printf("#   %s\n", p);
+					break;
+				}
+				printf("#   %.*s\n", (int)(nl - p), p);
+			}
+
+			continue;
+		}
+
 		/* no controls matched, throw a warning */
 		fprintf(stderr, "Unknown reply control oid: %s\n", reply[i]->oid);
 	}
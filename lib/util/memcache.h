@@ -47,6 +47,7 @@ enum memcache_number {
 	SHARE_MODE_LOCK_CACHE,	/* talloc */
 	VIRUSFILTER_SCAN_RESULTS_CACHE_TALLOC, /* talloc */
 	DFREE_CACHE,
+	DNS_RECORD_CACHE,
 };
 
 /*
@@ -1757,6 +1757,41 @@ class TestRPCRoundtrip(DNSTest):
                 None,
                 add_rec_buf)
 
+    def check_query_nxdomain(self, prefix):
+        name = "%s.%s" % (prefix, self.get_dns_domain())
+        p = self.make_name_packet(dns.DNS_OPCODE_QUERY)
+        q = self.make_name_question(name, dns.DNS_QTYPE_TXT, dns.DNS_QCLASS_IN)
+        self.finish_name_packet(p, [q])
+        (response, response_packet) =\
+            self.dns_transaction_udp(p, host=self.server_ip)
+        self.assert_dns_rcode_equals(response, dns.DNS_RCODE_NXDOMAIN)
+
+    def test_update_rpc_after_cached_query(self):
+        "Answers kept by the DNS server follow RPC changes to the name"
+        prefix = 'rpccacherec'
+        name = "%s.%s" % (prefix, self.get_dns_domain())
+
+        # Ask twice, so that the server answers from its cache
+        self.check_query_nxdomain(prefix)
+        self.check_query_nxdomain(prefix)
+
+        self.rpc_update(fqn=name, data='"\\"first\\""',
+                        wType=dnsp.DNS_TYPE_TXT)
+        try:
+            self.check_query_txt(prefix, ['"first"'])
+            self.check_query_txt(prefix, ['"first"'])
+
+            self.rpc_update(fqn=name, data='"\\"first\\""',
+                            wType=dnsp.DNS_TYPE_TXT, delete=True)
+            self.rpc_update(fqn=name, data='"\\"second\\""',
+                            wType=dnsp.DNS_TYPE_TXT)
+            self.check_query_txt(prefix, ['"second"'])
+        finally:
+            self.rpc_update(fqn=name, data='"\\"second\\""',
+                            wType=dnsp.DNS_TYPE_TXT, delete=True)
+
+        self.check_query_nxdomain(prefix)
+
     def test_update_add_null_padded_txt_record(self):
         "test adding records works"
         prefix, txt = 'pad1textrec', ['"This is a test"', '', '']
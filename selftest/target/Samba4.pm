@@ -2476,9 +2476,14 @@ sub setup_ad_dc_no_ntlm
 	       return "UNKNOWN";
 	}
 
+	# The logon stamps are also batched here, see login_stamps.py
+	my $extra_conf_options = "
+	ntlm auth = disabled
+	auth:logon stamp interval = 5
+";
 	my $env = $self->provision_ad_dc($path, "addc_no_ntlm", "ADNONTLMDOMAIN",
 					 "adnontlmdom.samba.example.com",
-					 "ntlm auth = disabled", undef);
+					 $extra_conf_options, undef);
 	unless ($env) {
 		return undef;
 	}
@@ -31,6 +31,7 @@
 #include "libcli/ldap/ldap_ndr.h"
 #include "param/param.h"
 #include "librpc/gen_ndr/ndr_winbind_c.h"
+#include "lib/util/dlinklist.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_AUTH
@@ -359,6 +360,8 @@ _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 	struct dom_sid *domain_sid;
 	TALLOC_CTX *tmp_ctx;
 	struct ldb_message_element *el;
+	uint64_t group_hits, group_searches;
+	uint64_t group_hits_now, group_searches_now;
 
 	user_info_dc = talloc(mem_ctx, struct auth_user_info_dc);
 	NT_STATUS_HAVE_NO_MEMORY(user_info_dc);
@@ -415,6 +418,8 @@ _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 
 	primary_group_blob = data_blob_string_const(primary_group_dn);
 
+	dsdb_expand_nested_groups_stats(sam_ctx, &group_hits, &group_searches);
+
 	/* Expands the primary group - this function takes in
 	 * memberOf-like values, so we fake one up with the
 	 * <SID=S-...> format of DN and then let it expand
@@ -445,6 +450,16 @@ _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 		}
 	}
 
+	dsdb_expand_nested_groups_stats(sam_ctx,
+					&group_hits_now,
+					&group_searches_now);
+	DBG_DEBUG("Expanded %u groups for %s with %llu searches "
+		  "(%llu cached)\n",
+		  num_sids - 2,
+		  ldb_dn_get_linearized(msg->dn),
+		  (unsigned long long)(group_searches_now - group_searches),
+		  (unsigned long long)(group_hits_now - group_hits));
+
 	user_info_dc->sids = sids;
 	user_info_dc->num_sids = num_sids;
 
@@ -1027,6 +1042,348 @@ NTSTATUS authsam_search_account(TALLOC_CTX *mem_ctx, struct ldb_context *sam_ctx
 }
 
 
+/*
+ * Logon stamps (lastLogon, logonCount and lastLogonTimestamp) that are
+ * waiting to be written.
+ *
+ * With "auth:logon stamp interval" set to a number of seconds, a
+ * successful logon that would only update these attributes queues
+ * them here, and they are written for all the accounts in one
+ * transaction when the interval expires.  This avoids a write
+ * transaction per logon during logon storms.
+ *
+ * Anything that affects the account lockout (badPwdCount, lockoutTime
+ * and badPasswordTime) is always written straight away.  Queued stamps
+ * are lost if the process exits before they are written.
+ *
+ * The account is found again by its objectGUID when the stamps are
+ * written, as it may have been renamed or moved in the meantime.
+ */
+#define AUTHSAM_LOGON_STAMP_BUCKETS 256
+
+struct authsam_logon_stamp {
+	struct authsam_logon_stamp *prev, *next;
+	struct GUID guid;
+	/* 0 if not to be changed */
+	NTTIME last_logon;
+	NTTIME last_logon_timestamp;
+	unsigned int logon_count_increments;
+};
+
+struct authsam_logon_stamps {
+	struct ldb_context *sam_ctx;
+	int interval;
+	struct tevent_timer *te;
+	unsigned int num_pending;
+	struct authsam_logon_stamp *buckets[AUTHSAM_LOGON_STAMP_BUCKETS];
+};
+
+static struct authsam_logon_stamps *authsam_logon_stamps_get(
+	struct ldb_context *sam_ctx)
+{
+	struct authsam_logon_stamps *stamps = NULL;
+	struct loadparm_context *lp_ctx = NULL;
+	int ret;
+
+	stamps = talloc_get_type(ldb_get_opaque(sam_ctx, "authsam_logon_stamps"),
+				 struct authsam_logon_stamps);
+	if (stamps == NULL) {
+		lp_ctx = talloc_get_type(ldb_get_opaque(sam_ctx, "loadparm"),
+					 struct loadparm_context);
+
+		stamps = talloc_zero(sam_ctx, struct authsam_logon_stamps);
+		if (stamps == NULL) {
+			return NULL;
+		}
+		stamps->sam_ctx = sam_ctx;
+		stamps->interval = lpcfg_parm_int(lp_ctx, NULL, "auth",
+						  "logon stamp interval", 0);
+		if (ldb_get_event_context(sam_ctx) == NULL) {
+			stamps->interval = 0;
+		}
+
+		ret = ldb_set_opaque(sam_ctx, "authsam_logon_stamps", stamps);
+		if (ret != LDB_SUCCESS) {
+			TALLOC_FREE(stamps);
+			return NULL;
+		}
+	}
+
+	if (stamps->interval <= 0) {
+		return NULL;
+	}
+	return stamps;
+}
+
+/*
+ * Write one queued logon stamp, inside the transaction of
+ * authsam_logon_stamps_write()
+ */
+static int authsam_logon_stamp_write(struct ldb_context *sam_ctx,
+				     TALLOC_CTX *mem_ctx,
+				     const struct authsam_logon_stamp *stamp)
+{
+	static const char * const attrs[] = { "lastLogon",
+					      "lastLogonTimestamp",
+					      "logonCount",
+					      NULL };
+	struct ldb_result *res = NULL;
+	struct ldb_message *msg_mod = NULL;
+	struct ldb_request *req = NULL;
+	struct ldb_dn *dn = NULL;
+	struct GUID_txt_buf guid_buf;
+	unsigned int i;
+	int ret;
+
+	dn = ldb_dn_new_fmt(mem_ctx, sam_ctx, "<GUID=%s>",
+			    GUID_buf_string(&stamp->guid, &guid_buf));
+	if (dn == NULL) {
+		return ldb_oom(sam_ctx);
+	}
+
+	/* the account may have gone away since the logon */
+	ret = dsdb_search_dn(sam_ctx, mem_ctx, &res, dn, attrs, 0);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	msg_mod = ldb_msg_new(mem_ctx);
+	if (msg_mod == NULL) {
+		return ldb_oom(sam_ctx);
+	}
+	msg_mod->dn = res->msgs[0]->dn;
+
+	/*
+	 * Never move the times backwards, in case a logon that was
+	 * not queued wrote a later time in the meantime.
+	 */
+	if (stamp->last_logon >
+	    ldb_msg_find_attr_as_int64(res->msgs[0], "lastLogon", 0)) {
+		ret = samdb_msg_add_int64(sam_ctx, msg_mod, msg_mod,
+					  "lastLogon", stamp->last_logon);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+	if (stamp->last_logon_timestamp >
+	    ldb_msg_find_attr_as_int64(res->msgs[0], "lastLogonTimestamp", 0)) {
+		ret = samdb_msg_add_int64(sam_ctx, msg_mod, msg_mod,
+					  "lastLogonTimestamp",
+					  stamp->last_logon_timestamp);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+	if (stamp->logon_count_increments > 0) {
+		int logonCount = ldb_msg_find_attr_as_int(res->msgs[0],
+							  "logonCount", 0);
+
+		ret = samdb_msg_add_int(sam_ctx, msg_mod, msg_mod,
+					"logonCount",
+					logonCount + stamp->logon_count_increments);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	if (msg_mod->num_elements == 0) {
+		return LDB_SUCCESS;
+	}
+
+	for (i=0;i<msg_mod->num_elements;i++) {
+		msg_mod->elements[i].flags = LDB_FLAG_MOD_REPLACE;
+	}
+
+	ret = ldb_build_mod_req(&req, sam_ctx, mem_ctx,
+				msg_mod,
+				NULL,
+				NULL,
+				ldb_op_default_callback,
+				NULL);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	ret = ldb_request_add_control(req,
+				      DSDB_CONTROL_FORCE_RODC_LOCAL_CHANGE,
+				      false, NULL);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	ret = ldb_request(sam_ctx, req);
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_wait(req->handle, LDB_WAIT_ALL);
+	}
+	return ret;
+}
+
+/*
+ * Write all the queued logon stamps in one transaction
+ */
+static void authsam_logon_stamps_write(struct tevent_context *ev,
+				       struct tevent_timer *te,
+				       struct timeval current_time,
+				       void *private_data)
+{
+	struct authsam_logon_stamps *stamps =
+		talloc_get_type_abort(private_data,
+				      struct authsam_logon_stamps);
+	struct ldb_context *sam_ctx = stamps->sam_ctx;
+	TALLOC_CTX *tmp_ctx = NULL;
+	unsigned int i;
+	unsigned int num_written = 0;
+	int ret;
+
+	stamps->te = NULL;
+
+	tmp_ctx = talloc_new(stamps);
+	if (tmp_ctx == NULL) {
+		return;
+	}
+
+	ret = ldb_transaction_start(sam_ctx);
+	if (ret != LDB_SUCCESS) {
+		DBG_ERR("Failed to start a transaction to write %u logon "
+			"stamps: %s\n",
+			stamps->num_pending, ldb_errstring(sam_ctx));
+		goto done;
+	}
+
+	for (i = 0; i < AUTHSAM_LOGON_STAMP_BUCKETS; i++) {
+		struct authsam_logon_stamp *stamp = NULL;
+
+		for (stamp = stamps->buckets[i]; stamp; stamp = stamp->next) {
+			struct GUID_txt_buf guid_buf;
+
+			ret = authsam_logon_stamp_write(sam_ctx, tmp_ctx, stamp);
+			if (ret != LDB_SUCCESS) {
+				DBG_WARNING("Failed to write the logon stamps "
+					    "of %s: %s\n",
+					    GUID_buf_string(&stamp->guid,
+							    &guid_buf),
+					    ldb_errstring(sam_ctx));
+				continue;
+			}
+			num_written++;
+		}
+	}
+
+	ret = ldb_transaction_commit(sam_ctx);
+	if (ret != LDB_SUCCESS) {
+		DBG_ERR("Failed to commit %u logon stamps: %s\n",
+			stamps->num_pending, ldb_errstring(sam_ctx));
+		goto done;
+	}
+
+	DBG_DEBUG("Wrote the logon stamps of %u of %u accounts\n",
+		  num_written, stamps->num_pending);
+
+done:
+	/*
+	 * These are only logon statistics, so on failure they are
+	 * dropped rather than retried.
+	 */
+	for (i = 0; i < AUTHSAM_LOGON_STAMP_BUCKETS; i++) {
+		while (stamps->buckets[i] != NULL) {
+			struct authsam_logon_stamp *stamp = stamps->buckets[i];
+			DLIST_REMOVE(stamps->buckets[i], stamp);
+			TALLOC_FREE(stamp);
+		}
+	}
+	stamps->num_pending = 0;
+	TALLOC_FREE(tmp_ctx);
+}
+
+/*
+ * Queue the changes of a successful logon to be written later, if
+ * they are only logon stamps.  Returns false if they need to be
+ * written now.
+ */
+static bool authsam_queue_logon_stamps(struct ldb_context *sam_ctx,
+				       const struct ldb_message *msg,
+				       const struct ldb_message *msg_mod,
+				       bool interactive_or_kerberos)
+{
+	struct authsam_logon_stamps *stamps = NULL;
+	struct authsam_logon_stamp *stamp = NULL;
+	struct GUID guid;
+	unsigned int bucket;
+	unsigned int i;
+
+	stamps = authsam_logon_stamps_get(sam_ctx);
+	if (stamps == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < msg_mod->num_elements; i++) {
+		const char *name = msg_mod->elements[i].name;
+
+		if (ldb_attr_cmp(name, "lastLogon") == 0 ||
+		    ldb_attr_cmp(name, "lastLogonTimestamp") == 0) {
+			continue;
+		}
+		/*
+		 * An increment can be queued, but not the initial
+		 * logonCount of 0 of a network logon
+		 */
+		if (ldb_attr_cmp(name, "logonCount") == 0 &&
+		    interactive_or_kerberos) {
+			continue;
+		}
+		return false;
+	}
+
+	guid = samdb_result_guid(msg, "objectGUID");
+	if (GUID_all_zero(&guid)) {
+		return false;
+	}
+	bucket = guid.time_low % AUTHSAM_LOGON_STAMP_BUCKETS;
+
+	for (stamp = stamps->buckets[bucket]; stamp; stamp = stamp->next) {
+		if (GUID_equal(&stamp->guid, &guid)) {
+			break;
+		}
+	}
+
+	if (stamp == NULL) {
+		stamp = talloc_zero(stamps, struct authsam_logon_stamp);
+		if (stamp == NULL) {
+			return false;
+		}
+		stamp->guid = guid;
+		DLIST_ADD(stamps->buckets[bucket], stamp);
+		stamps->num_pending++;
+	}
+
+	stamp->last_logon = MAX(stamp->last_logon,
+				ldb_msg_find_attr_as_int64(msg_mod,
+							   "lastLogon", 0));
+	stamp->last_logon_timestamp =
+		MAX(stamp->last_logon_timestamp,
+		    ldb_msg_find_attr_as_int64(msg_mod,
+					       "lastLogonTimestamp", 0));
+	if (ldb_msg_find_element(msg_mod, "logonCount") != NULL) {
+		stamp->logon_count_increments++;
+	}
+
+	if (stamps->te == NULL) {
+		stamps->te = tevent_add_timer(ldb_get_event_context(sam_ctx),
+					      stamps,
+					      timeval_current_ofs(stamps->interval, 0),
+					      authsam_logon_stamps_write,
+					      stamps);
+		if (stamps->te == NULL) {
+			DLIST_REMOVE(stamps->buckets[bucket], stamp);
+			stamps->num_pending--;
+			TALLOC_FREE(stamp);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /* Reset the badPwdCount to zero and update the lastLogon time. */
 NTSTATUS authsam_logon_success_accounting(struct ldb_context *sam_ctx,
 					  const struct ldb_message *msg,
@@ -1154,6 +1511,13 @@ NTSTATUS authsam_logon_success_accounting(struct ldb_context *sam_ctx,
 		}
 	}
 
+	if (msg_mod->num_elements > 0 &&
+	    authsam_queue_logon_stamps(sam_ctx, msg, msg_mod,
+				       interactive_or_kerberos)) {
+		TALLOC_FREE(mem_ctx);
+		return NT_STATUS_OK;
+	}
+
 	if (msg_mod->num_elements > 0) {
 		unsigned int i;
 		struct ldb_request *req;
@@ -48,6 +48,7 @@
 #include "librpc/gen_ndr/ndr_irpc.h"
 #include "lib/messaging/irpc.h"
 #include "libds/common/roles.h"
+#include "lib/util/memcache.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_DNS
@@ -800,6 +801,7 @@ static NTSTATUS dns_task_init(struct task_server *task)
 	struct ldb_message *dns_acc;
 	char *hostname_lower;
 	char *dns_spn;
+	int cache_size;
 
 	switch (lpcfg_server_role(task->lp_ctx)) {
 	case ROLE_STANDALONE:
@@ -900,6 +902,16 @@ static NTSTATUS dns_task_init(struct task_server *task)
 		return status;
 	}
 
+	cache_size = lpcfg_parm_int(task->lp_ctx, NULL, "dns",
+				    "record cache size", 8 * 1024 * 1024);
+	if (cache_size > 0) {
+		dns->record_cache = memcache_init(dns, cache_size);
+		if (dns->record_cache == NULL) {
+			task_server_terminate(task, "dns: out of memory", true);
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
 	status = dns_startup_interfaces(dns, ifaces, task->model_ops);
 	if (!NT_STATUS_IS_OK(status)) {
 		task_server_terminate(task, "dns failed to setup interfaces", true);
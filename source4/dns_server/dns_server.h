@@ -50,6 +50,11 @@ struct dns_server {
 	struct dns_server_zone *zones;
 	struct dns_server_tkey_store *tkeys;
 	struct cli_credentials *server_credentials;
+	/* see dns_lookup_records_cached() */
+	struct memcache *record_cache;
+	uint64_t record_cache_seq_num;
+	uint64_t record_cache_hits;
+	uint64_t record_cache_misses;
 };
 
 struct dns_request_state {
@@ -28,7 +28,9 @@
 #include <ldb.h>
 #include "dsdb/samdb/samdb.h"
 #include "dsdb/common/util.h"
+#include "libcli/security/security.h"
 #include "dns_server/dns_server.h"
+#include "lib/util/memcache.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_DNS
@@ -107,6 +109,243 @@ bool dns_records_match(struct dnsp_DnssrvRpcRecord *rec1,
 	return false;
 }
 
+/*
+ * The results of dns_lookup_records() and dns_lookup_records_wildcard()
+ * are kept in dns->record_cache until the sequence number of the
+ * database changes, so that the names queried over and over (such as
+ * the SRV records of the DCs) don't need an ldb search and a fresh
+ * NDR parse of the dnsRecord values each time.
+ *
+ * A cached value is the WERROR of the lookup, the number of records
+ * and then, for each record, its length and NDR encoding.
+ *
+ * Only lookups done as the system session use the cache.  Updates
+ * signed with a TSIG key set DSDB_SESSION_INFO to the session of the
+ * key for their prerequisite lookups, and what that session can read
+ * must neither be served to others nor be answered from what the
+ * system session read.
+ */
+static bool dns_record_cache_current(struct dns_server *dns)
+{
+	struct auth_session_info *session_info = NULL;
+	uint64_t seq_num;
+	int ret;
+
+	if (dns->record_cache == NULL) {
+		return false;
+	}
+
+	session_info = talloc_get_type(
+		ldb_get_opaque(dns->samdb, DSDB_SESSION_INFO),
+		struct auth_session_info);
+	if (security_session_user_level(session_info, NULL) !=
+	    SECURITY_SYSTEM) {
+		return false;
+	}
+
+	ret = ldb_sequence_number(dns->samdb, LDB_SEQ_HIGHEST_SEQ, &seq_num);
+	if (ret != LDB_SUCCESS) {
+		return false;
+	}
+
+	if (seq_num != dns->record_cache_seq_num) {
+		DBG_DEBUG("Flushing DNS record cache after %llu hits, "
+			  "%llu misses\n",
+			  (unsigned long long)dns->record_cache_hits,
+			  (unsigned long long)dns->record_cache_misses);
+		memcache_flush(dns->record_cache, DNS_RECORD_CACHE);
+		dns->record_cache_seq_num = seq_num;
+		dns->record_cache_hits = 0;
+		dns->record_cache_misses = 0;
+	}
+
+	return true;
+}
+
+static DATA_BLOB dns_record_cache_key(TALLOC_CTX *mem_ctx,
+				      struct ldb_dn *dn,
+				      bool wildcard)
+{
+	const char *casefold = ldb_dn_get_casefold(dn);
+	char *key = NULL;
+
+	if (casefold == NULL) {
+		return data_blob_null;
+	}
+
+	key = talloc_asprintf(mem_ctx, "%c%s", wildcard ? 'W' : 'E', casefold);
+	if (key == NULL) {
+		return data_blob_null;
+	}
+
+	return data_blob_const(key, strlen(key));
+}
+
+static bool dns_record_cache_lookup(struct dns_server *dns,
+				    TALLOC_CTX *mem_ctx,
+				    DATA_BLOB key,
+				    WERROR *werr,
+				    struct dnsp_DnssrvRpcRecord **records,
+				    uint16_t *rec_count)
+{
+	struct dnsp_DnssrvRpcRecord *recs = NULL;
+	DATA_BLOB value;
+	size_t ofs;
+	uint32_t count;
+	uint32_t i;
+
+	if (!memcache_lookup(dns->record_cache, DNS_RECORD_CACHE,
+			     key, &value)) {
+		dns->record_cache_misses++;
+		return false;
+	}
+
+	if (value.length < 8) {
+		return false;
+	}
+	*werr = W_ERROR(IVAL(value.data, 0));
+	count = IVAL(value.data, 4);
+	ofs = 8;
+
+	if (count > 0) {
+		recs = talloc_zero_array(mem_ctx,
+					 struct dnsp_DnssrvRpcRecord,
+					 count);
+		if (recs == NULL) {
+			return false;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		DATA_BLOB blob;
+		enum ndr_err_code ndr_err;
+
+		if (value.length - ofs < 4) {
+			TALLOC_FREE(recs);
+			return false;
+		}
+		blob.length = IVAL(value.data, ofs);
+		ofs += 4;
+		if (value.length - ofs < blob.length) {
+			TALLOC_FREE(recs);
+			return false;
+		}
+		blob.data = value.data + ofs;
+		ofs += blob.length;
+
+		ndr_err = ndr_pull_struct_blob(&blob, recs, &recs[i],
+				(ndr_pull_flags_fn_t)ndr_pull_dnsp_DnssrvRpcRecord);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			TALLOC_FREE(recs);
+			return false;
+		}
+	}
+
+	dns->record_cache_hits++;
+	*records = recs;
+	*rec_count = count;
+	return true;
+}
+
+static void dns_record_cache_add(struct dns_server *dns,
+				 DATA_BLOB key,
+				 WERROR werr,
+				 struct dnsp_DnssrvRpcRecord *records,
+				 uint16_t rec_count)
+{
+	TALLOC_CTX *tmp_ctx = NULL;
+	DATA_BLOB value;
+	uint16_t i;
+
+	/*
+	 * Only found records and names that do not exist are kept.
+	 * DNS_ERR(NAME_ERROR) is also what a failed search returns,
+	 * so it is not cached.
+	 */
+	if (!W_ERROR_IS_OK(werr) &&
+	    !W_ERROR_EQUAL(werr, WERR_DNS_ERROR_NAME_DOES_NOT_EXIST)) {
+		return;
+	}
+	if (!W_ERROR_IS_OK(werr)) {
+		rec_count = 0;
+	}
+
+	tmp_ctx = talloc_new(dns);
+	if (tmp_ctx == NULL) {
+		return;
+	}
+
+	value = data_blob_talloc(tmp_ctx, NULL, 8);
+	if (value.data == NULL) {
+		TALLOC_FREE(tmp_ctx);
+		return;
+	}
+	SIVAL(value.data, 0, W_ERROR_V(werr));
+	SIVAL(value.data, 4, rec_count);
+
+	for (i = 0; i < rec_count; i++) {
+		DATA_BLOB blob;
+		uint8_t len[4];
+		enum ndr_err_code ndr_err;
+
+		ndr_err = ndr_push_struct_blob(&blob, tmp_ctx, &records[i],
+				(ndr_push_flags_fn_t)ndr_push_dnsp_DnssrvRpcRecord);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			TALLOC_FREE(tmp_ctx);
+			return;
+		}
+
+		SIVAL(len, 0, blob.length);
+		if (!data_blob_append(tmp_ctx, &value, len, sizeof(len)) ||
+		    !data_blob_append(tmp_ctx, &value, blob.data, blob.length)) {
+			TALLOC_FREE(tmp_ctx);
+			return;
+		}
+	}
+
+	memcache_add(dns->record_cache, DNS_RECORD_CACHE, key, value);
+	TALLOC_FREE(tmp_ctx);
+}
+
+static WERROR dns_lookup_records_cached(struct dns_server *dns,
+					TALLOC_CTX *mem_ctx,
+					struct ldb_dn *dn,
+					bool wildcard,
+					struct dnsp_DnssrvRpcRecord **records,
+					uint16_t *rec_count)
+{
+	DATA_BLOB key = data_blob_null;
+	WERROR werr;
+
+	*records = NULL;
+	*rec_count = 0;
+
+	if (dns_record_cache_current(dns)) {
+		key = dns_record_cache_key(mem_ctx, dn, wildcard);
+	}
+
+	if (key.data != NULL &&
+	    dns_record_cache_lookup(dns, mem_ctx, key,
+				    &werr, records, rec_count)) {
+		TALLOC_FREE(key.data);
+		return werr;
+	}
+
+	if (wildcard) {
+		werr = dns_common_wildcard_lookup(dns->samdb, mem_ctx, dn,
+						  records, rec_count);
+	} else {
+		werr = dns_common_lookup(dns->samdb, mem_ctx, dn,
+					 records, rec_count, NULL);
+	}
+
+	if (key.data != NULL) {
+		dns_record_cache_add(dns, key, werr, *records, *rec_count);
+		TALLOC_FREE(key.data);
+	}
+	return werr;
+}
+
 /*
  * Lookup a DNS record, performing an exact match.
  * i.e. DNS wild card records are not considered.
@@ -117,8 +356,8 @@ WERROR dns_lookup_records(struct dns_server *dns,
 			  struct dnsp_DnssrvRpcRecord **records,
 			  uint16_t *rec_count)
 {
-	return dns_common_lookup(dns->samdb, mem_ctx, dn,
-				 records, rec_count, NULL);
+	return dns_lookup_records_cached(dns, mem_ctx, dn, false,
+					 records, rec_count);
 }
 
 /*
@@ -131,8 +370,8 @@ WERROR dns_lookup_records_wildcard(struct dns_server *dns,
 			  struct dnsp_DnssrvRpcRecord **records,
 			  uint16_t *rec_count)
 {
-	return dns_common_wildcard_lookup(dns->samdb, mem_ctx, dn,
-				 records, rec_count);
+	return dns_lookup_records_cached(dns, mem_ctx, dn, true,
+					 records, rec_count);
 }
 
 WERROR dns_replace_records(struct dns_server *dns,
@@ -41,43 +41,259 @@ static bool sids_contains_sid(const struct dom_sid *sids,
 }
 
 /*
- * This function generates the transitive closure of a given SAM object "dn_val"
- * (it basically expands nested memberships).
- * If the object isn't located in the "res_sids" structure yet and the
- * "only_childs" flag is false, we add it to "res_sids".
- * Then we've always to consider the "memberOf" attributes. We invoke the
- * function recursively on each of it with the "only_childs" flag set to
- * "false".
- * The "only_childs" flag is particularly useful if you have a user object and
- * want to include all it's groups (referenced with "memberOf") but not itself
- * or considering if that object matches the filter.
+ * The group memberships looked up by dsdb_expand_nested_groups(),
+ * kept on the ldb context so that the groups shared by many users
+ * are only searched for once.
  *
- * At the beginning "res_sids" should reference to a NULL pointer.
+ * An entry records the result of the base search for one object
+ * (with the filter, or with no filter for an 'only_childs' lookup):
+ * whether it was found and its memberOf values.  The whole cache is
+ * emptied when the sequence number of the database changes, which it
+ * does on any write, including a membership change made by another
+ * process or by replication.
  */
-NTSTATUS dsdb_expand_nested_groups(struct ldb_context *sam_ctx,
-				   struct ldb_val *dn_val, const bool only_childs, const char *filter,
-				   TALLOC_CTX *res_sids_ctx, struct dom_sid **res_sids,
-				   unsigned int *num_res_sids)
+#define DSDB_GROUP_CACHE_BUCKETS 1024
+#define DSDB_GROUP_CACHE_MAX_ENTRIES 100000
+
+struct dsdb_group_cache_entry {
+	struct dsdb_group_cache_entry *next;
+	struct dom_sid sid;
+	/* NULL for an only_childs lookup */
+	const char *filter;
+	bool found;
+	unsigned int num_member_of;
+	struct ldb_val *member_of;
+};
+
+struct dsdb_group_cache {
+	uint64_t seq_num;
+	unsigned int num_entries;
+	struct dsdb_group_cache_entry **buckets;
+	/* set while an expansion is walking the entries */
+	bool in_use;
+	/* counters for dsdb_expand_nested_groups_stats() */
+	uint64_t hits;
+	uint64_t searches;
+};
+
+/*
+ * Find the group cache of this ldb context, emptied if the database
+ * has changed since it was filled.
+ *
+ * Returns NULL (so that every lookup is a search) if the sequence
+ * number is not available.
+ */
+static struct dsdb_group_cache *dsdb_group_cache_get(struct ldb_context *sam_ctx)
+{
+	struct dsdb_group_cache *cache = NULL;
+	uint64_t seq_num;
+	int ret;
+
+	ret = ldb_sequence_number(sam_ctx, LDB_SEQ_HIGHEST_SEQ, &seq_num);
+	if (ret != LDB_SUCCESS) {
+		return NULL;
+	}
+
+	cache = talloc_get_type(ldb_get_opaque(sam_ctx, "cache.group_expansion"),
+				struct dsdb_group_cache);
+	if (cache == NULL) {
+		cache = talloc_zero(sam_ctx, struct dsdb_group_cache);
+		if (cache == NULL) {
+			return NULL;
+		}
+		ret = ldb_set_opaque(sam_ctx, "cache.group_expansion", cache);
+		if (ret != LDB_SUCCESS) {
+			talloc_free(cache);
+			return NULL;
+		}
+	}
+
+	if (cache->in_use) {
+		/*
+		 * Called from a search made by an expansion, which
+		 * must not have the entries it is walking freed.
+		 */
+		return NULL;
+	}
+
+	if (cache->buckets != NULL &&
+	    (cache->seq_num != seq_num ||
+	     cache->num_entries > DSDB_GROUP_CACHE_MAX_ENTRIES)) {
+		TALLOC_FREE(cache->buckets);
+		cache->num_entries = 0;
+	}
+	if (cache->buckets == NULL) {
+		cache->buckets = talloc_zero_array(cache,
+						   struct dsdb_group_cache_entry *,
+						   DSDB_GROUP_CACHE_BUCKETS);
+		if (cache->buckets == NULL) {
+			return NULL;
+		}
+	}
+	cache->seq_num = seq_num;
+
+	return cache;
+}
+
+static unsigned int dsdb_group_cache_bucket(const struct dom_sid *sid)
+{
+	if (sid->num_auths == 0) {
+		return 0;
+	}
+	return sid->sub_auths[sid->num_auths - 1] % DSDB_GROUP_CACHE_BUCKETS;
+}
+
+/*
+ * Search for the memberOf values of an object, or find them in the
+ * cache.
+ *
+ * The entry returned is owned by the cache (or by mem_ctx if there is
+ * no cache) and stays valid until the next call to
+ * dsdb_group_cache_get().
+ */
+static NTSTATUS dsdb_group_cache_lookup(struct ldb_context *sam_ctx,
+					struct dsdb_group_cache *cache,
+					TALLOC_CTX *mem_ctx,
+					struct ldb_dn *dn,
+					const struct dom_sid *sid,
+					const bool only_childs,
+					const char *filter,
+					const struct dsdb_group_cache_entry **_entry)
 {
 	const char * const attrs[] = { "memberOf", NULL };
+	struct dsdb_group_cache_entry *entry = NULL;
+	const struct ldb_message_element *el = NULL;
+	const char *entry_filter = only_childs ? NULL : filter;
+	struct ldb_result *res = NULL;
+	unsigned int bucket = 0;
 	unsigned int i;
 	int ret;
+
+	if (cache != NULL) {
+		bucket = dsdb_group_cache_bucket(sid);
+		for (entry = cache->buckets[bucket];
+		     entry != NULL;
+		     entry = entry->next) {
+			if (!dom_sid_equal(&entry->sid, sid)) {
+				continue;
+			}
+			if (entry->filter == NULL || entry_filter == NULL) {
+				if (entry->filter != entry_filter) {
+					continue;
+				}
+			} else if (strcmp(entry->filter, entry_filter) != 0) {
+				continue;
+			}
+			cache->hits++;
+			*_entry = entry;
+			return NT_STATUS_OK;
+		}
+		cache->searches++;
+	}
+
+	if (only_childs) {
+		ret = dsdb_search_dn(sam_ctx, mem_ctx, &res, dn, attrs,
+				     DSDB_SEARCH_SHOW_EXTENDED_DN);
+	} else {
+		ret = dsdb_search(sam_ctx, mem_ctx, &res, dn, LDB_SCOPE_BASE,
+				  attrs, DSDB_SEARCH_SHOW_EXTENDED_DN, "%s",
+				  filter);
+	}
+
+	/*
+	 * We have the problem with the caller creating a <SID=S-....>
+	 * DN for ForeignSecurityPrincipals as they also have
+	 * duplicate objects with the SAME SID under CN=Configuration.
+	 * This causes a SID= DN to fail with NO_SUCH_OBJECT on Samba
+	 * and on Windows.  So, we allow this to fail, and
+	 * double-check if we can find it with a search in the main
+	 * domain partition.
+	 */
+	if (ret == LDB_ERR_NO_SUCH_OBJECT && only_childs) {
+		char *sid_string = dom_sid_string(mem_ctx, sid);
+		if (!sid_string) {
+			return NT_STATUS_NO_MEMORY;
+		}
+
+		ret = dsdb_search(sam_ctx, mem_ctx, &res,
+				  ldb_get_default_basedn(sam_ctx),
+				  LDB_SCOPE_SUBTREE,
+				  attrs, DSDB_SEARCH_SHOW_EXTENDED_DN,
+				  "(&(objectClass=foreignSecurityPrincipal)(objectSID=%s))",
+				  sid_string);
+	}
+
+	if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+		DEBUG(1, (__location__ ": dsdb_search for %s failed: %s\n",
+			  ldb_dn_get_extended_linearized(mem_ctx, dn, 1),
+			  ldb_errstring(sam_ctx)));
+		return NT_STATUS_INTERNAL_DB_CORRUPTION;
+	}
+
+	entry = talloc_zero(cache != NULL ? (TALLOC_CTX *)cache->buckets : mem_ctx,
+			    struct dsdb_group_cache_entry);
+	if (entry == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	entry->sid = *sid;
+	if (entry_filter != NULL) {
+		entry->filter = talloc_strdup(entry, entry_filter);
+		if (entry->filter == NULL) {
+			talloc_free(entry);
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
+	/* We may get back 0 results, if the SID didn't match the filter - such as it wasn't a domain group, for example */
+	entry->found = (ret == LDB_SUCCESS && res->count == 1);
+
+	if (entry->found) {
+		el = ldb_msg_find_element(res->msgs[0], "memberOf");
+	}
+	if (el != NULL && el->num_values > 0) {
+		entry->member_of = talloc_array(entry, struct ldb_val,
+						el->num_values);
+		if (entry->member_of == NULL) {
+			talloc_free(entry);
+			return NT_STATUS_NO_MEMORY;
+		}
+		for (i = 0; i < el->num_values; i++) {
+			entry->member_of[i] = ldb_val_dup(entry->member_of,
+							  &el->values[i]);
+			if (entry->member_of[i].data == NULL) {
+				talloc_free(entry);
+				return NT_STATUS_NO_MEMORY;
+			}
+		}
+		entry->num_member_of = el->num_values;
+	}
+
+	if (cache != NULL) {
+		entry->next = cache->buckets[bucket];
+		cache->buckets[bucket] = entry;
+		cache->num_entries++;
+	}
+
+	*_entry = entry;
+	return NT_STATUS_OK;
+}
+
+static NTSTATUS dsdb_expand_nested_groups_cached(struct ldb_context *sam_ctx,
+						 struct dsdb_group_cache *cache,
+						 struct ldb_val *dn_val,
+						 const bool only_childs,
+						 const char *filter,
+						 TALLOC_CTX *res_sids_ctx,
+						 struct dom_sid **res_sids,
+						 unsigned int *num_res_sids)
+{
+	unsigned int i;
 	bool already_there;
 	struct ldb_dn *dn;
 	struct dom_sid sid;
 	TALLOC_CTX *tmp_ctx;
-	struct ldb_result *res;
+	const struct dsdb_group_cache_entry *entry = NULL;
 	NTSTATUS status;
-	const struct ldb_message_element *el;
-
-	if (*res_sids == NULL) {
-		*num_res_sids = 0;
-	}
-
-	if (!sam_ctx) {
-		DEBUG(0, ("No SAM available, cannot determine local groups\n"));
-		return NT_STATUS_INVALID_SYSTEM_SERVICE;
-	}
 
 	tmp_ctx = talloc_new(res_sids_ctx);
 
@@ -109,10 +325,7 @@ NTSTATUS dsdb_expand_nested_groups(struct ldb_context *sam_ctx,
 		return NT_STATUS_INTERNAL_DB_CORRUPTION;
 	}
 
-	if (only_childs) {
-		ret = dsdb_search_dn(sam_ctx, tmp_ctx, &res, dn, attrs,
-				     DSDB_SEARCH_SHOW_EXTENDED_DN);
-	} else {
+	if (!only_childs) {
 		/* This is an O(n^2) linear search */
 		already_there = sids_contains_sid(*res_sids,
 						  *num_res_sids, &sid);
@@ -120,52 +333,16 @@ NTSTATUS dsdb_expand_nested_groups(struct ldb_context *sam_ctx,
 			talloc_free(tmp_ctx);
 			return NT_STATUS_OK;
 		}
-
-		ret = dsdb_search(sam_ctx, tmp_ctx, &res, dn, LDB_SCOPE_BASE,
-				  attrs, DSDB_SEARCH_SHOW_EXTENDED_DN, "%s",
-				  filter);
-	}
-
-	/*
-	 * We have the problem with the caller creating a <SID=S-....>
-	 * DN for ForeignSecurityPrincipals as they also have
-	 * duplicate objects with the SAME SID under CN=Configuration.
-	 * This causes a SID= DN to fail with NO_SUCH_OBJECT on Samba
-	 * and on Windows.  So, we allow this to fail, and
-	 * double-check if we can find it with a search in the main
-	 * domain partition.
-	 */
-	if (ret == LDB_ERR_NO_SUCH_OBJECT && only_childs) {
-		char *sid_string = dom_sid_string(tmp_ctx,
-						  &sid);
-		if (!sid_string) {
-			talloc_free(tmp_ctx);
-			return NT_STATUS_OK;
-		}
-
-		ret = dsdb_search(sam_ctx, tmp_ctx, &res,
-				  ldb_get_default_basedn(sam_ctx),
-				  LDB_SCOPE_SUBTREE,
-				  attrs, DSDB_SEARCH_SHOW_EXTENDED_DN,
-				  "(&(objectClass=foreignSecurityPrincipal)(objectSID=%s))",
-				  sid_string);
 	}
 
-	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+	status = dsdb_group_cache_lookup(sam_ctx, cache, tmp_ctx, dn, &sid,
+					 only_childs, filter, &entry);
+	if (!NT_STATUS_IS_OK(status)) {
 		talloc_free(tmp_ctx);
-		return NT_STATUS_OK;
-	}
-
-	if (ret != LDB_SUCCESS) {
-		DEBUG(1, (__location__ ": dsdb_search for %s failed: %s\n",
-			  ldb_dn_get_extended_linearized(tmp_ctx, dn, 1),
-			  ldb_errstring(sam_ctx)));
-		talloc_free(tmp_ctx);
-		return NT_STATUS_INTERNAL_DB_CORRUPTION;
+		return status;
 	}
 
-	/* We may get back 0 results, if the SID didn't match the filter - such as it wasn't a domain group, for example */
-	if (res->count != 1) {
+	if (!entry->found) {
 		talloc_free(tmp_ctx);
 		return NT_STATUS_OK;
 	}
@@ -182,11 +359,13 @@ NTSTATUS dsdb_expand_nested_groups(struct ldb_context *sam_ctx,
 		++(*num_res_sids);
 	}
 
-	el = ldb_msg_find_element(res->msgs[0], "memberOf");
-
-	for (i = 0; el && i < el->num_values; i++) {
-		status = dsdb_expand_nested_groups(sam_ctx, &el->values[i],
-						   false, filter, res_sids_ctx, res_sids, num_res_sids);
+	for (i = 0; i < entry->num_member_of; i++) {
+		status = dsdb_expand_nested_groups_cached(sam_ctx, cache,
+							  &entry->member_of[i],
+							  false, filter,
+							  res_sids_ctx,
+							  res_sids,
+							  num_res_sids);
 		if (!NT_STATUS_IS_OK(status)) {
 			talloc_free(tmp_ctx);
 			return status;
@@ -197,3 +376,72 @@ NTSTATUS dsdb_expand_nested_groups(struct ldb_context *sam_ctx,
 
 	return NT_STATUS_OK;
 }
+
+/*
+ * This function generates the transitive closure of a given SAM object "dn_val"
+ * (it basically expands nested memberships).
+ * If the object isn't located in the "res_sids" structure yet and the
+ * "only_childs" flag is false, we add it to "res_sids".
+ * Then we've always to consider the "memberOf" attributes. We invoke the
+ * function recursively on each of it with the "only_childs" flag set to
+ * "false".
+ * The "only_childs" flag is particularly useful if you have a user object and
+ * want to include all it's groups (referenced with "memberOf") but not itself
+ * or considering if that object matches the filter.
+ *
+ * At the beginning "res_sids" should reference to a NULL pointer.
+ */
+NTSTATUS dsdb_expand_nested_groups(struct ldb_context *sam_ctx,
+				   struct ldb_val *dn_val, const bool only_childs, const char *filter,
+				   TALLOC_CTX *res_sids_ctx, struct dom_sid **res_sids,
+				   unsigned int *num_res_sids)
+{
+	struct dsdb_group_cache *cache = NULL;
+	NTSTATUS status;
+
+	if (*res_sids == NULL) {
+		*num_res_sids = 0;
+	}
+
+	if (!sam_ctx) {
+		DEBUG(0, ("No SAM available, cannot determine local groups\n"));
+		return NT_STATUS_INVALID_SYSTEM_SERVICE;
+	}
+
+	cache = dsdb_group_cache_get(sam_ctx);
+	if (cache != NULL) {
+		cache->in_use = true;
+	}
+
+	status = dsdb_expand_nested_groups_cached(sam_ctx, cache, dn_val,
+						  only_childs, filter,
+						  res_sids_ctx, res_sids,
+						  num_res_sids);
+
+	if (cache != NULL) {
+		cache->in_use = false;
+	}
+	return status;
+}
+
+/*
+ * Return the number of group lookups answered from the cache, and the
+ * number that needed a search, since this ldb context was opened.
+ */
+void dsdb_expand_nested_groups_stats(struct ldb_context *sam_ctx,
+				     uint64_t *hits,
+				     uint64_t *searches)
+{
+	struct dsdb_group_cache *cache = NULL;
+
+	*hits = 0;
+	*searches = 0;
+
+	cache = talloc_get_type(ldb_get_opaque(sam_ctx, "cache.group_expansion"),
+				struct dsdb_group_cache);
+	if (cache == NULL) {
+		return;
+	}
+	*hits = cache->hits;
+	*searches = cache->searches;
+}
@@ -261,8 +261,96 @@ struct dreplsrv_op_pull_source_state {
 	enum drsuapi_DsExtendedOperation extended_op_retry;
 	bool retry_started;
 	struct dreplsrv_op_pull_source_schema_cycle *schema_cycle;
+
+	/*
+	 * While a chunk is applied, the request for the next one
+	 * is already on its way (see dreplsrv_op_pull_source_prefetch())
+	 */
+	struct tevent_req *prefetch_subreq;
+	struct drsuapi_DsGetNCChanges *prefetch_r;
+	bool prefetch_received;
+	NTSTATUS prefetch_status;
+
+	/* a chunk waiting to be applied, and whether one is applied now */
+	struct drsuapi_DsGetNCChanges *apply_r;
+	uint32_t apply_ctr_level;
+	struct drsuapi_DsGetNCChangesCtr1 *apply_ctr1;
+	struct drsuapi_DsGetNCChangesCtr6 *apply_ctr6;
+	bool applying;
+
+	/* throughput of the current partition */
+	struct {
+		struct timeval start;
+		uint32_t chunks;
+		uint64_t objects;
+		uint64_t links;
+		uint64_t compressed_bytes;
+		uint64_t decompressed_bytes;
+	} stats;
 };
 
+static void dreplsrv_op_pull_source_drop_prefetch(
+	struct dreplsrv_op_pull_source_state *state)
+{
+	TALLOC_FREE(state->prefetch_subreq);
+	TALLOC_FREE(state->prefetch_r);
+	state->prefetch_received = false;
+}
+
+/* the next chunk was asked for already, see dreplsrv_op_pull_source_prefetch() */
+static bool dreplsrv_op_pull_source_prefetched(
+	struct dreplsrv_op_pull_source_state *state)
+{
+	return state->prefetch_subreq != NULL || state->prefetch_received;
+}
+
+/*
+ * Log how fast the partition was replicated, and start counting again
+ * for the next one, if any
+ */
+static void dreplsrv_op_pull_source_report(
+	struct dreplsrv_op_pull_source_state *state)
+{
+	struct dreplsrv_partition_source_dsa *source_dsa = state->op->source_dsa;
+	const char *source = NULL;
+	struct GUID_txt_buf guid_buf;
+	double elapsed = timeval_elapsed(&state->stats.start);
+
+	if (source_dsa->repsFrom1->other_info != NULL &&
+	    source_dsa->repsFrom1->other_info->dns_name != NULL) {
+		source = source_dsa->repsFrom1->other_info->dns_name;
+	} else {
+		source = GUID_buf_string(&source_dsa->repsFrom1->source_dsa_obj_guid,
+					 &guid_buf);
+	}
+
+	DBG_NOTICE("Replicated %s from %s: %"PRIu32" chunks, "
+		   "%"PRIu64" objects, %"PRIu64" links in %.3f seconds "
+		   "(%.1f objects/s), %"PRIu64" bytes compressed to %"PRIu64"\n",
+		   ldb_dn_get_linearized(source_dsa->partition->dn),
+		   source,
+		   state->stats.chunks,
+		   state->stats.objects,
+		   state->stats.links,
+		   elapsed,
+		   elapsed > 0 ? state->stats.objects / elapsed : 0.0,
+		   state->stats.decompressed_bytes,
+		   state->stats.compressed_bytes);
+
+	ZERO_STRUCT(state->stats);
+	state->stats.start = timeval_current();
+}
+
+static void dreplsrv_op_pull_source_cleanup(struct tevent_req *req,
+					    enum tevent_req_state req_state)
+{
+	struct dreplsrv_op_pull_source_state *state =
+		tevent_req_data(req,
+		struct dreplsrv_op_pull_source_state);
+
+	dreplsrv_op_pull_source_drop_prefetch(state);
+}
+
 static void dreplsrv_op_pull_source_connect_done(struct tevent_req *subreq);
 
 struct tevent_req *dreplsrv_op_pull_source_send(TALLOC_CTX *mem_ctx,
@@ -280,6 +368,14 @@ struct tevent_req *dreplsrv_op_pull_source_send(TALLOC_CTX *mem_ctx,
 	}
 	state->ev = ev;
 	state->op = op;
+	state->stats.start = timeval_current();
+
+	/*
+	 * Applying a chunk may finish the request, and we look at
+	 * the state afterwards
+	 */
+	tevent_req_defer_callback(req, ev);
+	tevent_req_set_cleanup_fn(req, dreplsrv_op_pull_source_cleanup);
 
 	subreq = dreplsrv_out_drsuapi_send(state, ev, op->source_dsa->conn);
 	if (tevent_req_nomem(subreq, req)) {
@@ -474,11 +570,17 @@ static WERROR udv_convert(TALLOC_CTX *mem_ctx,
 }
 
 
-static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
+/*
+  build and send a DsGetNCChanges request, starting at the
+  highwatermark in rf1
+ */
+static struct tevent_req *dreplsrv_op_pull_source_get_changes_request(
+	struct tevent_req *req,
+	const struct repsFromTo1 *rf1,
+	struct drsuapi_DsGetNCChanges **pr)
 {
 	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
 						      struct dreplsrv_op_pull_source_state);
-	const struct repsFromTo1 *rf1 = state->op->source_dsa->repsFrom1;
 	struct dreplsrv_service *service = state->op->service;
 	struct dreplsrv_partition *partition = state->op->source_dsa->partition;
 	struct dreplsrv_drsuapi_connection *drsuapi = state->op->source_dsa->conn->drsuapi;
@@ -494,25 +596,24 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 
 	if (state->schema_cycle != NULL) {
 		is_schema = true;
-		rf1 = &state->schema_cycle->repsFrom1;
 	}
 
 	r = talloc(state, struct drsuapi_DsGetNCChanges);
 	if (tevent_req_nomem(r, req)) {
-		return;
+		return NULL;
 	}
 
 	r->out.level_out = talloc(r, uint32_t);
 	if (tevent_req_nomem(r->out.level_out, req)) {
-		return;
+		return NULL;
 	}
 	r->in.req = talloc(r, union drsuapi_DsGetNCChangesRequest);
 	if (tevent_req_nomem(r->in.req, req)) {
-		return;
+		return NULL;
 	}
 	r->out.ctr = talloc(r, union drsuapi_DsGetNCChangesCtr);
 	if (tevent_req_nomem(r->out.ctr, req)) {
-		return;
+		return NULL;
 	}
 
 	if (partition->uptodatevector.count != 0 &&
@@ -523,7 +624,7 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 			DEBUG(0,(__location__ ": Failed to convert UDV for %s : %s\n",
 				 ldb_dn_get_linearized(partition->dn), win_errstr(werr)));
 			tevent_req_nterror(req, werror_to_ntstatus(werr));
-			return;
+			return NULL;
 		}
 	}
 
@@ -544,6 +645,16 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 		replica_flags |= DRSUAPI_DRS_SYNC_FORCED;
 	}
 
+	/*
+	 * The compressed reply formats were negotiated in DsBind(),
+	 * but the source DSA only uses them if asked to
+	 */
+	if (service->pull.compression &&
+	    (drsuapi->remote_info28.supported_extensions &
+	     DRSUAPI_SUPPORTED_EXTENSION_GETCHG_COMPRESS)) {
+		replica_flags |= DRSUAPI_DRS_USE_COMPRESSION;
+	}
+
 	if (partition->partial_replica) {
 		status = dreplsrv_get_gc_partial_attribute_set(service, r,
 							       &pas,
@@ -551,7 +662,7 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 		if (!NT_STATUS_IS_OK(status)) {
 			DEBUG(0,(__location__ ": Failed to construct GC partial attribute set : %s\n", nt_errstr(status)));
 			tevent_req_nterror(req, status);
-			return;
+			return NULL;
 		}
 		replica_flags &= ~DRSUAPI_DRS_WRIT_REP;
 	} else if (partition->rodc_replica || state->op->extended_op == DRSUAPI_EXOP_REPL_SECRET) {
@@ -562,7 +673,7 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 		if (!NT_STATUS_IS_OK(status)) {
 			DEBUG(0,(__location__ ": Failed to construct RODC partial attribute set : %s\n", nt_errstr(status)));
 			tevent_req_nterror(req, status);
-			return;
+			return NULL;
 		}
 		replica_flags &= ~DRSUAPI_DRS_WRIT_REP;
 		if (state->op->extended_op == DRSUAPI_EXOP_REPL_SECRET) {
@@ -662,40 +773,210 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 	NDR_PRINT_IN_DEBUG(drsuapi_DsGetNCChanges, r);
 #endif
 
-	state->ndr_struct_ptr = r;
 	subreq = dcerpc_drsuapi_DsGetNCChanges_r_send(state,
 						      state->ev,
 						      drsuapi->drsuapi_handle,
 						      r);
 	if (tevent_req_nomem(subreq, req)) {
+		return NULL;
+	}
+
+	*pr = r;
+	return subreq;
+}
+
+static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	const struct repsFromTo1 *rf1 = state->op->source_dsa->repsFrom1;
+	struct drsuapi_DsGetNCChanges *r = NULL;
+	struct tevent_req *subreq;
+
+	/*
+	 * Whatever made us start again, a chunk asked for in advance
+	 * is not the one we want
+	 */
+	dreplsrv_op_pull_source_drop_prefetch(state);
+
+	if (state->schema_cycle != NULL) {
+		rf1 = &state->schema_cycle->repsFrom1;
+	}
+
+	subreq = dreplsrv_op_pull_source_get_changes_request(req, rf1, &r);
+	if (subreq == NULL) {
 		return;
 	}
+
+	state->ndr_struct_ptr = r;
 	tevent_req_set_callback(subreq, dreplsrv_op_pull_source_get_changes_done, req);
 }
 
+static void dreplsrv_op_pull_source_changes_received(struct tevent_req *req,
+						     struct drsuapi_DsGetNCChanges *r,
+						     NTSTATUS status);
+
+static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(subreq,
+				 struct tevent_req);
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	NTSTATUS status;
+	struct drsuapi_DsGetNCChanges *r = talloc_get_type(state->ndr_struct_ptr,
+					   struct drsuapi_DsGetNCChanges);
+	state->ndr_struct_ptr = NULL;
+
+	status = dcerpc_drsuapi_DsGetNCChanges_r_recv(subreq, r);
+	TALLOC_FREE(subreq);
+
+	dreplsrv_op_pull_source_changes_received(req, r, status);
+}
+
+static void dreplsrv_op_pull_source_prefetch_done(struct tevent_req *subreq);
+
+/*
+ * Ask for the chunk after the one in ctr1/ctr6 before applying it, so
+ * that the source DSA prepares it, and it comes over the network,
+ * while we apply this one.  This is the request we would make once
+ * this chunk is applied, see dreplsrv_op_pull_source_apply_changes_trigger().
+ * If applying fails and we have to start again, the reply is dropped.
+ */
+static bool dreplsrv_op_pull_source_prefetch(struct tevent_req *req,
+					     uint32_t ctr_level,
+					     struct drsuapi_DsGetNCChangesCtr1 *ctr1,
+					     struct drsuapi_DsGetNCChangesCtr6 *ctr6)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	struct repsFromTo1 rf1 = *state->op->source_dsa->repsFrom1;
+	struct tevent_req *subreq = NULL;
+
+	if (state->schema_cycle != NULL) {
+		rf1 = state->schema_cycle->repsFrom1;
+	}
+
+	switch (ctr_level) {
+	case 1:
+		rf1.source_dsa_obj_guid		= ctr1->source_dsa_guid;
+		rf1.source_dsa_invocation_id	= ctr1->source_dsa_invocation_id;
+		rf1.highwatermark		= ctr1->new_highwatermark;
+		break;
+	case 6:
+		rf1.source_dsa_obj_guid		= ctr6->source_dsa_guid;
+		rf1.source_dsa_invocation_id	= ctr6->source_dsa_invocation_id;
+		rf1.highwatermark		= ctr6->new_highwatermark;
+		break;
+	default:
+		return false;
+	}
+
+	subreq = dreplsrv_op_pull_source_get_changes_request(req, &rf1,
+							     &state->prefetch_r);
+	if (subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, dreplsrv_op_pull_source_prefetch_done, req);
+	state->prefetch_subreq = subreq;
+
+	return true;
+}
+
+static void dreplsrv_op_pull_source_prefetch_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(subreq,
+				 struct tevent_req);
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	struct drsuapi_DsGetNCChanges *r = state->prefetch_r;
+	NTSTATUS status;
+
+	status = dcerpc_drsuapi_DsGetNCChanges_r_recv(subreq, r);
+	TALLOC_FREE(subreq);
+	state->prefetch_subreq = NULL;
+
+	if (state->applying || state->apply_r != NULL) {
+		/* dreplsrv_op_pull_source_apply() picks it up */
+		state->prefetch_received = true;
+		state->prefetch_status = status;
+		return;
+	}
+
+	state->prefetch_r = NULL;
+	dreplsrv_op_pull_source_changes_received(req, r, status);
+}
+
 static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req,
 						          struct drsuapi_DsGetNCChanges *r,
 						          uint32_t ctr_level,
 						          struct drsuapi_DsGetNCChangesCtr1 *ctr1,
 						          struct drsuapi_DsGetNCChangesCtr6 *ctr6);
 
-static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
+static void dreplsrv_op_pull_source_apply(struct tevent_req *req,
+					  struct drsuapi_DsGetNCChanges *r,
+					  uint32_t ctr_level,
+					  struct drsuapi_DsGetNCChangesCtr1 *ctr1,
+					  struct drsuapi_DsGetNCChangesCtr6 *ctr6)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	NTSTATUS status;
+
+	state->applying = true;
+	dreplsrv_op_pull_source_apply_changes_trigger(req, r, ctr_level,
+						      ctr1, ctr6);
+	state->applying = false;
+
+	if (!tevent_req_is_in_progress(req)) {
+		return;
+	}
+
+	if (state->prefetch_received) {
+		/* the next chunk came in while we applied this one */
+		r = state->prefetch_r;
+		status = state->prefetch_status;
+		state->prefetch_r = NULL;
+		state->prefetch_received = false;
+		dreplsrv_op_pull_source_changes_received(req, r, status);
+	}
+}
+
+static void dreplsrv_op_pull_source_apply_wakeup(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(subreq,
 				 struct tevent_req);
 	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
 						      struct dreplsrv_op_pull_source_state);
-	NTSTATUS status;
-	struct drsuapi_DsGetNCChanges *r = talloc_get_type(state->ndr_struct_ptr,
-					   struct drsuapi_DsGetNCChanges);
+	struct drsuapi_DsGetNCChanges *r = state->apply_r;
+	bool ok;
+
+	ok = tevent_wakeup_recv(subreq);
+	TALLOC_FREE(subreq);
+	state->apply_r = NULL;
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
+		return;
+	}
+
+	dreplsrv_op_pull_source_apply(req, r,
+				      state->apply_ctr_level,
+				      state->apply_ctr1,
+				      state->apply_ctr6);
+}
+
+static void dreplsrv_op_pull_source_changes_received(struct tevent_req *req,
+						     struct drsuapi_DsGetNCChanges *r,
+						     NTSTATUS status)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
 	uint32_t ctr_level = 0;
 	struct drsuapi_DsGetNCChangesCtr1 *ctr1 = NULL;
 	struct drsuapi_DsGetNCChangesCtr6 *ctr6 = NULL;
 	enum drsuapi_DsExtendedError extended_ret = DRSUAPI_EXOP_ERR_NONE;
-	state->ndr_struct_ptr = NULL;
+	struct tevent_req *subreq = NULL;
+	bool more_data = false;
 
-	status = dcerpc_drsuapi_DsGetNCChanges_r_recv(subreq, r);
-	TALLOC_FREE(subreq);
 	if (tevent_req_nterror(req, status)) {
 		return;
 	}
@@ -713,6 +994,10 @@ static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 		   r->out.ctr->ctr2.mszip1.ts) {
 		ctr_level = 1;
 		ctr1 = &r->out.ctr->ctr2.mszip1.ts->ctr1;
+		state->stats.compressed_bytes +=
+			r->out.ctr->ctr2.mszip1.compressed_length;
+		state->stats.decompressed_bytes +=
+			r->out.ctr->ctr2.mszip1.decompressed_length;
 	} else if (*r->out.level_out == 6) {
 		ctr_level = 6;
 		ctr6 = &r->out.ctr->ctr6;
@@ -722,12 +1007,20 @@ static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 		   r->out.ctr->ctr7.ctr.mszip6.ts) {
 		ctr_level = 6;
 		ctr6 = &r->out.ctr->ctr7.ctr.mszip6.ts->ctr6;
+		state->stats.compressed_bytes +=
+			r->out.ctr->ctr7.ctr.mszip6.compressed_length;
+		state->stats.decompressed_bytes +=
+			r->out.ctr->ctr7.ctr.mszip6.decompressed_length;
 	} else if (*r->out.level_out == 7 &&
 		   r->out.ctr->ctr7.level == 6 &&
 		   r->out.ctr->ctr7.type == DRSUAPI_COMPRESSION_TYPE_XPRESS &&
 		   r->out.ctr->ctr7.ctr.xpress6.ts) {
 		ctr_level = 6;
 		ctr6 = &r->out.ctr->ctr7.ctr.xpress6.ts->ctr6;
+		state->stats.compressed_bytes +=
+			r->out.ctr->ctr7.ctr.xpress6.compressed_length;
+		state->stats.decompressed_bytes +=
+			r->out.ctr->ctr7.ctr.xpress6.decompressed_length;
 	} else {
 		status = werror_to_ntstatus(WERR_BAD_NET_RESP);
 		tevent_req_nterror(req, status);
@@ -747,11 +1040,17 @@ static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 			return;
 		}
 		extended_ret = ctr6->extended_ret;
+		more_data = ctr6->more_data;
+		state->stats.objects += ctr6->object_count;
+		state->stats.links += ctr6->linked_attributes_count;
 	}
 
 	if (ctr_level == 1) {
 		extended_ret = ctr1->extended_ret;
+		more_data = ctr1->more_data;
+		state->stats.objects += ctr1->object_count;
 	}
+	state->stats.chunks++;
 
 	if (state->op->extended_op != DRSUAPI_EXOP_NONE) {
 		state->op->extended_ret = extended_ret;
@@ -763,7 +1062,36 @@ static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 		}
 	}
 
-	dreplsrv_op_pull_source_apply_changes_trigger(req, r, ctr_level, ctr1, ctr6);
+	if (!more_data ||
+	    !state->op->service->pull.pipeline ||
+	    state->op->extended_op != DRSUAPI_EXOP_NONE) {
+		dreplsrv_op_pull_source_apply(req, r, ctr_level, ctr1, ctr6);
+		return;
+	}
+
+	if (!dreplsrv_op_pull_source_prefetch(req, ctr_level, ctr1, ctr6)) {
+		if (!tevent_req_is_in_progress(req)) {
+			return;
+		}
+		dreplsrv_op_pull_source_apply(req, r, ctr_level, ctr1, ctr6);
+		return;
+	}
+
+	/*
+	 * The request is only written once we return to the event
+	 * loop, so apply this chunk from a timer, which runs after
+	 * that
+	 */
+	state->apply_r = r;
+	state->apply_ctr_level = ctr_level;
+	state->apply_ctr1 = ctr1;
+	state->apply_ctr6 = ctr6;
+
+	subreq = tevent_wakeup_send(state, state->ev, timeval_current());
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, dreplsrv_op_pull_source_apply_wakeup, req);
 }
 
 /**
@@ -952,7 +1280,9 @@ static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req
 			/* we don't need this structure anymore */
 			TALLOC_FREE(r);
 
-			dreplsrv_op_pull_source_get_changes_trigger(req);
+			if (!dreplsrv_op_pull_source_prefetched(state)) {
+				dreplsrv_op_pull_source_get_changes_trigger(req);
+			}
 			return;
 		}
 
@@ -1195,10 +1525,14 @@ static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req
 	TALLOC_FREE(r);
 
 	if (more_data) {
-		dreplsrv_op_pull_source_get_changes_trigger(req);
+		if (!dreplsrv_op_pull_source_prefetched(state)) {
+			dreplsrv_op_pull_source_get_changes_trigger(req);
+		}
 		return;
 	}
 
+	dreplsrv_op_pull_source_report(state);
+
 	/*
 	 * If we had to divert via doing some other thing, such as
 	 * pulling the schema, then go back and do the original
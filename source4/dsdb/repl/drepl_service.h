@@ -215,6 +215,22 @@ struct dreplsrv_service {
 		struct tevent_timer *te;
 	} notify;
 
+	/* options for outgoing DsGetNCChanges() calls */
+	struct {
+		/*
+		 * request the next chunk of changes while the
+		 * current one is applied
+		 */
+		bool pipeline;
+
+		/*
+		 * ask for compressed replies, if the source DSA
+		 * supports them ("dreplsrv:compress_pull", off by
+		 * default as Samba itself never sends them)
+		 */
+		bool compression;
+	} pull;
+
 	/*
 	 * the list of partitions we need to replicate
 	 */
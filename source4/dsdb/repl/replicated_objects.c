@@ -837,6 +837,9 @@ WERROR dsdb_replicated_objects_commit(struct ldb_context *ldb,
 	int ret;
 	uint64_t seq_num1, seq_num2;
 	bool used_global_schema = false;
+	/* how long each phase of the commit takes, for the debug log */
+	struct timeval t_start = timeval_current();
+	struct timeval t_applied, t_checked, t_prepared;
 
 	TALLOC_CTX *tmp_ctx = talloc_new(objects);
 	if (!tmp_ctx) {
@@ -912,6 +915,7 @@ WERROR dsdb_replicated_objects_commit(struct ldb_context *ldb,
 		return WERR_FOOBAR;
 	}
 	talloc_free(ext_res);
+	t_applied = timeval_current();
 
 	/* Save our updated prefixMap and check the schema is good. */
 	if (working_schema) {
@@ -964,6 +968,12 @@ WERROR dsdb_replicated_objects_commit(struct ldb_context *ldb,
 		}
 	}
 
+	t_checked = timeval_current();
+
+	/*
+	 * This applies the linked attributes and writes out the
+	 * index records changed by the whole chunk
+	 */
 	ret = ldb_transaction_prepare_commit(ldb);
 	if (ret != LDB_SUCCESS) {
 		/* restore previous schema */
@@ -978,6 +988,7 @@ WERROR dsdb_replicated_objects_commit(struct ldb_context *ldb,
 		TALLOC_FREE(tmp_ctx);
 		return WERR_FOOBAR;
 	}
+	t_prepared = timeval_current();
 
 	ret = dsdb_load_partition_usn(ldb, objects->partition_dn, &seq_num2, NULL);
 	if (ret != LDB_SUCCESS) {
@@ -1058,6 +1069,14 @@ WERROR dsdb_replicated_objects_commit(struct ldb_context *ldb,
 	DEBUG(2,("Replicated %u objects (%u linked attributes) for %s\n",
 		 objects->num_objects, objects->linked_attributes_count,
 		 ldb_dn_get_linearized(objects->partition_dn)));
+	DEBUG(4,("Replication commit took %.3fs: apply objects %.3fs, "
+		 "schema check %.3fs, apply links and indexes %.3fs, "
+		 "commit %.3fs\n",
+		 timeval_elapsed(&t_start),
+		 timeval_elapsed2(&t_start, &t_applied),
+		 timeval_elapsed2(&t_applied, &t_checked),
+		 timeval_elapsed2(&t_checked, &t_prepared),
+		 timeval_elapsed(&t_prepared)));
 		 
 	TALLOC_FREE(tmp_ctx);
 	return WERR_OK;
@@ -53,14 +53,68 @@ struct aclread_context {
 	/* cache on the last parent we checked in this search */
 	struct ldb_dn *last_parent_dn;
 	int last_parent_check_ret;
+
+	/* cache of the attribute access checks made in this search */
+	struct aclread_decision *decisions;
+	uint64_t decision_hits;
+	uint64_t decision_misses;
+	uint64_t sd_hits;
+	uint64_t sd_misses;
+};
+
+/*
+ * A parsed security descriptor, kept so that objects sharing the same
+ * nTSecurityDescriptor (most of them) are only parsed once.
+ */
+struct aclread_sd {
+	/* unique for as long as the module is loaded, 0 for unused slots */
+	uint64_t id;
+	uint32_t hash;
+	struct ldb_val blob;
+	struct security_descriptor *sd;
+	/* does the DACL have an ACE for PRINCIPAL_SELF? */
+	bool has_self_ace;
+};
+
+#define ACLREAD_SD_CACHE_SIZE 256
+
+/*
+ * Does the objectSid of the object matter to the access check, and if
+ * so, is it in the token of the connected user?
+ */
+enum aclread_self {
+	ACLREAD_SELF_NONE = 0,
+	ACLREAD_SELF_IN_TOKEN,
+	ACLREAD_SELF_NOT_IN_TOKEN,
 };
 
+/*
+ * The result of an attribute access check.
+ *
+ * Given the (constant) token of the search, the result of
+ * acl_check_access_on_attribute() only depends on the SD, the
+ * structural objectclass, the attribute and the access mask, as well
+ * as on the objectSid of the object if the SD grants or denies access
+ * to PRINCIPAL_SELF.
+ */
+struct aclread_decision {
+	uint64_t sd_id;
+	const struct dsdb_class *objectclass;
+	const struct dsdb_attribute *attr;
+	uint32_t access_mask;
+	enum aclread_self self;
+	int ret;
+};
+
+#define ACLREAD_DECISION_CACHE_SIZE 512
+
 struct aclread_private {
 	bool enabled;
 
-	/* cache of the last SD we read during any search */
-	struct security_descriptor *sd_cached;
-	struct ldb_val sd_cached_blob;
+	/* cache of the SDs we read during any search */
+	struct aclread_sd *sd_cache;
+	unsigned int sd_cache_next;
+	uint64_t sd_next_id;
 };
 
 static void aclread_mark_inaccesslible(struct ldb_message_element *el) {
@@ -152,6 +206,36 @@ static int aclread_check_parent(struct aclread_context *ac,
 	return ret;
 }
 
+static uint32_t aclread_sd_hash(const struct ldb_val *blob)
+{
+	uint32_t hash = 5381;
+	size_t i;
+
+	for (i = 0; i < blob->length; i++) {
+		hash = ((hash << 5) + hash) + blob->data[i];
+	}
+	return hash;
+}
+
+static bool aclread_sd_has_self_ace(const struct security_descriptor *sd)
+{
+	struct dom_sid self_sid;
+	uint32_t i;
+
+	if (sd->dacl == NULL) {
+		return false;
+	}
+
+	dom_sid_parse(SID_NT_SELF, &self_sid);
+
+	for (i = 0; i < sd->dacl->num_aces; i++) {
+		if (dom_sid_equal(&sd->dacl->aces[i].trustee, &self_sid)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * The sd returned from this function is valid until the next call on
  * this module context
@@ -162,14 +246,19 @@ static int aclread_check_parent(struct aclread_context *ac,
 
 static int aclread_get_sd_from_ldb_message(struct aclread_context *ac,
 					   struct ldb_message *acl_res,
-					   struct security_descriptor **sd)
+					   struct aclread_sd **sd)
 {
 	struct ldb_message_element *sd_element;
 	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
 	struct aclread_private *private_data
 		= talloc_get_type(ldb_module_get_private(ac->module),
 				  struct aclread_private);
+	struct aclread_sd *entry = NULL;
+	struct security_descriptor *new_sd = NULL;
+	struct ldb_val blob;
 	enum ndr_err_code ndr_err;
+	uint32_t hash;
+	unsigned int i;
 
 	sd_element = ldb_msg_find_element(acl_res, "nTSecurityDescriptor");
 	if (sd_element == NULL) {
@@ -183,49 +272,152 @@ static int aclread_get_sd_from_ldb_message(struct aclread_context *ac,
 
 	/*
 	 * The time spent in ndr_pull_security_descriptor() is quite
-	 * expensive, so we check if this is the same binary blob as last
-	 * time, and if so return the memory tree from that previous parse.
+	 * expensive, and most objects share one of a few hundred
+	 * SDs, so we check if this is the same binary blob as one we
+	 * have already parsed, and if so return the memory tree from
+	 * that previous parse.
 	 */
 
-	if (private_data->sd_cached != NULL &&
-	    private_data->sd_cached_blob.data != NULL &&
-	    ldb_val_equal_exact(&sd_element->values[0],
-				&private_data->sd_cached_blob)) {
-		*sd = private_data->sd_cached;
-		return LDB_SUCCESS;
+	if (private_data->sd_cache == NULL) {
+		private_data->sd_cache = talloc_zero_array(private_data,
+							   struct aclread_sd,
+							   ACLREAD_SD_CACHE_SIZE);
+		if (private_data->sd_cache == NULL) {
+			return ldb_oom(ldb);
+		}
+	}
+
+	hash = aclread_sd_hash(&sd_element->values[0]);
+
+	for (i = 0; i < ACLREAD_SD_CACHE_SIZE; i++) {
+		entry = &private_data->sd_cache[i];
+		if (entry->id != 0 &&
+		    entry->hash == hash &&
+		    ldb_val_equal_exact(&sd_element->values[0],
+					&entry->blob)) {
+			ac->sd_hits++;
+			*sd = entry;
+			return LDB_SUCCESS;
+		}
 	}
+	ac->sd_misses++;
 
-	*sd = talloc(private_data, struct security_descriptor);
-	if(!*sd) {
+	new_sd = talloc(private_data, struct security_descriptor);
+	if (new_sd == NULL) {
 		return ldb_oom(ldb);
 	}
-	ndr_err = ndr_pull_struct_blob(&sd_element->values[0], *sd, *sd,
+	ndr_err = ndr_pull_struct_blob(&sd_element->values[0], new_sd, new_sd,
 			     (ndr_pull_flags_fn_t)ndr_pull_security_descriptor);
 
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
-		TALLOC_FREE(*sd);
+		TALLOC_FREE(new_sd);
 		return ldb_operr(ldb);
 	}
 
-	talloc_unlink(private_data, private_data->sd_cached_blob.data);
 	if (ac->added_nTSecurityDescriptor) {
-		private_data->sd_cached_blob = sd_element->values[0];
+		blob = sd_element->values[0];
 		talloc_steal(private_data, sd_element->values[0].data);
 	} else {
-		private_data->sd_cached_blob = ldb_val_dup(private_data,
-							   &sd_element->values[0]);
-		if (private_data->sd_cached_blob.data == NULL) {
-			TALLOC_FREE(*sd);
+		blob = ldb_val_dup(private_data, &sd_element->values[0]);
+		if (blob.data == NULL) {
+			TALLOC_FREE(new_sd);
 			return ldb_operr(ldb);
 		}
 	}
 
-	talloc_unlink(private_data, private_data->sd_cached);
-	private_data->sd_cached = *sd;
+	/* replace the entries in turn once the cache is full */
+	entry = &private_data->sd_cache[private_data->sd_cache_next];
+	private_data->sd_cache_next = (private_data->sd_cache_next + 1)
+		% ACLREAD_SD_CACHE_SIZE;
 
+	talloc_unlink(private_data, entry->blob.data);
+	talloc_unlink(private_data, entry->sd);
+
+	*entry = (struct aclread_sd) {
+		.id = ++private_data->sd_next_id,
+		.hash = hash,
+		.blob = blob,
+		.sd = new_sd,
+		.has_self_ace = aclread_sd_has_self_ace(new_sd),
+	};
+
+	*sd = entry;
 	return LDB_SUCCESS;
 }
 
+/*
+ * As acl_check_access_on_attribute(), but remembering the result for
+ * the rest of the search.
+ *
+ * The cache is valid for the whole search as the token of the
+ * connected user and the schema don't change during it, and the SD is
+ * identified by an id that is never reused.
+ */
+static int aclread_check_access_on_attribute(struct aclread_context *ac,
+					     TALLOC_CTX *mem_ctx,
+					     struct aclread_sd *sd,
+					     struct dom_sid *sid,
+					     uint32_t access_mask,
+					     const struct dsdb_attribute *attr,
+					     const struct dsdb_class *objectclass)
+{
+	struct aclread_decision *decision = NULL;
+	enum aclread_self self = ACLREAD_SELF_NONE;
+	uintptr_t slot;
+	int ret;
+
+	if (sd->has_self_ace && sid != NULL) {
+		struct security_token *token = acl_user_token(ac->module);
+
+		if (security_token_has_sid(token, sid)) {
+			self = ACLREAD_SELF_IN_TOKEN;
+		} else {
+			self = ACLREAD_SELF_NOT_IN_TOKEN;
+		}
+	}
+
+	if (ac->decisions == NULL) {
+		ac->decisions = talloc_zero_array(ac,
+						  struct aclread_decision,
+						  ACLREAD_DECISION_CACHE_SIZE);
+		if (ac->decisions == NULL) {
+			return ldb_oom(ldb_module_get_ctx(ac->module));
+		}
+	}
+
+	slot = (uintptr_t)attr ^ ((uintptr_t)objectclass >> 4)
+		^ (uintptr_t)sd->id ^ access_mask ^ self;
+	slot = (slot ^ (slot >> 9)) % ACLREAD_DECISION_CACHE_SIZE;
+	decision = &ac->decisions[slot];
+
+	if (decision->sd_id == sd->id &&
+	    decision->objectclass == objectclass &&
+	    decision->attr == attr &&
+	    decision->access_mask == access_mask &&
+	    decision->self == self) {
+		ac->decision_hits++;
+		return decision->ret;
+	}
+	ac->decision_misses++;
+
+	ret = acl_check_access_on_attribute(ac->module, mem_ctx, sd->sd, sid,
+					    access_mask, attr, objectclass);
+	if (ret != LDB_SUCCESS && ret != LDB_ERR_INSUFFICIENT_ACCESS_RIGHTS) {
+		return ret;
+	}
+
+	*decision = (struct aclread_decision) {
+		.sd_id = sd->id,
+		.objectclass = objectclass,
+		.attr = attr,
+		.access_mask = access_mask,
+		.self = self,
+		.ret = ret,
+	};
+
+	return ret;
+}
+
 /*
  * Returns the access mask required to read a given attribute
  */
@@ -267,7 +459,7 @@ struct parse_tree_aclread_ctx {
 	TALLOC_CTX *mem_ctx;
 	struct dom_sid *sid;
 	struct ldb_dn *dn;
-	struct security_descriptor *sd;
+	struct aclread_sd *sd;
 	const struct dsdb_class *objectclass;
 	bool suppress_result;
 };
@@ -277,7 +469,7 @@ struct parse_tree_aclread_ctx {
  */
 static int check_attr_access_rights(TALLOC_CTX *mem_ctx, const char *attr_name,
 				    struct aclread_context *ac,
-				    struct security_descriptor *sd,
+				    struct aclread_sd *sd,
 				    const struct dsdb_class *objectclass,
 				    struct dom_sid *sid, struct ldb_dn *dn)
 {
@@ -305,8 +497,8 @@ static int check_attr_access_rights(TALLOC_CTX *mem_ctx, const char *attr_name,
 		return LDB_SUCCESS;
 	}
 
-	ret = acl_check_access_on_attribute(ac->module, mem_ctx, sd, sid,
-					    access_mask, attr, objectclass);
+	ret = aclread_check_access_on_attribute(ac, mem_ctx, sd, sid,
+						access_mask, attr, objectclass);
 
 	if (ret == LDB_ERR_INSUFFICIENT_ACCESS_RIGHTS) {
 		return ret;
@@ -427,7 +619,7 @@ static int parse_tree_check_attr_access(struct ldb_parse_tree *tree,
  */
 static int check_search_ops_access(struct aclread_context *ac,
 				   TALLOC_CTX *mem_ctx,
-				   struct security_descriptor *sd,
+				   struct aclread_sd *sd,
 				   const struct dsdb_class *objectclass,
 				   struct dom_sid *sid, struct ldb_dn *dn,
 				   bool *suppress_result)
@@ -461,7 +653,7 @@ static int aclread_callback(struct ldb_request *req, struct ldb_reply *ares)
 	int ret;
 	size_t num_of_attrs = 0;
 	unsigned int i, k = 0;
-	struct security_descriptor *sd = NULL;
+	struct aclread_sd *sd = NULL;
 	struct dom_sid *sid = NULL;
 	TALLOC_CTX *tmp_ctx;
 	uint32_t instanceType;
@@ -576,13 +768,13 @@ static int aclread_callback(struct ldb_request *req, struct ldb_reply *ares)
 				continue;
 			}
 
-			ret = acl_check_access_on_attribute(ac->module,
-							    tmp_ctx,
-							    sd,
-							    sid,
-							    access_mask,
-							    attr,
-							    objectclass);
+			ret = aclread_check_access_on_attribute(ac,
+								tmp_ctx,
+								sd,
+								sid,
+								access_mask,
+								attr,
+								objectclass);
 
 			/*
 			 * Dirsync control needs the replpropertymetadata attribute
@@ -699,6 +891,13 @@ static int aclread_callback(struct ldb_request *req, struct ldb_reply *ares)
 	case LDB_REPLY_REFERRAL:
 		return ldb_module_send_referral(ac->req, ares->referral);
 	case LDB_REPLY_DONE:
+		DBG_DEBUG("%llu of %llu descriptors and %llu of %llu "
+			  "attribute checks were cached\n",
+			  (unsigned long long)ac->sd_hits,
+			  (unsigned long long)(ac->sd_hits + ac->sd_misses),
+			  (unsigned long long)ac->decision_hits,
+			  (unsigned long long)(ac->decision_hits +
+					       ac->decision_misses));
 		return ldb_module_done(ac->req, ares->controls,
 					ares->response, LDB_SUCCESS);
 
@@ -124,6 +124,13 @@ struct replmd_replicated_request {
 	uint32_t index_current;
 	struct dsdb_extended_replicated_objects *objs;
 
+	/*
+	 * Set for the objects in objs that replmd_replicated_prefetch()
+	 * found don't exist locally, so replmd_replicated_apply_next()
+	 * can go straight to adding them.  NULL if not known.
+	 */
+	bool *is_new_object;
+
 	struct ldb_message *search_msg;
 	struct GUID local_parent_guid;
 
@@ -3286,11 +3293,13 @@ static int replmd_modify_handle_linked_attribs(struct ldb_module *module,
 					       time_t t,
 					       struct ldb_request *parent)
 {
-	struct ldb_result *res;
+	struct ldb_result *res = NULL;
 	unsigned int i;
-	int ret;
+	unsigned int num_attrs = 0;
+	int ret = LDB_SUCCESS;
 	struct ldb_context *ldb = ldb_module_get_ctx(module);
-	struct ldb_message *old_msg;
+	struct ldb_message *old_msg = NULL;
+	const char **attrs = NULL;
 
 	if (dsdb_functional_level(ldb) == DS_DOMAIN_FUNCTION_2000) {
 		/*
@@ -3307,26 +3316,43 @@ static int replmd_modify_handle_linked_attribs(struct ldb_module *module,
 	}
 
 	/*
-	 * TODO:
-	 *
-	 * We should restrict this to the intersection of the list of
-	 * linked attributes in the schema and the list of attributes
-	 * being modified.
-	 *
-	 * This will help performance a little, as otherwise we have
-	 * to allocate the entire object value-by-value.
+	 * Only fetch the forward links being modified, rather than
+	 * allocating the entire object value-by-value.  This matters
+	 * for a big group, where a member change should not have to
+	 * unpack every other linked attribute on the object as well.
 	 */
-	ret = dsdb_module_search_dn(module, msg, &res, msg->dn, NULL,
-	                            DSDB_FLAG_NEXT_MODULE |
-	                            DSDB_SEARCH_SHOW_RECYCLED |
-				    DSDB_SEARCH_REVEAL_INTERNALS |
-				    DSDB_SEARCH_SHOW_DN_IN_STORAGE_FORMAT,
-				    parent);
-	if (ret != LDB_SUCCESS) {
-		return ret;
+	attrs = talloc_array(msg, const char *, msg->num_elements + 1);
+	if (attrs == NULL) {
+		return ldb_module_oom(module);
+	}
+	for (i=0; i<msg->num_elements; i++) {
+		const struct dsdb_attribute *schema_attr
+			= dsdb_attribute_by_lDAPDisplayName(ac->schema,
+							    msg->elements[i].name);
+		if (schema_attr == NULL ||
+		    schema_attr->linkID == 0 ||
+		    (schema_attr->linkID & 1) == 1) {
+			continue;
+		}
+		attrs[num_attrs++] = msg->elements[i].name;
 	}
+	attrs[num_attrs] = NULL;
 
-	old_msg = res->msgs[0];
+	/* No forward links are being changed, so nothing to look up */
+	if (num_attrs > 0) {
+		ret = dsdb_module_search_dn(module, msg, &res, msg->dn, attrs,
+					    DSDB_FLAG_NEXT_MODULE |
+					    DSDB_SEARCH_SHOW_RECYCLED |
+					    DSDB_SEARCH_REVEAL_INTERNALS |
+					    DSDB_SEARCH_SHOW_DN_IN_STORAGE_FORMAT,
+					    parent);
+		if (ret != LDB_SUCCESS) {
+			talloc_free(attrs);
+			return ret;
+		}
+
+		old_msg = res->msgs[0];
+	}
 
 	for (i=0; i<msg->num_elements; i++) {
 		struct ldb_message_element *el = &msg->elements[i];
@@ -3430,6 +3456,7 @@ static int replmd_modify_handle_linked_attribs(struct ldb_module *module,
 	}
 
 	talloc_free(res);
+	talloc_free(attrs);
 	return ret;
 }
 
@@ -6745,6 +6772,127 @@ static int replmd_store_linked_attributes(struct replmd_replicated_request *ar)
 
 static int replmd_replicated_uptodate_vector(struct replmd_replicated_request *ar);
 
+static int replmd_guid_cmp_v(const struct GUID *guid1, const struct GUID guid2)
+{
+	return GUID_compare(guid1, &guid2);
+}
+
+/*
+ * Find which of the objects in this chunk don't exist locally yet,
+ * with one search for the whole chunk rather than one per object.
+ *
+ * In an initial replication almost every object is new, and this
+ * saves looking each of them up again as it is applied.  An object
+ * that appears more than once in the chunk is always looked up, as
+ * the first copy applied will create it.
+ */
+static void replmd_replicated_prefetch(struct replmd_replicated_request *ar)
+{
+	struct ldb_module *module = ar->module;
+	struct dsdb_extended_replicated_objects *objs = ar->objs;
+	static const char *attrs[] = { "objectGUID", NULL };
+	TALLOC_CTX *tmp_ctx = NULL;
+	struct ldb_result *res = NULL;
+	struct GUID *existing = NULL;
+	struct GUID *chunk = NULL;
+	struct GUID_txt_buf guid_str_buf;
+	char *filter = NULL;
+	uint32_t i;
+	int ret;
+
+	if (objs->num_objects < 2) {
+		return;
+	}
+
+	tmp_ctx = talloc_new(ar);
+	if (tmp_ctx == NULL) {
+		return;
+	}
+
+	chunk = talloc_array(tmp_ctx, struct GUID, objs->num_objects);
+	filter = talloc_strdup(tmp_ctx, "(|");
+	if (chunk == NULL || filter == NULL) {
+		TALLOC_FREE(tmp_ctx);
+		return;
+	}
+
+	for (i = 0; i < objs->num_objects; i++) {
+		chunk[i] = objs->objects[i].object_guid;
+		filter = talloc_asprintf_append_buffer(
+			filter, "(objectGUID=%s)",
+			GUID_buf_string(&chunk[i], &guid_str_buf));
+		if (filter == NULL) {
+			TALLOC_FREE(tmp_ctx);
+			return;
+		}
+	}
+	filter = talloc_strdup_append_buffer(filter, ")");
+	if (filter == NULL) {
+		TALLOC_FREE(tmp_ctx);
+		return;
+	}
+
+	/* the same search replmd_replicated_apply_next() would do */
+	ret = dsdb_module_search(module, tmp_ctx, &res,
+				 objs->partition_dn, LDB_SCOPE_SUBTREE,
+				 attrs,
+				 DSDB_FLAG_NEXT_MODULE |
+				 DSDB_SEARCH_SHOW_RECYCLED,
+				 ar->req,
+				 "%s", filter);
+	if (ret != LDB_SUCCESS) {
+		/* just look up each object as it is applied */
+		DBG_INFO("Failed to prefetch %u replicated objects: %s\n",
+			 objs->num_objects, ldb_strerror(ret));
+		TALLOC_FREE(tmp_ctx);
+		return;
+	}
+
+	existing = talloc_array(tmp_ctx, struct GUID, res->count);
+	ar->is_new_object = talloc_zero_array(ar, bool, objs->num_objects);
+	if (existing == NULL || ar->is_new_object == NULL) {
+		TALLOC_FREE(ar->is_new_object);
+		TALLOC_FREE(tmp_ctx);
+		return;
+	}
+	for (i = 0; i < res->count; i++) {
+		existing[i] = samdb_result_guid(res->msgs[i], "objectGUID");
+	}
+
+	TYPESAFE_QSORT(existing, res->count, GUID_compare);
+	TYPESAFE_QSORT(chunk, objs->num_objects, GUID_compare);
+
+	for (i = 0; i < objs->num_objects; i++) {
+		const struct GUID *guid = &objs->objects[i].object_guid;
+		struct GUID *found = NULL;
+		uint32_t idx;
+
+		BINARY_ARRAY_SEARCH_V(existing, res->count, guid,
+				      replmd_guid_cmp_v, found);
+		if (found != NULL) {
+			continue;
+		}
+
+		BINARY_ARRAY_SEARCH_V(chunk, objs->num_objects, guid,
+				      replmd_guid_cmp_v, found);
+		if (found == NULL) {
+			continue;
+		}
+		idx = found - chunk;
+		if (idx > 0 && GUID_equal(&chunk[idx - 1], guid)) {
+			continue;
+		}
+		if (idx + 1 < objs->num_objects &&
+		    GUID_equal(&chunk[idx + 1], guid)) {
+			continue;
+		}
+
+		ar->is_new_object[i] = true;
+	}
+
+	TALLOC_FREE(tmp_ctx);
+}
+
 static int replmd_replicated_apply_next(struct replmd_replicated_request *ar)
 {
 	struct ldb_context *ldb;
@@ -6778,6 +6926,17 @@ static int replmd_replicated_apply_next(struct replmd_replicated_request *ar)
 	ar->search_msg = NULL;
 	ar->isDeleted = false;
 
+	if (ar->is_new_object != NULL &&
+	    ar->is_new_object[ar->index_current]) {
+		/*
+		 * The object doesn't exist locally, so this is the
+		 * ADD case of replmd_replicated_apply_search_callback()
+		 */
+		ar->objs->objects[ar->index_current].local_parent_dn = NULL;
+		ar->objs->objects[ar->index_current].last_known_parent = NULL;
+		return replmd_replicated_apply_search_for_parent(ar);
+	}
+
 	tmp_str = GUID_buf_string(&ar->objs->objects[ar->index_current].object_guid,
 				  &guid_str_buf);
 
@@ -7352,6 +7511,8 @@ static int replmd_extended_replicated_objects(struct ldb_module *module, struct
 	ar->controls = req->controls;
 	req->controls = ctrls;
 
+	replmd_replicated_prefetch(ar);
+
 	return replmd_replicated_apply_next(ar);
 }
 
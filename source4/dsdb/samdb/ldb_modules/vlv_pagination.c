@@ -49,18 +49,55 @@
 
 #include "dsdb/common/util.h"
 #include "lib/util/binsearch.h"
+#include "lib/util/dlinklist.h"
 
 /* This is the number of concurrent searches per connection to cache. */
 #define VLV_N_SEARCHES 5
 
+/* This is the number of sorted views shared between connections. */
+#define VLV_N_SHARED_VIEWS 8
+
+/*
+ * The sorted result of a search, with the value of the sort attribute
+ * of each entry so that a greaterThanOrEqual target can be found
+ * without searching the database.
+ *
+ * A view is shared by the stores of every connection in the process
+ * that makes the same search as the same user, until the highest
+ * sequence number of the database changes.  Address book clients
+ * make the same sorted search over and over, each time with a new
+ * VLV context.
+ */
+struct vlv_view {
+	struct vlv_view *prev, *next;
+
+	/* NULL if the view can't be shared */
+	const char *key;
+	uint64_t seq_num;
+	time_t timestamp;
+	bool cached;
+	/* The stores using this view */
+	unsigned int users;
+
+	struct GUID *results;
+	/* values[i].data is NULL if results[i] has no sort attribute */
+	struct ldb_val *values;
+	size_t num_entries;
+	size_t result_array_size;
+
+	struct ldb_control **controls;
+};
+
+static struct vlv_view *vlv_views;
+static unsigned int vlv_n_views;
 
 struct results_store {
 	uint32_t contextId;
 	time_t timestamp;
 
+	struct vlv_view *view;
 	struct GUID *results;
 	size_t num_entries;
-	size_t result_array_size;
 
 	struct referral_store *first_ref;
 	struct referral_store *last_ref;
@@ -84,9 +121,106 @@ struct vlv_context {
 	struct results_store *store;
 	struct ldb_control **controls;
 	struct private_data *priv;
+	/* The key to share the view being built under, if any */
+	char *view_key;
+	uint64_t view_seq_num;
 };
 
 
+static void vlv_view_release(struct vlv_view *view)
+{
+	SMB_ASSERT(view->users > 0);
+	view->users--;
+	if (view->users == 0 && !view->cached) {
+		talloc_free(view);
+	}
+}
+
+static void vlv_view_uncache(struct vlv_view *view)
+{
+	DLIST_REMOVE(vlv_views, view);
+	vlv_n_views--;
+	view->cached = false;
+	if (view->users == 0) {
+		talloc_free(view);
+	}
+}
+
+/*
+  find a shared view, dropping it if the database has changed since
+  it was made
+ */
+static struct vlv_view *vlv_view_find(const char *key, uint64_t seq_num)
+{
+	struct vlv_view *view = NULL;
+
+	for (view = vlv_views; view != NULL; view = view->next) {
+		if (strcmp(view->key, key) == 0) {
+			break;
+		}
+	}
+	if (view == NULL) {
+		return NULL;
+	}
+	if (view->seq_num != seq_num) {
+		vlv_view_uncache(view);
+		return NULL;
+	}
+
+	view->timestamp = time(NULL);
+	return view;
+}
+
+static void vlv_view_cache(struct vlv_view *view,
+			   char *key,
+			   uint64_t seq_num)
+{
+	struct vlv_view *old = NULL;
+
+	old = vlv_view_find(key, seq_num);
+	if (old != NULL) {
+		vlv_view_uncache(old);
+	}
+
+	if (vlv_n_views >= VLV_N_SHARED_VIEWS) {
+		struct vlv_view *v = NULL;
+
+		old = vlv_views;
+		for (v = vlv_views; v != NULL; v = v->next) {
+			if (v->timestamp < old->timestamp) {
+				old = v;
+			}
+		}
+		vlv_view_uncache(old);
+	}
+
+	view->key = talloc_steal(view, key);
+	view->seq_num = seq_num;
+	view->timestamp = time(NULL);
+	view->cached = true;
+	DLIST_ADD(vlv_views, view);
+	vlv_n_views++;
+}
+
+static void results_store_set_view(struct results_store *store,
+				   struct vlv_view *view)
+{
+	store->view = view;
+	view->users++;
+	store->results = view->results;
+	store->num_entries = view->num_entries;
+	store->controls = view->controls;
+}
+
+static int results_store_destructor(struct results_store *store)
+{
+	if (store->view != NULL) {
+		vlv_view_release(store->view);
+		store->view = NULL;
+	}
+	return 0;
+}
+
 static struct results_store *new_store(struct private_data *priv)
 {
 	struct results_store *store;
@@ -112,6 +246,7 @@ static struct results_store *new_store(struct private_data *priv)
 	}
 	priv->store[best] = store;
 	store->timestamp = time(NULL);
+	talloc_set_destructor(store, results_store_destructor);
 	return store;
 }
 
@@ -119,9 +254,7 @@ static struct results_store *new_store(struct private_data *priv)
 struct vlv_sort_context {
 	struct ldb_context *ldb;
 	ldb_attr_comparison_t comparison_fn;
-	const char *attr;
 	struct vlv_context *ac;
-	int status;
 	struct ldb_val value;
 };
 
@@ -232,36 +365,27 @@ static int send_referrals(struct results_store *store,
 /* vlv_value_compare() is used in a binary search */
 
 static int vlv_value_compare(struct vlv_sort_context *target,
-			     struct GUID *guid)
+			     struct ldb_val *value)
 {
-	struct ldb_result *result = NULL;
-	struct ldb_message_element *el = NULL;
-	struct vlv_context *ac = target->ac;
-	int ret;
-	const char *attrs[2] = {
-		target->attr,
-		NULL
-	};
-
-	ret = vlv_search_by_dn_guid(ac->module, ac, &result, guid, attrs);
-
-	if (ret != LDB_SUCCESS) {
-		target->status = ret;
-		/* returning 0 ends the search. */
-		return 0;
+	if (value->data == NULL) {
+		/* entries without the attribute are sorted last */
+		return -1;
 	}
 
-	el = ldb_msg_find_element(result->msgs[0], target->attr);
-	return target->comparison_fn(target->ldb, ac,
-				     &target->value, &el->values[0]);
-
+	return target->comparison_fn(target->ldb, target->ac,
+				     &target->value, value);
 }
 
 /* The same as vlv_value_compare() but sorting in the opposite direction. */
 static int vlv_value_compare_rev(struct vlv_sort_context *target,
-			     struct GUID *guid)
+			     struct ldb_val *value)
 {
-	return -vlv_value_compare(target, guid);
+	if (value->data == NULL) {
+		/* these are still last when the sort is reversed */
+		return -1;
+	}
+
+	return -vlv_value_compare(target, value);
 }
 
 
@@ -272,15 +396,14 @@ static int vlv_value_compare_rev(struct vlv_sort_context *target,
    If the query value is greater than (or less than in the reverse case) all
    the items, An index just beyond the last position is used.
 
-   If an error occurs during the search for the index, we stash it in the
-   status argument.
+   The values of the sort attribute were kept when the search was made,
+   so this is a binary search in memory.
  */
 
 static int vlv_gt_eq_to_index(struct vlv_context *ac,
-			      struct GUID *guid_array,
+			      struct ldb_val *value_array,
 			      struct ldb_vlv_req_control *vlv_details,
-			      struct ldb_server_sort_control *sort_details,
-			      int *status)
+			      struct ldb_server_sort_control *sort_details)
 {
 	/* this has a >= comparison string, which needs to be
 	 * converted into indices.
@@ -288,7 +411,7 @@ static int vlv_gt_eq_to_index(struct vlv_context *ac,
 	size_t len = ac->store->num_entries;
 	struct ldb_context *ldb;
 	const struct ldb_schema_attribute *a;
-	struct GUID *result = NULL;
+	struct ldb_val *result = NULL;
 	struct vlv_sort_context context;
 	struct ldb_val value = {
 		.data = (uint8_t *)vlv_details->match.gtOrEq.value,
@@ -300,34 +423,27 @@ static int vlv_gt_eq_to_index(struct vlv_context *ac,
 	context = (struct vlv_sort_context){
 		.ldb = ldb,
 		.comparison_fn = a->syntax->comparison_fn,
-		.attr = sort_details->attributeName,
 		.ac = ac,
-		.status = LDB_SUCCESS,
 		.value = value
 	};
 
 	if (sort_details->reverse) {
 		/* when the sort is reversed, "gtOrEq" means
 		   "less than or equal" */
-		BINARY_ARRAY_SEARCH_GTE(guid_array, len, &context,
+		BINARY_ARRAY_SEARCH_GTE(value_array, len, &context,
 					vlv_value_compare_rev,
 					result, result);
 	} else {
-		BINARY_ARRAY_SEARCH_GTE(guid_array, len, &context,
+		BINARY_ARRAY_SEARCH_GTE(value_array, len, &context,
 					vlv_value_compare,
 					result, result);
 	}
-	if (context.status != LDB_SUCCESS) {
-		*status = context.status;
-		return len;
-	}
-	*status = LDB_SUCCESS;
 
 	if (result == NULL) {
 		/* the target is beyond the end of the array */
 		return len;
 	}
-	return result - guid_array;
+	return result - value_array;
 
 }
 
@@ -415,12 +531,9 @@ static int vlv_results(struct vlv_context *ac)
 
 	if (ac->store->num_entries != 0) {
 		if (vlv_details->type == 1) {
-			target = vlv_gt_eq_to_index(ac, ac->store->results,
+			target = vlv_gt_eq_to_index(ac, ac->store->view->values,
 						    vlv_details,
-						    sort_details, &ret);
-			if (ret != LDB_SUCCESS) {
-				return ret;
-			}
+						    sort_details);
 		} else {
 			target = vlv_calc_real_offset(vlv_details->match.byOffset.offset,
 						      vlv_details->match.byOffset.contentCount,
@@ -529,10 +642,13 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 {
 	struct vlv_context *ac;
 	struct results_store *store;
+	struct vlv_view *view;
+	struct ldb_message_element *el;
 	int ret;
 
 	ac = talloc_get_type(req->context, struct vlv_context);
 	store = ac->store;
+	view = store->view;
 
 	if (!ares) {
 		return ldb_module_done(ac->req, NULL, NULL,
@@ -545,28 +661,47 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 
 	switch (ares->type) {
 	case LDB_REPLY_ENTRY:
-		if (store->results == NULL) {
-			store->num_entries = 0;
-			store->result_array_size = 16;
-			store->results = talloc_array(store, struct GUID,
-						      store->result_array_size);
-			if (store->results == NULL) {
+		if (view->results == NULL) {
+			view->num_entries = 0;
+			view->result_array_size = 16;
+			view->results = talloc_array(view, struct GUID,
+						     view->result_array_size);
+			view->values = talloc_array(view, struct ldb_val,
+						    view->result_array_size);
+			if (view->results == NULL || view->values == NULL) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						       LDB_ERR_OPERATIONS_ERROR);
 			}
-		} else if (store->num_entries == store->result_array_size) {
-			store->result_array_size *= 2;
-			store->results = talloc_realloc(store, store->results,
-							struct GUID,
-							store->result_array_size);
-			if (store->results == NULL) {
+		} else if (view->num_entries == view->result_array_size) {
+			view->result_array_size *= 2;
+			view->results = talloc_realloc(view, view->results,
+						       struct GUID,
+						       view->result_array_size);
+			view->values = talloc_realloc(view, view->values,
+						      struct ldb_val,
+						      view->result_array_size);
+			if (view->results == NULL || view->values == NULL) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						       LDB_ERR_OPERATIONS_ERROR);
 			}
 		}
-		store->results[store->num_entries] = \
+		view->results[view->num_entries] = \
 			samdb_result_guid(ares->message, "objectGUID");
-		store->num_entries++;
+
+		el = ldb_msg_find_element(ares->message,
+					  store->sort_details->attributeName);
+		if (el != NULL && el->num_values > 0) {
+			view->values[view->num_entries] =
+				ldb_val_dup(view->values, &el->values[0]);
+			if (view->values[view->num_entries].data == NULL) {
+				return ldb_module_done(ac->req, NULL, NULL,
+						       LDB_ERR_OPERATIONS_ERROR);
+			}
+		} else {
+			view->values[view->num_entries] = data_blob_null;
+		}
+		view->num_entries++;
+		talloc_free(ares);
 		break;
 
 	case LDB_REPLY_REFERRAL:
@@ -577,18 +712,34 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 		break;
 
 	case LDB_REPLY_DONE:
-		if (store->num_entries != 0) {
-			store->results = talloc_realloc(store, store->results,
-							struct GUID,
-							store->num_entries);
-			if (store->results == NULL) {
+		if (view->num_entries != 0) {
+			view->results = talloc_realloc(view, view->results,
+						       struct GUID,
+						       view->num_entries);
+			view->values = talloc_realloc(view, view->values,
+						      struct ldb_val,
+						      view->num_entries);
+			if (view->results == NULL || view->values == NULL) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						       LDB_ERR_OPERATIONS_ERROR);
 			}
 		}
-		store->result_array_size = store->num_entries;
+		view->result_array_size = view->num_entries;
+
+		view->controls = talloc_move(view, &ares->controls);
+		store->results = view->results;
+		store->num_entries = view->num_entries;
+		store->controls = view->controls;
+
+		/*
+		 * Referrals are kept by the store, so a view with
+		 * them is not shared
+		 */
+		if (ac->view_key != NULL && store->first_ref == NULL) {
+			vlv_view_cache(view, ac->view_key, ac->view_seq_num);
+			ac->view_key = NULL;
+		}
 
-		ac->store->controls = talloc_move(ac->store, &ares->controls);
 		ret = vlv_results(ac);
 		return ldb_module_done(ac->req, ac->controls,
 					ares->response, ret);
@@ -693,6 +844,208 @@ vlv_copy_down_controls(TALLOC_CTX *mem_ctx, struct ldb_control **controls)
 	return new_controls;
 }
 
+/*
+  whether a view sorted or filtered on an attribute can be shared.
+
+  A shared view is used until the highest sequence number changes,
+  which writes to attributes that are not replicated (like lastLogon
+  or badPwdCount) don't do.  Constructed attributes change without
+  any write at all.
+ */
+static bool vlv_attr_shareable(const struct dsdb_schema *schema,
+			       const char *name)
+{
+	const struct dsdb_attribute *attr = NULL;
+
+	if (name == NULL) {
+		return false;
+	}
+
+	attr = dsdb_attribute_by_lDAPDisplayName(schema, name);
+	if (attr == NULL) {
+		return false;
+	}
+
+	if (attr->systemFlags & (DS_FLAG_ATTR_NOT_REPLICATED |
+				 DS_FLAG_ATTR_IS_CONSTRUCTED)) {
+		return false;
+	}
+
+	return true;
+}
+
+static int vlv_tree_shareable(struct ldb_parse_tree *tree,
+			      void *private_context)
+{
+	const struct dsdb_schema *schema =
+		(const struct dsdb_schema *)private_context;
+	const char *attr = NULL;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+	case LDB_OP_NOT:
+		return LDB_SUCCESS;
+	case LDB_OP_EQUALITY:
+		attr = tree->u.equality.attr;
+		break;
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		attr = tree->u.comparison.attr;
+		break;
+	case LDB_OP_SUBSTRING:
+		attr = tree->u.substring.attr;
+		break;
+	case LDB_OP_PRESENT:
+		attr = tree->u.present.attr;
+		break;
+	case LDB_OP_EXTENDED:
+		attr = tree->u.extended.attr;
+		break;
+	}
+
+	if (!vlv_attr_shareable(schema, attr)) {
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  the key a sorted view is shared under, or NULL if this search can't
+  share one.
+
+  The entries a search returns depend on the database, the base,
+  scope, filter and sort, the controls and the rights of the user.
+ */
+static char *vlv_view_key(TALLOC_CTX *mem_ctx,
+			  struct ldb_module *module,
+			  struct ldb_request *req,
+			  struct ldb_server_sort_control *sort_ctrl)
+{
+	/* Controls that don't change which entries are returned */
+	static const char * const shareable_oids[] = {
+		DSDB_CONTROL_NO_GLOBAL_CATALOG,
+		LDB_CONTROL_EXTENDED_DN_OID,
+		LDB_CONTROL_DOMAIN_SCOPE_OID,
+		LDB_CONTROL_SHOW_DELETED_OID,
+		LDB_CONTROL_SHOW_RECYCLED_OID,
+	};
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct auth_session_info *session_info = NULL;
+	const struct dsdb_schema *schema = NULL;
+	const struct GUID *invocation_id = NULL;
+	struct GUID_txt_buf guid_buf;
+	char *filter = NULL;
+	char *key = NULL;
+	unsigned int i, j;
+	int ret;
+
+	invocation_id = samdb_ntds_invocation_id(ldb);
+	if (invocation_id == NULL) {
+		return NULL;
+	}
+
+	schema = dsdb_get_schema(ldb, NULL);
+	if (schema == NULL) {
+		return NULL;
+	}
+	if (!vlv_attr_shareable(schema, sort_ctrl->attributeName)) {
+		return NULL;
+	}
+	ret = ldb_parse_tree_walk(req->op.search.tree,
+				  vlv_tree_shareable,
+				  discard_const_p(struct dsdb_schema, schema));
+	if (ret != LDB_SUCCESS) {
+		return NULL;
+	}
+
+	filter = ldb_filter_from_tree(mem_ctx, req->op.search.tree);
+	if (filter == NULL) {
+		return NULL;
+	}
+
+	key = talloc_asprintf(mem_ctx, "%s;%s;%d;%s;%s;%s;%d",
+			      GUID_buf_string(invocation_id, &guid_buf),
+			      ldb_dn_get_casefold(req->op.search.base),
+			      req->op.search.scope,
+			      filter,
+			      sort_ctrl->attributeName,
+			      sort_ctrl->orderingRule ?
+			      sort_ctrl->orderingRule : "",
+			      sort_ctrl->reverse);
+	TALLOC_FREE(filter);
+	if (key == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; req->controls != NULL && req->controls[i] != NULL; i++) {
+		struct ldb_control *control = req->controls[i];
+
+		if (control->oid == NULL) {
+			break;
+		}
+		if (strcmp(control->oid, LDB_CONTROL_VLV_REQ_OID) == 0 ||
+		    strcmp(control->oid, LDB_CONTROL_SERVER_SORT_OID) == 0) {
+			continue;
+		}
+		if (strcmp(control->oid, LDB_CONTROL_SEARCH_OPTIONS_OID) == 0) {
+			struct ldb_search_options_control *options =
+				talloc_get_type(control->data,
+				struct ldb_search_options_control);
+			if (options == NULL) {
+				TALLOC_FREE(key);
+				return NULL;
+			}
+			key = talloc_asprintf_append_buffer(
+				key, ";%s:%u", control->oid,
+				options->search_options);
+			if (key == NULL) {
+				return NULL;
+			}
+			continue;
+		}
+
+		for (j = 0; j < ARRAY_SIZE(shareable_oids); j++) {
+			if (strcmp(control->oid, shareable_oids[j]) == 0) {
+				break;
+			}
+		}
+		if (j == ARRAY_SIZE(shareable_oids)) {
+			TALLOC_FREE(key);
+			return NULL;
+		}
+		key = talloc_asprintf_append_buffer(key, ";%s", control->oid);
+		if (key == NULL) {
+			return NULL;
+		}
+	}
+
+	session_info = (struct auth_session_info *)ldb_get_opaque(
+		ldb, DSDB_SESSION_INFO);
+	if (session_info == NULL || session_info->security_token == NULL) {
+		return talloc_asprintf_append_buffer(key, ";system");
+	}
+
+	key = talloc_asprintf_append_buffer(
+		key, ";%"PRIx64";%"PRIx32,
+		session_info->security_token->privilege_mask,
+		session_info->security_token->rights_mask);
+	for (i = 0;
+	     key != NULL && i < session_info->security_token->num_sids;
+	     i++) {
+		struct dom_sid_buf sid_buf;
+
+		key = talloc_asprintf_append_buffer(
+			key, ";%s",
+			dom_sid_str_buf(&session_info->security_token->sids[i],
+					&sid_buf));
+	}
+
+	return key;
+}
+
 static int vlv_search(struct ldb_module *module, struct ldb_request *req)
 {
 	struct ldb_context *ldb;
@@ -748,9 +1101,8 @@ static int vlv_search(struct ldb_module *module, struct ldb_request *req)
 	 * saved search.
 	 */
 	if (vlv_ctrl->ctxid_len == 0) {
-		static const char * const attrs[2] = {
-			"objectGUID", NULL
-		};
+		const char **attrs = NULL;
+		struct vlv_view *view = NULL;
 
 		ac->store = new_store(priv);
 		if (ac->store == NULL) {
@@ -762,6 +1114,53 @@ static int vlv_search(struct ldb_module *module, struct ldb_request *req)
 			return ret;
 		}
 
+		/*
+		 * Use the sorted view of another connection if the
+		 * same search was made since the database last changed
+		 */
+		ac->view_key = vlv_view_key(ac, module, req, sort_ctrl[0]);
+		if (ac->view_key != NULL) {
+			ret = ldb_sequence_number(ldb, LDB_SEQ_HIGHEST_SEQ,
+						  &ac->view_seq_num);
+			if (ret != LDB_SUCCESS) {
+				TALLOC_FREE(ac->view_key);
+			}
+		}
+		if (ac->view_key != NULL) {
+			view = vlv_view_find(ac->view_key, ac->view_seq_num);
+		}
+		if (view != NULL) {
+			results_store_set_view(ac->store, view);
+
+			ac->store->down_controls = vlv_copy_down_controls(
+				ac->store, req->controls);
+			if (ac->store->down_controls == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+
+			ret = vlv_results(ac);
+			if (ret != LDB_SUCCESS) {
+				return ldb_module_done(req, NULL, NULL, ret);
+			}
+			return ldb_module_done(req, ac->controls, NULL,
+					       LDB_SUCCESS);
+		}
+
+		view = talloc_zero(NULL, struct vlv_view);
+		if (view == NULL) {
+			return ldb_oom(ldb);
+		}
+		results_store_set_view(ac->store, view);
+
+		/* The sort values are kept for greaterThanOrEqual targets */
+		attrs = talloc_array(ac, const char *, 3);
+		if (attrs == NULL) {
+			return ldb_oom(ldb);
+		}
+		attrs[0] = "objectGUID";
+		attrs[1] = ac->store->sort_details->attributeName;
+		attrs[2] = NULL;
+
 		ret = ldb_build_search_req_ex(&search_req, ldb, ac,
 					      req->op.search.base,
 					      req->op.search.scope,
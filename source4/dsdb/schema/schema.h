@@ -245,6 +245,17 @@ struct dsdb_schema {
 	uint32_t num_int_id_attr;
 	struct dsdb_attribute **attributes_by_msDS_IntId;
 
+	/*
+	 * open addressing hash tables of positions in the sorted
+	 * arrays above (plus one, so 0 marks an empty slot), for
+	 * lookups by name and OID without a binary search
+	 */
+	uint32_t classes_hash_size;
+	uint32_t *classes_by_lDAPDisplayName_hash;
+	uint32_t attributes_hash_size;
+	uint32_t *attributes_by_lDAPDisplayName_hash;
+	uint32_t *attributes_by_attributeID_oid_hash;
+
 	struct {
 		bool we_are_master;
 		bool update_allowed;
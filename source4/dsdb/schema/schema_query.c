@@ -54,6 +54,19 @@ static int strcasecmp_with_ldb_val(const struct ldb_val *target, const char *str
 	return ret;
 }
 
+/*
+  return the next position (plus one) in a chain of a name hash table,
+  or 0 at the end of the chain
+ */
+static uint32_t dsdb_name_hash_next(const uint32_t *table, uint32_t size,
+				    uint32_t *slot)
+{
+	uint32_t idx = table[*slot];
+
+	*slot = (*slot + 1) & (size - 1);
+	return idx;
+}
+
 const struct dsdb_attribute *dsdb_attribute_by_attributeID_id(const struct dsdb_schema *schema,
 							      uint32_t id)
 {
@@ -84,6 +97,21 @@ const struct dsdb_attribute *dsdb_attribute_by_attributeID_oid(const struct dsdb
 
 	if (!oid) return NULL;
 
+	if (schema->attributes_by_attributeID_oid_hash != NULL) {
+		uint32_t size = schema->attributes_hash_size;
+		uint32_t slot = dsdb_schema_name_hash(oid, strlen(oid)) & (size - 1);
+		uint32_t idx;
+
+		while ((idx = dsdb_name_hash_next(schema->attributes_by_attributeID_oid_hash,
+						  size, &slot)) != 0) {
+			c = schema->attributes_by_attributeID_oid[idx - 1];
+			if (strcasecmp(c->attributeID_oid, oid) == 0) {
+				return c;
+			}
+		}
+		return NULL;
+	}
+
 	BINARY_ARRAY_SEARCH_P(schema->attributes_by_attributeID_oid,
 			      schema->num_attributes, attributeID_oid, oid, strcasecmp, c);
 	return c;
@@ -96,6 +124,21 @@ const struct dsdb_attribute *dsdb_attribute_by_lDAPDisplayName(const struct dsdb
 
 	if (!name) return NULL;
 
+	if (schema->attributes_by_lDAPDisplayName_hash != NULL) {
+		uint32_t size = schema->attributes_hash_size;
+		uint32_t slot = dsdb_schema_name_hash(name, strlen(name)) & (size - 1);
+		uint32_t idx;
+
+		while ((idx = dsdb_name_hash_next(schema->attributes_by_lDAPDisplayName_hash,
+						  size, &slot)) != 0) {
+			c = schema->attributes_by_lDAPDisplayName[idx - 1];
+			if (strcasecmp(c->lDAPDisplayName, name) == 0) {
+				return c;
+			}
+		}
+		return NULL;
+	}
+
 	BINARY_ARRAY_SEARCH_P(schema->attributes_by_lDAPDisplayName,
 			      schema->num_attributes, lDAPDisplayName, name, strcasecmp, c);
 	return c;
@@ -108,6 +151,22 @@ const struct dsdb_attribute *dsdb_attribute_by_lDAPDisplayName_ldb_val(const str
 
 	if (!name) return NULL;
 
+	if (schema->attributes_by_lDAPDisplayName_hash != NULL) {
+		uint32_t size = schema->attributes_hash_size;
+		uint32_t slot = dsdb_schema_name_hash((const char *)name->data,
+						      name->length) & (size - 1);
+		uint32_t idx;
+
+		while ((idx = dsdb_name_hash_next(schema->attributes_by_lDAPDisplayName_hash,
+						  size, &slot)) != 0) {
+			a = schema->attributes_by_lDAPDisplayName[idx - 1];
+			if (strcasecmp_with_ldb_val(name, a->lDAPDisplayName) == 0) {
+				return a;
+			}
+		}
+		return NULL;
+	}
+
 	BINARY_ARRAY_SEARCH_P(schema->attributes_by_lDAPDisplayName,
 			      schema->num_attributes, lDAPDisplayName, name, strcasecmp_with_ldb_val, a);
 	return a;
@@ -154,6 +213,20 @@ const struct dsdb_class *dsdb_class_by_lDAPDisplayName(const struct dsdb_schema
 {
 	struct dsdb_class *c;
 	if (!name) return NULL;
+	if (schema->classes_by_lDAPDisplayName_hash != NULL) {
+		uint32_t size = schema->classes_hash_size;
+		uint32_t slot = dsdb_schema_name_hash(name, strlen(name)) & (size - 1);
+		uint32_t idx;
+
+		while ((idx = dsdb_name_hash_next(schema->classes_by_lDAPDisplayName_hash,
+						  size, &slot)) != 0) {
+			c = schema->classes_by_lDAPDisplayName[idx - 1];
+			if (strcasecmp(c->lDAPDisplayName, name) == 0) {
+				return c;
+			}
+		}
+		return NULL;
+	}
 	BINARY_ARRAY_SEARCH_P(schema->classes_by_lDAPDisplayName,
 			      schema->num_classes, lDAPDisplayName, name, strcasecmp, c);
 	return c;
@@ -164,6 +237,21 @@ const struct dsdb_class *dsdb_class_by_lDAPDisplayName_ldb_val(const struct dsdb
 {
 	struct dsdb_class *c;
 	if (!name) return NULL;
+	if (schema->classes_by_lDAPDisplayName_hash != NULL) {
+		uint32_t size = schema->classes_hash_size;
+		uint32_t slot = dsdb_schema_name_hash((const char *)name->data,
+						      name->length) & (size - 1);
+		uint32_t idx;
+
+		while ((idx = dsdb_name_hash_next(schema->classes_by_lDAPDisplayName_hash,
+						  size, &slot)) != 0) {
+			c = schema->classes_by_lDAPDisplayName[idx - 1];
+			if (strcasecmp_with_ldb_val(name, c->lDAPDisplayName) == 0) {
+				return c;
+			}
+		}
+		return NULL;
+	}
 	BINARY_ARRAY_SEARCH_P(schema->classes_by_lDAPDisplayName,
 			      schema->num_classes, lDAPDisplayName, name, strcasecmp_with_ldb_val, c);
 	return c;
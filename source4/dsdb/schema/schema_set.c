@@ -487,6 +487,61 @@ static void dsdb_sorted_accessors_free(struct dsdb_schema *schema)
 	TALLOC_FREE(schema->attributes_by_msDS_IntId);
 	TALLOC_FREE(schema->attributes_by_attributeID_oid);
 	TALLOC_FREE(schema->attributes_by_linkID);
+	/* free hash tables */
+	TALLOC_FREE(schema->classes_by_lDAPDisplayName_hash);
+	TALLOC_FREE(schema->attributes_by_lDAPDisplayName_hash);
+	TALLOC_FREE(schema->attributes_by_attributeID_oid_hash);
+	schema->classes_hash_size = 0;
+	schema->attributes_hash_size = 0;
+}
+
+/*
+  hash a lDAPDisplayName or OID, ignoring (ASCII) case, to match the
+  strcasecmp() used by the sorted arrays
+ */
+uint32_t dsdb_schema_name_hash(const char *name, size_t len)
+{
+	uint32_t hash = 5381;
+	size_t i;
+
+	for (i = 0; i < len && name[i] != '\0'; i++) {
+		unsigned char c = name[i];
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		hash = ((hash << 5) + hash) + c;
+	}
+	return hash;
+}
+
+/*
+  the size of a hash table for num entries, a power of two so at most
+  half the slots are used
+ */
+static uint32_t dsdb_name_hash_size(uint32_t num)
+{
+	uint32_t size = 16;
+
+	while (size < num * 2) {
+		size *= 2;
+	}
+	return size;
+}
+
+static void dsdb_name_hash_insert(uint32_t *table, uint32_t size,
+				  const char *name, uint32_t idx)
+{
+	uint32_t slot;
+
+	if (name == NULL) {
+		return;
+	}
+
+	slot = dsdb_schema_name_hash(name, strlen(name)) & (size - 1);
+	while (table[slot] != 0) {
+		slot = (slot + 1) & (size - 1);
+	}
+	table[slot] = idx + 1;
 }
 
 /*
@@ -547,6 +602,21 @@ int dsdb_setup_sorted_accessors(struct ldb_context *ldb,
 	TYPESAFE_QSORT(schema->classes_by_governsID_oid, schema->num_classes, dsdb_compare_class_by_governsID_oid);
 	TYPESAFE_QSORT(schema->classes_by_cn, schema->num_classes, dsdb_compare_class_by_cn);
 
+	/* index the sorted arrays by name */
+	schema->classes_hash_size = dsdb_name_hash_size(schema->num_classes);
+	schema->classes_by_lDAPDisplayName_hash = talloc_zero_array(schema,
+								    uint32_t,
+								    schema->classes_hash_size);
+	if (schema->classes_by_lDAPDisplayName_hash == NULL) {
+		goto failed;
+	}
+	for (i=0; i < schema->num_classes; i++) {
+		dsdb_name_hash_insert(schema->classes_by_lDAPDisplayName_hash,
+				      schema->classes_hash_size,
+				      schema->classes_by_lDAPDisplayName[i]->lDAPDisplayName,
+				      i);
+	}
+
 	/* now build the attribute accessor arrays */
 
 	/* count the attributes
@@ -596,6 +666,29 @@ int dsdb_setup_sorted_accessors(struct ldb_context *ldb,
 	TYPESAFE_QSORT(schema->attributes_by_attributeID_oid, schema->num_attributes, dsdb_compare_attribute_by_attributeID_oid);
 	TYPESAFE_QSORT(schema->attributes_by_linkID, schema->num_attributes, dsdb_compare_attribute_by_linkID);
 
+	/* index the sorted arrays by name and OID */
+	schema->attributes_hash_size = dsdb_name_hash_size(schema->num_attributes);
+	schema->attributes_by_lDAPDisplayName_hash = talloc_zero_array(schema,
+								       uint32_t,
+								       schema->attributes_hash_size);
+	schema->attributes_by_attributeID_oid_hash = talloc_zero_array(schema,
+								       uint32_t,
+								       schema->attributes_hash_size);
+	if (schema->attributes_by_lDAPDisplayName_hash == NULL ||
+	    schema->attributes_by_attributeID_oid_hash == NULL) {
+		goto failed;
+	}
+	for (i=0; i < schema->num_attributes; i++) {
+		dsdb_name_hash_insert(schema->attributes_by_lDAPDisplayName_hash,
+				      schema->attributes_hash_size,
+				      schema->attributes_by_lDAPDisplayName[i]->lDAPDisplayName,
+				      i);
+		dsdb_name_hash_insert(schema->attributes_by_attributeID_oid_hash,
+				      schema->attributes_hash_size,
+				      schema->attributes_by_attributeID_oid[i]->attributeID_oid,
+				      i);
+	}
+
 	dsdb_setup_attribute_shortcuts(ldb, schema);
 
 	ret = schema_fill_constructed(schema);
@@ -0,0 +1,200 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   Test and time DSDB schema lookups
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include <ldb.h>
+#include "dsdb/samdb/samdb.h"
+#include "param/param.h"
+#include "torture/smbtorture.h"
+#include "torture/local/proto.h"
+#include "param/provision.h"
+
+struct torture_dsdb_schema_lookup {
+	struct ldb_context *ldb;
+	struct dsdb_schema *schema;
+};
+
+/*
+ * Every attribute and class must be found by its own name and OID, in
+ * any case, and as an ldb_val.
+ */
+static bool torture_dsdb_schema_lookup_all(struct torture_context *torture,
+					   struct torture_dsdb_schema_lookup *priv)
+{
+	const struct dsdb_schema *schema = priv->schema;
+	const struct dsdb_attribute *a;
+	const struct dsdb_class *c;
+
+	for (a = schema->attributes; a != NULL; a = a->next) {
+		char *upper = strupper_talloc(torture, a->lDAPDisplayName);
+		struct ldb_val val = data_blob_string_const(upper);
+
+		torture_assert(torture,
+			       dsdb_attribute_by_lDAPDisplayName(schema,
+						a->lDAPDisplayName) == a,
+			       a->lDAPDisplayName);
+		torture_assert(torture,
+			       dsdb_attribute_by_lDAPDisplayName(schema,
+								 upper) == a,
+			       upper);
+		torture_assert(torture,
+			       dsdb_attribute_by_lDAPDisplayName_ldb_val(schema,
+									 &val) == a,
+			       upper);
+		torture_assert(torture,
+			       dsdb_attribute_by_attributeID_oid(schema,
+						a->attributeID_oid) == a,
+			       a->attributeID_oid);
+		TALLOC_FREE(upper);
+	}
+
+	for (c = schema->classes; c != NULL; c = c->next) {
+		char *upper = strupper_talloc(torture, c->lDAPDisplayName);
+		struct ldb_val val = data_blob_string_const(upper);
+
+		torture_assert(torture,
+			       dsdb_class_by_lDAPDisplayName(schema,
+						c->lDAPDisplayName) == c,
+			       c->lDAPDisplayName);
+		torture_assert(torture,
+			       dsdb_class_by_lDAPDisplayName_ldb_val(schema,
+								     &val) == c,
+			       upper);
+		TALLOC_FREE(upper);
+	}
+
+	torture_assert(torture,
+		       dsdb_attribute_by_lDAPDisplayName(schema,
+							 "noSuchAttribute") == NULL,
+		       "found an attribute that does not exist");
+	torture_assert(torture,
+		       dsdb_attribute_by_attributeID_oid(schema,
+							 "1.2.3.4.5.6.7") == NULL,
+		       "found an OID that does not exist");
+	torture_assert(torture,
+		       dsdb_class_by_lDAPDisplayName(schema,
+						     "noSuchClass") == NULL,
+		       "found a class that does not exist");
+
+	return true;
+}
+
+/*
+ * Time dsdb_attribute_by_lDAPDisplayName(), as called for every
+ * element of every message by many ldb modules.
+ */
+static bool torture_dsdb_schema_lookup_speed(struct torture_context *torture,
+					     struct torture_dsdb_schema_lookup *priv)
+{
+	const struct dsdb_schema *schema = priv->schema;
+	static const char * const names[] = {
+		"objectClass", "cn", "name", "objectGUID", "objectSid",
+		"sAMAccountName", "userAccountControl", "memberOf",
+		"member", "nTSecurityDescriptor", "whenChanged",
+		"replPropertyMetaData", "userPrincipalName", "unicodePwd",
+		"servicePrincipalName", "noSuchAttribute",
+	};
+	int timelimit = torture_setting_int(torture, "timelimit", 2);
+	struct timeval tv;
+	unsigned int count = 0;
+	size_t i;
+
+	torture_comment(torture, "Testing attribute lookups for %d seconds\n",
+			timelimit);
+
+	tv = timeval_current();
+	while (timeval_elapsed(&tv) < timelimit) {
+		for (i = 0; i < ARRAY_SIZE(names); i++) {
+			const struct dsdb_attribute *a =
+				dsdb_attribute_by_lDAPDisplayName(schema,
+								  names[i]);
+			if (a == NULL && i != ARRAY_SIZE(names) - 1) {
+				torture_fail(torture, names[i]);
+			}
+		}
+		count += ARRAY_SIZE(names);
+	}
+
+	torture_comment(torture, "attribute lookups %.2f ops/sec\n",
+			count / timeval_elapsed(&tv));
+
+	return true;
+}
+
+static bool torture_dsdb_schema_lookup_tcase_setup(struct torture_context *tctx,
+						   void **data)
+{
+	struct torture_dsdb_schema_lookup *priv;
+
+	priv = talloc_zero(tctx, struct torture_dsdb_schema_lookup);
+	torture_assert(tctx, priv, "No memory");
+
+	priv->ldb = provision_get_schema(priv, tctx->lp_ctx, NULL, NULL);
+	torture_assert(tctx, priv->ldb, "Failed to load schema from disk");
+
+	priv->schema = dsdb_get_schema(priv->ldb, NULL);
+	torture_assert(tctx, priv->schema, "Failed to fetch schema");
+
+	*data = priv;
+	return true;
+}
+
+static bool torture_dsdb_schema_lookup_tcase_teardown(struct torture_context *tctx,
+						      void *data)
+{
+	struct torture_dsdb_schema_lookup *priv;
+
+	priv = talloc_get_type_abort(data, struct torture_dsdb_schema_lookup);
+	talloc_unlink(priv, priv->ldb);
+	talloc_free(priv);
+
+	return true;
+}
+
+/**
+ * DSDB-SCHEMA-LOOKUP test suite creation
+ */
+struct torture_suite *torture_dsdb_schema_lookup(TALLOC_CTX *mem_ctx)
+{
+	typedef bool (*pfn_run)(struct torture_context *, void *);
+
+	struct torture_tcase *tc;
+	struct torture_suite *suite = torture_suite_create(mem_ctx,
+							   "dsdb.schema.lookup");
+
+	if (suite == NULL) {
+		return NULL;
+	}
+
+	tc = torture_suite_add_tcase(suite, "tc");
+	if (!tc) {
+		return NULL;
+	}
+
+	torture_tcase_set_fixture(tc,
+				  torture_dsdb_schema_lookup_tcase_setup,
+				  torture_dsdb_schema_lookup_tcase_teardown);
+
+	torture_tcase_add_simple_test(tc, "all", (pfn_run)torture_dsdb_schema_lookup_all);
+	torture_tcase_add_simple_test(tc, "speed", (pfn_run)torture_dsdb_schema_lookup_speed);
+
+	suite->description = talloc_strdup(suite, "DSDB schema lookup tests");
+
+	return suite;
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Tests of the logon stamps (logonCount and lastLogon) that a DC with
+# "auth:logon stamp interval" set queues and writes in batches.
+#
+from __future__ import print_function
+import optparse
+import sys
+import time
+
+sys.path.insert(0, "bin/python")
+import samba
+from samba.tests.subunitrun import TestProgram, SubunitOptions
+import samba.getopt as options
+from samba.auth import system_session
+from samba.credentials import Credentials, MUST_USE_KERBEROS
+from samba.samdb import SamDB
+from samba.tests import delete_force
+from ldb import SCOPE_BASE
+
+parser = optparse.OptionParser("login_stamps.py [options] <host>")
+sambaopts = options.SambaOptions(parser)
+parser.add_option_group(sambaopts)
+parser.add_option_group(options.VersionOptions(parser))
+# use command line creds if available
+credopts = options.CredentialsOptions(parser)
+parser.add_option_group(credopts)
+subunitopts = SubunitOptions(parser)
+parser.add_option_group(subunitopts)
+parser.add_option('--logon-stamp-interval', type='int', default=5,
+                  help="the 'auth:logon stamp interval' of the DC")
+opts, args = parser.parse_args()
+
+if len(args) < 1:
+    parser.print_usage()
+    sys.exit(1)
+
+host = args[0]
+host_url = "ldap://%s" % host
+
+lp = sambaopts.get_loadparm()
+global_creds = credopts.get_credentials(lp)
+
+
+class LogonStampTests(samba.tests.TestCase):
+
+    def setUp(self):
+        super(LogonStampTests, self).setUp()
+        self.ldb = SamDB(url=host_url, credentials=global_creds,
+                         session_info=system_session(lp), lp=lp)
+        self.base_dn = self.ldb.domain_dn()
+
+        self.username = "stampuser"
+        self.password = "thatsAcomplPASS1"
+        self.userdn = "CN=%s,CN=Users,%s" % (self.username, self.base_dn)
+
+        delete_force(self.ldb, self.userdn)
+        self.ldb.newuser(self.username, self.password)
+        self.addCleanup(delete_force, self.ldb, self.userdn)
+
+    def user_creds(self):
+        creds = Credentials()
+        creds.guess(lp)
+        creds.set_username(self.username)
+        creds.set_password(self.password)
+        creds.set_domain(global_creds.get_domain())
+        creds.set_realm(global_creds.get_realm())
+        creds.set_workstation(global_creds.get_workstation())
+        creds.set_kerberos_state(MUST_USE_KERBEROS)
+        return creds
+
+    def get_stamps(self, dn):
+        res = self.ldb.search(dn, scope=SCOPE_BASE,
+                              attrs=["logonCount", "lastLogon"])
+        self.assertEqual(len(res), 1)
+        return (int(res[0]["logonCount"][0]), int(res[0]["lastLogon"][0]))
+
+    def test_queued_stamps_merged(self):
+        logon_count, last_logon = self.get_stamps(self.userdn)
+
+        num_logons = 3
+        for i in range(num_logons):
+            SamDB(url=host_url, credentials=self.user_creds(), lp=lp)
+
+        # The stamps are only queued, nothing is written yet
+        self.assertEqual(self.get_stamps(self.userdn),
+                         (logon_count, last_logon))
+
+        time.sleep(opts.logon_stamp_interval + 2)
+
+        new_logon_count, new_last_logon = self.get_stamps(self.userdn)
+        self.assertEqual(new_logon_count, logon_count + num_logons)
+        self.assertGreater(new_last_logon, last_logon)
+
+    def test_queued_stamps_after_rename(self):
+        logon_count, last_logon = self.get_stamps(self.userdn)
+
+        num_logons = 3
+        for i in range(num_logons):
+            SamDB(url=host_url, credentials=self.user_creds(), lp=lp)
+
+        # The account is renamed before the stamps are written, they
+        # must still be written to it
+        new_dn = "CN=%s-renamed,CN=Users,%s" % (self.username, self.base_dn)
+        self.addCleanup(delete_force, self.ldb, new_dn)
+        self.ldb.rename(self.userdn, new_dn)
+        self.assertEqual(self.get_stamps(new_dn), (logon_count, last_logon))
+
+        time.sleep(opts.logon_stamp_interval + 2)
+
+        new_logon_count, new_last_logon = self.get_stamps(new_dn)
+        self.assertEqual(new_logon_count, logon_count + num_logons)
+        self.assertGreater(new_last_logon, last_logon)
+
+
+TestProgram(module=__name__, opts=subunitopts)
@@ -1191,6 +1191,57 @@ class VLVTests(TestsWithUserOU):
         expected_results = [r for r in full_results if r != del_user[attr]]
         self.assertEqual(results, expected_results)
 
+    def test_vlv_new_view_after_change(self):
+        """A new VLV view must show changes made since the same sorted
+        search was made, even on another connection."""
+        attr = 'roomNumber'
+        expr = "(objectclass=user)"
+
+        full_results, cookie = self.vlv_search(attr, expr,
+                                               after_count=len(self.users))
+
+        other_ldb = SamDB(host, credentials=creds,
+                          session_info=system_session(lp), lp=lp)
+        res = other_ldb.search(self.ou,
+                               expression=expr,
+                               scope=ldb.SCOPE_ONELEVEL,
+                               attrs=[attr],
+                               controls=["vlv:1:0:%d:1:0" % len(self.users),
+                                         "server_sort:1:0:%s" % attr])
+        self.assertEqual([str(x[attr][0]) for x in res], full_results)
+
+        # Add a user at the end of the sort order
+        add_val = "z_addedval"
+        user = {'cn': add_val, "objectclass": "user", attr: add_val}
+        user['dn'] = "cn=%s,%s" % (user['cn'], self.ou)
+        other_ldb.add(user)
+
+        results, cookie = self.vlv_search(attr, expr,
+                                          after_count=len(self.users) + 1)
+        self.assertEqual(results, full_results + [add_val])
+
+    def test_vlv_new_view_after_unreplicated_change(self):
+        """Writes to attributes that are not replicated don't change the
+        sequence number of the database, a new VLV view sorted on one
+        must still show them."""
+        attr = 'lastLogon'
+        expr = "(objectclass=user)"
+
+        full_results, cookie = self.vlv_search(attr, expr,
+                                               after_count=len(self.users))
+        self.assertEqual(full_results, ["0"] * len(self.users))
+
+        other_ldb = SamDB(host, credentials=creds,
+                          session_info=system_session(lp), lp=lp)
+        m = ldb.Message()
+        m.dn = ldb.Dn(other_ldb, self.users[0]['dn'])
+        m[attr] = ldb.MessageElement("12345", ldb.FLAG_MOD_REPLACE, attr)
+        other_ldb.modify(m)
+
+        results, cookie = self.vlv_search(attr, expr,
+                                          after_count=len(self.users))
+        self.assertEqual(results, ["0"] * (len(self.users) - 1) + ["12345"])
+
 
 
 class PagedResultsTests(TestsWithUserOU):
@@ -1763,6 +1763,199 @@ static krb5_error_code samba_kdc_fetch_client(krb5_context context,
 	return ret;
 }
 
+/*
+ * A small cache of the service principals named in TGS-REQs, so that
+ * a hit saves cracking the principal name into a DN before the
+ * search.  Our own krbtgt is a single base search on a known DN, a
+ * hit could not be cheaper than that and it is not cached.
+ *
+ * An entry is only used while the highest sequence number of the
+ * database is unchanged, so any replicated write (including a
+ * password change or replicated secret) empties the cache.
+ *
+ * Writes of attributes that are not replicated, like badPwdCount,
+ * don't change the sequence number, and a cancelled transaction may
+ * hand out the same number again, so an entry is also dropped after
+ * SAMBA_KDC_MSG_CACHE_TTL seconds.  The constructed attributes depend
+ * on the time of the search (the lockout and password expiry), they
+ * are not cached but searched for again on every hit.
+ */
+#define SAMBA_KDC_MSG_CACHE_SIZE 32
+#define SAMBA_KDC_MSG_CACHE_TTL 10
+
+static const char * const samba_kdc_msg_cache_constructed_attrs[] = {
+	"msDS-User-Account-Control-Computed",
+	"msDS-UserPasswordExpiryTimeComputed",
+	NULL
+};
+
+struct samba_kdc_msg_cache_entry {
+	char *key;
+	uint64_t seq_num;
+	time_t expires;
+	struct ldb_dn *realm_dn;
+	struct ldb_message *msg;
+};
+
+struct samba_kdc_msg_cache {
+	struct samba_kdc_msg_cache_entry entries[SAMBA_KDC_MSG_CACHE_SIZE];
+	/* the entry to replace next */
+	unsigned int next;
+};
+
+/*
+  replace the constructed attributes of a cached message by their
+  current values
+ */
+static int samba_kdc_msg_cache_refresh(struct samba_kdc_db_context *kdc_db_ctx,
+				       struct ldb_message *msg)
+{
+	struct ldb_message *computed = NULL;
+	unsigned int i;
+	int ret;
+
+	ret = dsdb_search_one(kdc_db_ctx->samdb, msg,
+			      &computed, msg->dn, LDB_SCOPE_BASE,
+			      samba_kdc_msg_cache_constructed_attrs,
+			      DSDB_SEARCH_NO_GLOBAL_CATALOG,
+			      "(objectClass=*)");
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	for (i = 0; samba_kdc_msg_cache_constructed_attrs[i] != NULL; i++) {
+		const char *name = samba_kdc_msg_cache_constructed_attrs[i];
+		struct ldb_message_element *el = NULL;
+
+		el = ldb_msg_find_element(computed, name);
+		if (el == NULL) {
+			continue;
+		}
+		ret = ldb_msg_add(msg, el, 0);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  find a cached search result, returning a copy on mem_ctx.
+
+  *seq_num is set to the current sequence number, to be passed to
+  samba_kdc_msg_cache_add() after a miss.
+ */
+static bool samba_kdc_msg_cache_get(struct samba_kdc_db_context *kdc_db_ctx,
+				    TALLOC_CTX *mem_ctx,
+				    const char *key,
+				    uint64_t *seq_num,
+				    struct ldb_dn **realm_dn,
+				    struct ldb_message **msg)
+{
+	struct samba_kdc_msg_cache *cache = kdc_db_ctx->msg_cache;
+	time_t now = time_mono(NULL);
+	unsigned int i;
+	int ret;
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	ret = ldb_sequence_number(kdc_db_ctx->samdb,
+				  LDB_SEQ_HIGHEST_SEQ,
+				  seq_num);
+	if (ret != LDB_SUCCESS) {
+		*seq_num = 0;
+		return false;
+	}
+
+	for (i = 0; i < SAMBA_KDC_MSG_CACHE_SIZE; i++) {
+		struct samba_kdc_msg_cache_entry *e = &cache->entries[i];
+
+		if (e->key == NULL) {
+			continue;
+		}
+		if (e->seq_num != *seq_num || e->expires < now) {
+			/* the database may have changed since this was cached */
+			TALLOC_FREE(e->key);
+			continue;
+		}
+		if (strcmp(e->key, key) != 0) {
+			continue;
+		}
+
+		*msg = ldb_msg_copy(mem_ctx, e->msg);
+		if (*msg == NULL) {
+			return false;
+		}
+		ret = samba_kdc_msg_cache_refresh(kdc_db_ctx, *msg);
+		if (ret != LDB_SUCCESS) {
+			/* maybe gone, let the caller search again */
+			TALLOC_FREE(e->key);
+			TALLOC_FREE(*msg);
+			return false;
+		}
+		if (realm_dn != NULL) {
+			*realm_dn = ldb_dn_copy(mem_ctx, e->realm_dn);
+			if (*realm_dn == NULL) {
+				TALLOC_FREE(*msg);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
+
+/*
+  remember a search result made at sequence number seq_num
+ */
+static void samba_kdc_msg_cache_add(struct samba_kdc_db_context *kdc_db_ctx,
+				    const char *key,
+				    uint64_t seq_num,
+				    struct ldb_dn *realm_dn,
+				    const struct ldb_message *msg)
+{
+	struct samba_kdc_msg_cache *cache = kdc_db_ctx->msg_cache;
+	struct samba_kdc_msg_cache_entry *e = NULL;
+	unsigned int i;
+
+	if (cache == NULL || seq_num == 0) {
+		return;
+	}
+
+	e = &cache->entries[cache->next];
+	cache->next = (cache->next + 1) % SAMBA_KDC_MSG_CACHE_SIZE;
+
+	/* the key owns the rest of the entry */
+	TALLOC_FREE(e->key);
+	e->key = talloc_strdup(cache, key);
+	if (e->key == NULL) {
+		return;
+	}
+	e->msg = ldb_msg_copy(e->key, msg);
+	if (e->msg == NULL) {
+		TALLOC_FREE(e->key);
+		return;
+	}
+	for (i = 0; samba_kdc_msg_cache_constructed_attrs[i] != NULL; i++) {
+		ldb_msg_remove_attr(e->msg,
+				    samba_kdc_msg_cache_constructed_attrs[i]);
+	}
+	e->realm_dn = NULL;
+	if (realm_dn != NULL) {
+		e->realm_dn = ldb_dn_copy(e->key, realm_dn);
+		if (e->realm_dn == NULL) {
+			TALLOC_FREE(e->key);
+			return;
+		}
+	}
+	e->seq_num = seq_num;
+	e->expires = time_mono(NULL) + SAMBA_KDC_MSG_CACHE_TTL;
+}
+
 static krb5_error_code samba_kdc_fetch_krbtgt(krb5_context context,
 					      struct samba_kdc_db_context *kdc_db_ctx,
 					      TALLOC_CTX *mem_ctx,
@@ -1924,6 +2117,8 @@ static krb5_error_code samba_kdc_lookup_server(krb5_context context,
 		NTSTATUS nt_status;
 		struct ldb_dn *user_dn;
 		char *principal_string;
+		char *cache_key = NULL;
+		uint64_t seq_num = 0;
 
 		ret = krb5_unparse_name_flags(context, principal,
 					      KRB5_PRINCIPAL_UNPARSE_NO_REALM,
@@ -1932,6 +2127,27 @@ static krb5_error_code samba_kdc_lookup_server(krb5_context context,
 			return ret;
 		}
 
+		/*
+		 * Only the lookups for the TGS-REQ itself are cached,
+		 * the other callers ask for different attributes.
+		 */
+		if (attrs == server_attrs) {
+			cache_key = talloc_asprintf(mem_ctx, "server:%s",
+						    principal_string);
+			if (cache_key == NULL) {
+				free(principal_string);
+				return ENOMEM;
+			}
+		}
+		if (cache_key != NULL &&
+		    samba_kdc_msg_cache_get(kdc_db_ctx, mem_ctx,
+					    cache_key, &seq_num,
+					    realm_dn, msg)) {
+			free(principal_string);
+			TALLOC_FREE(cache_key);
+			return 0;
+		}
+
 		/* At this point we may find the host is known to be
 		 * in a different realm, so we should generate a
 		 * referral instead */
@@ -1941,6 +2157,7 @@ static krb5_error_code samba_kdc_lookup_server(krb5_context context,
 		free(principal_string);
 
 		if (!NT_STATUS_IS_OK(nt_status)) {
+			TALLOC_FREE(cache_key);
 			return SDB_ERR_NOENTRY;
 		}
 
@@ -1951,8 +2168,15 @@ static krb5_error_code samba_kdc_lookup_server(krb5_context context,
 					  DSDB_SEARCH_SHOW_EXTENDED_DN | DSDB_SEARCH_NO_GLOBAL_CATALOG,
 					  "(objectClass=*)");
 		if (ldb_ret != LDB_SUCCESS) {
+			TALLOC_FREE(cache_key);
 			return SDB_ERR_NOENTRY;
 		}
+
+		if (cache_key != NULL) {
+			samba_kdc_msg_cache_add(kdc_db_ctx, cache_key, seq_num,
+						*realm_dn, *msg);
+			TALLOC_FREE(cache_key);
+		}
 		return 0;
 	} else if (!(flags & SDB_F_FOR_AS_REQ)
 		   && smb_krb5_principal_get_type(context, principal) == KRB5_NT_ENTERPRISE_PRINCIPAL) {
@@ -2769,6 +2993,15 @@ NTSTATUS samba_kdc_setup_db_ctx(TALLOC_CTX *mem_ctx, struct samba_kdc_base_conte
 		return NT_STATUS_CANT_ACCESS_DOMAIN_INFO;
 	}
 
+	if (lpcfg_parm_bool(kdc_db_ctx->lp_ctx, NULL, "kdc", "lookup cache", true)) {
+		kdc_db_ctx->msg_cache = talloc_zero(kdc_db_ctx,
+						    struct samba_kdc_msg_cache);
+		if (kdc_db_ctx->msg_cache == NULL) {
+			talloc_free(kdc_db_ctx);
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
 	/* Find out our own krbtgt kvno */
 	ldb_ret = samdb_rodc(kdc_db_ctx->samdb, &kdc_db_ctx->rodc);
 	if (ldb_ret != LDB_SUCCESS) {
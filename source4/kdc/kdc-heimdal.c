@@ -302,6 +302,18 @@ static NTSTATUS kdc_task_init(struct task_server *task)
 	kdc->task = task;
 	task->private_data = kdc;
 
+#ifdef SO_REUSEPORT
+	/*
+	 * With the prefork process model, let the kernel balance the
+	 * UDP requests over the workers.
+	 */
+	if (strcmp(task->model_ops->name, "prefork") == 0) {
+		kdc->udp_reuseport = lpcfg_parm_bool(task->lp_ctx, NULL,
+						     "kdc", "udp reuseport",
+						     true);
+	}
+#endif
+
 	/* start listening on the configured network interfaces */
 	status = kdc_startup_interfaces(kdc, task->lp_ctx, ifaces,
 					task->model_ops);
@@ -475,6 +487,12 @@ static void kdc_post_fork(struct task_server *task, struct process_details *pd)
 	}
 	kdc->private_data = kdc_config;
 
+	status = kdc_add_reuseport_udp_sockets(kdc);
+	if (!NT_STATUS_IS_OK(status)) {
+		task_server_terminate(task, "kdc failed to setup UDP sockets", true);
+		return;
+	}
+
 	status = IRPC_REGISTER(task->msg_ctx, irpc, KDC_CHECK_GENERIC_KERBEROS,
 			       kdc_check_generic_kerberos, kdc);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -539,6 +539,131 @@ static const struct stream_server_ops kdc_tcp_stream_ops = {
 	.send_handler		= kdc_tcp_send
 };
 
+/*
+  open a UDP socket bound to the address of kdc_socket that shares the
+  port with the same socket of the other workers, so that the kernel
+  spreads the incoming requests over them
+ */
+static int kdc_udp_reuseport_socket(const struct tsocket_address *local,
+				    TALLOC_CTX *mem_ctx,
+				    struct tdgram_context **dgram)
+{
+#ifdef SO_REUSEPORT
+	struct sockaddr_storage ss;
+	ssize_t sa_len;
+	int fd;
+	int val = 1;
+	int ret;
+
+	sa_len = tsocket_address_bsd_sockaddr(local,
+					      (struct sockaddr *)&ss,
+					      sizeof(ss));
+	if (sa_len < 0) {
+		return -1;
+	}
+
+	fd = socket(ss.ss_family, SOCK_DGRAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	smb_set_close_on_exec(fd);
+
+	ret = set_blocking(fd, false);
+	if (ret == -1) {
+		goto fail;
+	}
+
+#ifdef HAVE_IPV6
+	if (ss.ss_family == AF_INET6) {
+		ret = setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY,
+				 (const void *)&val, sizeof(val));
+		if (ret == -1) {
+			goto fail;
+		}
+	}
+#endif
+
+	ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+			 (const void *)&val, sizeof(val));
+	if (ret == -1) {
+		goto fail;
+	}
+
+	ret = bind(fd, (struct sockaddr *)&ss, sa_len);
+	if (ret == -1) {
+		goto fail;
+	}
+
+	ret = tdgram_bsd_existing_socket(mem_ctx, fd, dgram);
+	if (ret == -1) {
+		goto fail;
+	}
+	return 0;
+
+fail:
+	{
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+	}
+	return -1;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+  listen for UDP requests on the address of kdc_socket, on a socket of
+  this process alone if reuseport is set
+ */
+static NTSTATUS kdc_add_udp_socket(struct kdc_socket *kdc_socket,
+				   bool reuseport)
+{
+	struct kdc_server *kdc = kdc_socket->kdc;
+	struct kdc_udp_socket *kdc_udp_socket;
+	struct tevent_req *udpsubreq;
+	NTSTATUS status;
+	int ret;
+
+	kdc_udp_socket = talloc(kdc_socket, struct kdc_udp_socket);
+	NT_STATUS_HAVE_NO_MEMORY(kdc_udp_socket);
+
+	kdc_udp_socket->kdc_socket = kdc_socket;
+
+	if (reuseport) {
+		ret = kdc_udp_reuseport_socket(kdc_socket->local_address,
+					       kdc_udp_socket,
+					       &kdc_udp_socket->dgram);
+	} else {
+		ret = tdgram_inet_udp_socket(kdc_socket->local_address,
+					     NULL,
+					     kdc_udp_socket,
+					     &kdc_udp_socket->dgram);
+	}
+	if (ret != 0) {
+		status = map_nt_error_from_unix_common(errno);
+		DEBUG(0,("Failed to bind to %s UDP - %s\n",
+			 tsocket_address_string(kdc_socket->local_address,
+						kdc_udp_socket),
+			 nt_errstr(status)));
+		talloc_free(kdc_udp_socket);
+		return status;
+	}
+
+	kdc_udp_socket->send_queue = tevent_queue_create(kdc_udp_socket,
+							 "kdc_udp_send_queue");
+	NT_STATUS_HAVE_NO_MEMORY(kdc_udp_socket->send_queue);
+
+	udpsubreq = tdgram_recvfrom_send(kdc_udp_socket,
+					 kdc->task->event_ctx,
+					 kdc_udp_socket->dgram);
+	NT_STATUS_HAVE_NO_MEMORY(udpsubreq);
+	tevent_req_set_callback(udpsubreq, kdc_udp_call_loop, kdc_udp_socket);
+
+	return NT_STATUS_OK;
+}
+
 /*
  * Start listening on the given address
  */
@@ -551,8 +676,6 @@ NTSTATUS kdc_add_socket(struct kdc_server *kdc,
 			bool udp_only)
 {
 	struct kdc_socket *kdc_socket;
-	struct kdc_udp_socket *kdc_udp_socket;
-	struct tevent_req *udpsubreq;
 	NTSTATUS status;
 	int ret;
 
@@ -588,31 +711,48 @@ NTSTATUS kdc_add_socket(struct kdc_server *kdc,
 		}
 	}
 
-	kdc_udp_socket = talloc(kdc_socket, struct kdc_udp_socket);
-	NT_STATUS_HAVE_NO_MEMORY(kdc_udp_socket);
+	if (kdc->udp_reuseport) {
+		/*
+		 * The workers all accept TCP connections from the
+		 * listening socket above, but a UDP socket shared by
+		 * them wakes every worker for each request.  Each
+		 * worker opens its own UDP socket in
+		 * kdc_add_reuseport_udp_sockets() instead.
+		 */
+		struct kdc_socket **sockets = NULL;
+
+		sockets = talloc_realloc(kdc,
+					 kdc->reuseport_sockets,
+					 struct kdc_socket *,
+					 kdc->num_reuseport_sockets + 1);
+		NT_STATUS_HAVE_NO_MEMORY(sockets);
+		sockets[kdc->num_reuseport_sockets++] = kdc_socket;
+		kdc->reuseport_sockets = sockets;
+		return NT_STATUS_OK;
+	}
 
-	kdc_udp_socket->kdc_socket = kdc_socket;
+	return kdc_add_udp_socket(kdc_socket, false);
+}
 
-	ret = tdgram_inet_udp_socket(kdc_socket->local_address,
-				     NULL,
-				     kdc_udp_socket,
-				     &kdc_udp_socket->dgram);
-	if (ret != 0) {
-		status = map_nt_error_from_unix_common(errno);
-		DEBUG(0,("Failed to bind to %s:%u UDP - %s\n",
-			 address, port, nt_errstr(status)));
-		return status;
-	}
+/*
+  open the UDP sockets set aside by kdc_add_socket() in this worker
+ */
+NTSTATUS kdc_add_reuseport_udp_sockets(struct kdc_server *kdc)
+{
+	size_t num_binds = 0;
+	size_t i;
 
-	kdc_udp_socket->send_queue = tevent_queue_create(kdc_udp_socket,
-							 "kdc_udp_send_queue");
-	NT_STATUS_HAVE_NO_MEMORY(kdc_udp_socket->send_queue);
+	for (i = 0; i < kdc->num_reuseport_sockets; i++) {
+		NTSTATUS status;
 
-	udpsubreq = tdgram_recvfrom_send(kdc_udp_socket,
-					 kdc->task->event_ctx,
-					 kdc_udp_socket->dgram);
-	NT_STATUS_HAVE_NO_MEMORY(udpsubreq);
-	tevent_req_set_callback(udpsubreq, kdc_udp_call_loop, kdc_udp_socket);
+		status = kdc_add_udp_socket(kdc->reuseport_sockets[i], true);
+		if (NT_STATUS_IS_OK(status)) {
+			num_binds++;
+		}
+	}
 
+	if (kdc->num_reuseport_sockets > 0 && num_binds == 0) {
+		return NT_STATUS_INVALID_PARAMETER_MIX;
+	}
 	return NT_STATUS_OK;
 }
@@ -42,6 +42,13 @@ struct kdc_server {
 	uint32_t proxy_timeout;
 	const char *keytab_name;
 	void *private_data;
+	/*
+	 * Set to open the UDP sockets in each worker process, with
+	 * SO_REUSEPORT, rather than once before forking.
+	 */
+	bool udp_reuseport;
+	struct kdc_socket **reuseport_sockets;
+	size_t num_reuseport_sockets;
 };
 
 typedef enum kdc_code_e {
@@ -79,5 +86,6 @@ NTSTATUS kdc_add_socket(struct kdc_server *kdc,
 			uint16_t port,
 			kdc_process_fn_t process,
 			bool udp_only);
+NTSTATUS kdc_add_reuseport_udp_sockets(struct kdc_server *kdc);
 
 #endif /* _KDC_SERVER_H */
@@ -37,6 +37,7 @@ struct samba_kdc_base_context {
 };
 
 struct samba_kdc_seq;
+struct samba_kdc_msg_cache;
 
 struct samba_kdc_db_context {
 	struct tevent_context *ev_ctx;
@@ -48,6 +49,7 @@ struct samba_kdc_db_context {
 	unsigned int my_krbtgt_number;
 	struct ldb_dn *krbtgt_dn;
 	struct samba_kdc_policy policy;
+	struct samba_kdc_msg_cache *msg_cache;
 };
 
 struct samba_kdc_entry {
@@ -302,6 +302,9 @@ static NTSTATUS ldapsrv_queue_reply_forced(struct ldapsrv_call *call,
  * Queue a reply (encoding it also) but check we do not send more than
  * LDAP_SERVER_MAX_REPLY_SIZE of responses as a way to limit the
  * amount of data a client can make us allocate.
+ *
+ * Replies passed on by call->send_reply are not kept in memory, so
+ * they don't count towards that limit.
  */
 NTSTATUS ldapsrv_queue_reply(struct ldapsrv_call *call, struct ldapsrv_reply *reply)
 {
@@ -311,6 +314,14 @@ NTSTATUS ldapsrv_queue_reply(struct ldapsrv_call *call, struct ldapsrv_reply *re
 		return status;
 	}
 
+	if (call->send_reply != NULL) {
+		status = call->send_reply(call, reply,
+					  call->send_reply_private);
+		TALLOC_FREE(reply->blob.data);
+		TALLOC_FREE(reply);
+		return status;
+	}
+
 	if (call->reply_size > call->reply_size + reply->blob.length
 	    || call->reply_size + reply->blob.length > LDAP_SERVER_MAX_REPLY_SIZE) {
 		DBG_WARNING("Refusing to queue LDAP search response size "
@@ -709,7 +720,7 @@ queue_reply:
 }
 
 
-static NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
+NTSTATUS ldapsrv_SearchRequest(struct ldapsrv_call *call)
 {
 	struct ldap_SearchRequest *req = &call->request->r.SearchRequest;
 	struct ldap_Result *done;
@@ -1467,6 +1478,9 @@ NTSTATUS ldapsrv_do_call(struct ldapsrv_call *call)
 	case LDAP_TAG_UnbindRequest:
 		return ldapsrv_UnbindRequest(call);
 	case LDAP_TAG_SearchRequest:
+		if (ldapsrv_search_worker_eligible(call)) {
+			return ldapsrv_search_worker_queue(call);
+		}
 		return ldapsrv_SearchRequest(call);
 	case LDAP_TAG_ModifyRequest:
 		status = ldapsrv_ModifyRequest(call);
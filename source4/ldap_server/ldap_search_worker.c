@@ -0,0 +1,1329 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   LDAP server search worker processes
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * All calls of an LDAP server task are processed in order on a single
+ * tevent loop, so one expensive subtree search holds up every other
+ * connection served by the same process.
+ *
+ * With "ldap server search workers" set, one level and subtree searches
+ * that do not keep state on the connection (paged results, VLV and
+ * notifications) are passed to a pool of helper processes forked when
+ * the task starts.  Each helper has its own sam.ldb contexts, and on
+ * the LMDB backend each search runs in its own read transaction,
+ * concurrently with the other helpers.  Modifications and stateful
+ * searches stay in the task process, so writes remain serialized.
+ *
+ * Helpers are processes rather than threads as neither the ldb module
+ * stack nor the dsdb schema cache are thread safe.  A helper that dies
+ * is replaced after a delay, and its searches (and any queued while no
+ * helper is left) are run by the task itself.
+ *
+ * Each request sent to a helper is
+ *
+ *   uint32 length (of the rest of the frame)
+ *   uint32 flags (LDAPSRV_SEARCH_WORKER_*)
+ *   uint32 session length
+ *   NDR encoded auth_session_info
+ *   LDAP SearchRequest PDU as received from the client
+ *
+ * and the helper answers with one frame per encoded LDAP reply
+ *
+ *   uint32 length (of the rest of the frame)
+ *   uint32 flags (LDAPSRV_SEARCH_WORKER_LAST_REPLY on SearchResultDone)
+ *   LDAP reply PDU
+ *
+ * All integers are in network byte order.
+ *
+ * The helper writes each entry as soon as the search returns it, and
+ * the task passes the replies on to the client as they arrive.  The
+ * task stops reading from the helper while it has more than
+ * LDAP_SERVER_STREAM_HIGH_WATERMARK bytes of replies waiting to be
+ * written to the client, so a helper serving a slow client blocks in
+ * the middle of its search once the socket between them is full.
+ * This bounds the memory used for large result sets.
+ *
+ * A helper blocked like this keeps its read transaction open.  If the
+ * client does not take the replies within the search time limit of
+ * the connection the helper is replaced and the call fails, and while
+ * every helper is blocked the queued searches are run by the task.
+ */
+
+#include "includes.h"
+#include "system/network.h"
+#include "system/filesys.h"
+#include "system/dir.h"
+#include "system/wait.h"
+#include "lib/events/events.h"
+#include "../lib/util/dlinklist.h"
+#include "../lib/util/asn1.h"
+#include "../lib/util/blocking.h"
+#include "../lib/util/sys_rw_data.h"
+#include "../lib/util/tevent_ntstatus.h"
+#include "../lib/tsocket/tsocket.h"
+#include "../libcli/util/tstream.h"
+#include "librpc/gen_ndr/ndr_auth.h"
+#include "ldap_server/ldap_server.h"
+#include "smbd/service_task.h"
+#include "smbd/process_model.h"
+#include "dsdb/samdb/samdb.h"
+#include "param/param.h"
+#include "libcli/ldap/ldap_proto.h"
+#include "ldb_wrap.h"
+#include <ldb.h>
+#include <ldb_errors.h>
+
+#define LDAPSRV_SEARCH_WORKER_GLOBAL_CATALOG	0x00000001
+#define LDAPSRV_SEARCH_WORKER_PRIVILEGED	0x00000002
+#define LDAPSRV_SEARCH_WORKER_REFERRAL_LDAPS	0x00000004
+
+#define LDAPSRV_SEARCH_WORKER_LAST_REPLY	0x00000001
+
+/*
+ * Upper limit of a request frame, the search request PDU plus the
+ * session info of the connection
+ */
+#define LDAPSRV_SEARCH_WORKER_MAX_REQUEST ((size_t)(16 * 1024 * 1024))
+
+/*
+ * Number of sam.ldb contexts, one per session, a helper keeps open
+ */
+#define LDAPSRV_SEARCH_WORKER_MAX_SESSIONS 16
+
+struct ldapsrv_search_worker {
+	struct ldapsrv_search_worker *prev, *next;
+	struct ldapsrv_search_pool *pool;
+	pid_t pid;
+	struct tstream_context *stream;
+	DATA_BLOB frame;
+	struct iovec iov;
+	bool busy;
+	/*
+	 * The search being processed, NULL when the call went away
+	 * before the helper finished.  The remaining replies are
+	 * then read and dropped to keep the stream in sync.
+	 */
+	struct tevent_req *req;
+	/*
+	 * The call the helper is working for, and whether reading
+	 * its replies is paused until the client has taken the
+	 * previous ones
+	 */
+	struct ldapsrv_search_worker_context *ctx;
+	bool paused;
+	/*
+	 * A paused helper holds its read transaction open, it is
+	 * replaced if the client does not take the replies in time
+	 */
+	struct tevent_timer *pause_te;
+};
+
+/*
+ * Delay before a helper that died is replaced, doubled each time a
+ * new helper dies before finishing a search
+ */
+#define LDAPSRV_SEARCH_WORKER_RESPAWN_MIN 1
+#define LDAPSRV_SEARCH_WORKER_RESPAWN_MAX 60
+
+struct ldapsrv_search_pool {
+	struct tevent_context *ev;
+	struct loadparm_context *lp_ctx;
+	int num_workers;
+	struct ldapsrv_search_worker *workers;
+	struct ldapsrv_search_worker_wait_state *pending;
+	struct tevent_timer *respawn_te;
+	unsigned int respawn_delay;
+};
+
+/*
+ * Helper process side
+ */
+
+struct ldapsrv_search_worker_session {
+	struct ldapsrv_search_worker_session *prev, *next;
+	DATA_BLOB blob;
+	bool global_catalog;
+	struct auth_session_info *session_info;
+	struct ldb_context *ldb;
+};
+
+static struct ldapsrv_search_worker_session *ldapsrv_search_worker_session(
+	TALLOC_CTX *mem_ctx,
+	struct ldapsrv_search_worker_session **sessions,
+	struct tevent_context *ev,
+	struct loadparm_context *lp_ctx,
+	DATA_BLOB blob,
+	bool global_catalog)
+{
+	struct ldapsrv_search_worker_session *s = NULL;
+	enum ndr_err_code ndr_err;
+	char *errstring = NULL;
+	size_t num_sessions = 0;
+	int ret;
+
+	for (s = *sessions; s != NULL; s = s->next) {
+		if (s->global_catalog == global_catalog &&
+		    data_blob_cmp(&s->blob, &blob) == 0) {
+			DLIST_PROMOTE(*sessions, s);
+			return s;
+		}
+		num_sessions++;
+	}
+
+	if (num_sessions >= LDAPSRV_SEARCH_WORKER_MAX_SESSIONS) {
+		s = DLIST_TAIL(*sessions);
+		DLIST_REMOVE(*sessions, s);
+		TALLOC_FREE(s);
+	}
+
+	s = talloc_zero(mem_ctx, struct ldapsrv_search_worker_session);
+	if (s == NULL) {
+		return NULL;
+	}
+	s->global_catalog = global_catalog;
+
+	s->blob = data_blob_dup_talloc(s, blob);
+	if (s->blob.data == NULL) {
+		TALLOC_FREE(s);
+		return NULL;
+	}
+
+	s->session_info = talloc_zero(s, struct auth_session_info);
+	if (s->session_info == NULL) {
+		TALLOC_FREE(s);
+		return NULL;
+	}
+
+	ndr_err = ndr_pull_struct_blob(
+		&blob,
+		s->session_info,
+		s->session_info,
+		(ndr_pull_flags_fn_t)ndr_pull_auth_session_info);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_ERR("ndr_pull_auth_session_info failed: %s\n",
+			ndr_errstr(ndr_err));
+		TALLOC_FREE(s);
+		return NULL;
+	}
+
+	/*
+	 * The remote address is only used for auditing of
+	 * modifications and the netlogon attribute of base searches,
+	 * neither of which is done by the helpers
+	 */
+	ret = samdb_connect_url(s,
+				ev,
+				lp_ctx,
+				s->session_info,
+				global_catalog ? LDB_FLG_RDONLY : 0,
+				"sam.ldb",
+				NULL,
+				&s->ldb,
+				&errstring);
+	if (ret != LDB_SUCCESS) {
+		DBG_ERR("Failed to connect to sam.ldb: %s\n",
+			errstring != NULL ? errstring : ldb_strerror(ret));
+		TALLOC_FREE(s);
+		return NULL;
+	}
+
+	DLIST_ADD(*sessions, s);
+	return s;
+}
+
+/*
+ * Write one reply frame to the task process
+ */
+static NTSTATUS ldapsrv_search_worker_write_reply(int fd,
+						  struct ldapsrv_reply *reply,
+						  uint32_t flags)
+{
+	uint8_t hdr[8];
+	struct iovec iov[2];
+	ssize_t nwritten;
+
+	RSIVAL(hdr, 0, reply->blob.length + 4);
+	RSIVAL(hdr, 4, flags);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = reply->blob.data;
+	iov[1].iov_len = reply->blob.length;
+
+	/*
+	 * This blocks (and so pauses the search) while the task
+	 * process is not reading, see the comment at the top
+	 */
+	nwritten = write_data_iov(fd, iov, ARRAY_SIZE(iov));
+	if (nwritten == -1) {
+		return map_nt_error_from_unix_common(errno);
+	}
+
+	return NT_STATUS_OK;
+}
+
+static NTSTATUS ldapsrv_search_worker_send_reply(struct ldapsrv_call *call,
+						 struct ldapsrv_reply *reply,
+						 void *private_data)
+{
+	int *fd = (int *)private_data;
+
+	return ldapsrv_search_worker_write_reply(*fd, reply, 0);
+}
+
+static bool ldapsrv_search_worker_run(
+	TALLOC_CTX *mem_ctx,
+	struct ldapsrv_search_worker_session **sessions,
+	struct tevent_context *ev,
+	struct loadparm_context *lp_ctx,
+	int fd,
+	DATA_BLOB frame)
+{
+	struct ldapsrv_search_worker_session *s = NULL;
+	struct ldapsrv_connection *conn = NULL;
+	struct ldapsrv_call *call = NULL;
+	struct ldapsrv_reply *reply = NULL;
+	struct asn1_data *asn1 = NULL;
+	DATA_BLOB session;
+	DATA_BLOB request;
+	uint32_t flags;
+	uint32_t session_length;
+	NTSTATUS status;
+
+	flags = RIVAL(frame.data, 0);
+	session_length = RIVAL(frame.data, 4);
+	if (session_length > frame.length - 8) {
+		DBG_ERR("Invalid session length %"PRIu32"\n", session_length);
+		return false;
+	}
+	session = data_blob_const(frame.data + 8, session_length);
+	request = data_blob_const(frame.data + 8 + session_length,
+				  frame.length - 8 - session_length);
+
+	s = ldapsrv_search_worker_session(
+		mem_ctx,
+		sessions,
+		ev,
+		lp_ctx,
+		session,
+		flags & LDAPSRV_SEARCH_WORKER_GLOBAL_CATALOG);
+	if (s == NULL) {
+		return false;
+	}
+
+	conn = talloc_zero(mem_ctx, struct ldapsrv_connection);
+	if (conn == NULL) {
+		return false;
+	}
+	conn->lp_ctx = lp_ctx;
+	conn->session_info = s->session_info;
+	conn->ldb = s->ldb;
+	conn->global_catalog = flags & LDAPSRV_SEARCH_WORKER_GLOBAL_CATALOG;
+	conn->is_privileged = flags & LDAPSRV_SEARCH_WORKER_PRIVILEGED;
+	if (flags & LDAPSRV_SEARCH_WORKER_REFERRAL_LDAPS) {
+		conn->referral_scheme = LDAP_REFERRAL_SCHEME_LDAPS;
+	}
+	/* The task process already logged the authorization */
+	conn->authz_logged = true;
+
+	call = talloc_zero(conn, struct ldapsrv_call);
+	if (call == NULL) {
+		TALLOC_FREE(conn);
+		return false;
+	}
+	call->conn = conn;
+	call->send_reply = ldapsrv_search_worker_send_reply;
+	call->send_reply_private = &fd;
+
+	call->request = talloc(call, struct ldap_message);
+	asn1 = asn1_init(call);
+	if (call->request == NULL || asn1 == NULL) {
+		TALLOC_FREE(conn);
+		return false;
+	}
+	if (!asn1_load(asn1, request)) {
+		TALLOC_FREE(conn);
+		return false;
+	}
+	status = ldap_decode(asn1, samba_ldap_control_handlers(),
+			     call->request);
+	if (!NT_STATUS_IS_OK(status) ||
+	    call->request->type != LDAP_TAG_SearchRequest) {
+		DBG_ERR("Invalid search request: %s\n", nt_errstr(status));
+		TALLOC_FREE(conn);
+		return false;
+	}
+
+	status = ldapsrv_SearchRequest(call);
+	if (!NT_STATUS_IS_OK(status) || call->replies == NULL) {
+		DBG_ERR("ldapsrv_SearchRequest failed: %s\n",
+			nt_errstr(status));
+		TALLOC_FREE(conn);
+		return false;
+	}
+
+	/* The entries are already written, this is the SearchResultDone */
+	for (reply = call->replies; reply != NULL; reply = reply->next) {
+		status = ldapsrv_search_worker_write_reply(
+			fd,
+			reply,
+			(reply->next == NULL) ?
+			LDAPSRV_SEARCH_WORKER_LAST_REPLY : 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			TALLOC_FREE(conn);
+			return false;
+		}
+	}
+
+	TALLOC_FREE(conn);
+	return true;
+}
+
+static void ldapsrv_search_worker_main(struct loadparm_context *lp_ctx,
+				       int fd)
+{
+	TALLOC_CTX *mem_ctx = NULL;
+	struct tevent_context *ev = NULL;
+	struct ldapsrv_search_worker_session *sessions = NULL;
+
+	/*
+	 * The signal handlers inherited from the task belong to a
+	 * tevent loop this process never runs
+	 */
+	CatchSignal(SIGTERM, SIG_DFL);
+	CatchSignal(SIGHUP, SIG_IGN);
+
+	ldb_wrap_fork_hook();
+
+	mem_ctx = talloc_new(NULL);
+	if (mem_ctx == NULL) {
+		exit(1);
+	}
+
+	ev = s4_event_context_init(mem_ctx);
+	if (ev == NULL) {
+		exit(1);
+	}
+
+	while (true) {
+		uint8_t hdr[4];
+		DATA_BLOB frame;
+		size_t length;
+		ssize_t nread;
+		bool ok;
+
+		nread = read_data(fd, hdr, sizeof(hdr));
+		if (nread != sizeof(hdr)) {
+			/* The task process has gone away */
+			break;
+		}
+
+		length = RIVAL(hdr, 0);
+		if (length < 8 || length > LDAPSRV_SEARCH_WORKER_MAX_REQUEST) {
+			DBG_ERR("Invalid request length %zu\n", length);
+			break;
+		}
+
+		frame = data_blob_talloc(mem_ctx, NULL, length);
+		if (frame.data == NULL) {
+			break;
+		}
+
+		nread = read_data(fd, frame.data, length);
+		if (nread != (ssize_t)length) {
+			break;
+		}
+
+		ok = ldapsrv_search_worker_run(mem_ctx,
+					       &sessions,
+					       ev,
+					       lp_ctx,
+					       fd,
+					       frame);
+		data_blob_free(&frame);
+		if (!ok) {
+			break;
+		}
+	}
+
+	exit(0);
+}
+
+/*
+ * Task process side
+ */
+
+struct ldapsrv_search_worker_context {
+	struct ldapsrv_call *call;
+	DATA_BLOB frame;
+	/* The helper running the search, once started */
+	struct ldapsrv_search_worker *worker;
+	/* Some replies were already passed on to the client */
+	bool streamed;
+};
+
+struct ldapsrv_search_worker_wait_state {
+	struct ldapsrv_search_worker_wait_state *prev, *next;
+	struct tevent_req *req;
+	struct ldapsrv_search_pool *pool;
+	struct ldapsrv_search_worker *worker;
+	struct ldapsrv_search_worker_context *ctx;
+	struct ldapsrv_call *call;
+	DATA_BLOB frame;
+	bool queued;
+	struct ldapsrv_reply *replies;
+	size_t replies_size;
+};
+
+static void ldapsrv_search_pool_dispatch(struct ldapsrv_search_pool *pool);
+static void ldapsrv_search_pool_schedule_respawn(
+	struct ldapsrv_search_pool *pool);
+
+static void ldapsrv_search_worker_wait_cleanup(struct tevent_req *req,
+					       enum tevent_req_state req_state)
+{
+	struct ldapsrv_search_worker_wait_state *state =
+		tevent_req_data(req,
+		struct ldapsrv_search_worker_wait_state);
+
+	if (state->queued) {
+		DLIST_REMOVE(state->pool->pending, state);
+		state->queued = false;
+	}
+
+	if (state->worker != NULL) {
+		state->worker->req = NULL;
+		state->worker = NULL;
+	}
+}
+
+/*
+ * Run the search in the task process, when no helper is available
+ */
+static void ldapsrv_search_worker_local(struct tevent_req *req)
+{
+	struct ldapsrv_search_worker_wait_state *state =
+		tevent_req_data(req,
+		struct ldapsrv_search_worker_wait_state);
+	struct ldapsrv_reply *reply = NULL;
+	NTSTATUS status;
+
+	while ((reply = state->replies) != NULL) {
+		DLIST_REMOVE(state->replies, reply);
+		TALLOC_FREE(reply);
+	}
+
+	status = ldapsrv_SearchRequest(state->call);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+static void ldapsrv_search_worker_failed(struct ldapsrv_search_worker *worker,
+					 const char *reason)
+{
+	struct ldapsrv_search_pool *pool = worker->pool;
+	struct tevent_req *req = worker->req;
+
+	DBG_ERR("LDAP search worker %d failed: %s\n",
+		(int)worker->pid, reason);
+
+	DLIST_REMOVE(pool->workers, worker);
+	kill(worker->pid, SIGKILL);
+	waitpid(worker->pid, NULL, 0);
+
+	if (worker->ctx != NULL) {
+		worker->ctx->worker = NULL;
+		worker->ctx = NULL;
+	}
+
+	if (req != NULL) {
+		struct ldapsrv_search_worker_wait_state *state =
+			tevent_req_data(req,
+			struct ldapsrv_search_worker_wait_state);
+		state->worker = NULL;
+		worker->req = NULL;
+		if (state->ctx->streamed) {
+			/*
+			 * The client has part of the result already,
+			 * running the search again would repeat it
+			 */
+			tevent_req_nterror(req, NT_STATUS_CONNECTION_RESET);
+		} else {
+			ldapsrv_search_worker_local(req);
+		}
+	}
+
+	TALLOC_FREE(worker);
+
+	ldapsrv_search_pool_schedule_respawn(pool);
+
+	/* With no helper left the queued searches are run locally */
+	ldapsrv_search_pool_dispatch(pool);
+}
+
+static void ldapsrv_search_worker_write_done(struct tevent_req *subreq);
+
+static void ldapsrv_search_worker_start(
+	struct ldapsrv_search_worker *worker,
+	struct ldapsrv_search_worker_wait_state *state)
+{
+	struct tevent_req *subreq = NULL;
+
+	worker->busy = true;
+	worker->req = state->req;
+	worker->ctx = state->ctx;
+	state->worker = worker;
+	state->ctx->worker = worker;
+
+	/*
+	 * The frame belongs to the worker from now on, the call may
+	 * go away before it is written
+	 */
+	worker->frame = state->frame;
+	talloc_steal(worker, worker->frame.data);
+	state->frame = data_blob_null;
+
+	worker->iov.iov_base = worker->frame.data;
+	worker->iov.iov_len = worker->frame.length;
+
+	subreq = tstream_writev_send(worker,
+				     worker->pool->ev,
+				     worker->stream,
+				     &worker->iov, 1);
+	if (subreq == NULL) {
+		ldapsrv_search_worker_failed(worker,
+					     "tstream_writev_send failed");
+		return;
+	}
+	tevent_req_set_callback(subreq, ldapsrv_search_worker_write_done,
+				worker);
+}
+
+static NTSTATUS ldapsrv_search_worker_full_frame(void *private_data,
+						 DATA_BLOB blob,
+						 size_t *size)
+{
+	size_t length;
+
+	if (blob.length < 8) {
+		return STATUS_MORE_ENTRIES;
+	}
+
+	length = RIVAL(blob.data, 0);
+	if (length < 4 || length > LDAP_SERVER_MAX_REPLY_SIZE) {
+		return NT_STATUS_INVALID_BUFFER_SIZE;
+	}
+
+	*size = length + 4;
+	if (*size > blob.length) {
+		return STATUS_MORE_ENTRIES;
+	}
+
+	return NT_STATUS_OK;
+}
+
+static void ldapsrv_search_worker_read_done(struct tevent_req *subreq);
+
+static void ldapsrv_search_worker_pause_timeout(struct tevent_context *ev,
+						struct tevent_timer *te,
+						struct timeval current_time,
+						void *private_data)
+{
+	struct ldapsrv_search_worker *worker =
+		talloc_get_type_abort(private_data,
+		struct ldapsrv_search_worker);
+
+	worker->pause_te = NULL;
+	ldapsrv_search_worker_failed(worker, "client stopped reading");
+}
+
+static void ldapsrv_search_worker_read_next(
+	struct ldapsrv_search_worker *worker)
+{
+	struct tevent_req *subreq = NULL;
+
+	subreq = tstream_read_pdu_blob_send(worker,
+					    worker->pool->ev,
+					    worker->stream,
+					    8, /* initial_read_size */
+					    ldapsrv_search_worker_full_frame,
+					    NULL);
+	if (subreq == NULL) {
+		ldapsrv_search_worker_failed(worker,
+					     "tstream_read_pdu_blob_send "
+					     "failed");
+		return;
+	}
+	tevent_req_set_callback(subreq, ldapsrv_search_worker_read_done,
+				worker);
+}
+
+static void ldapsrv_search_worker_write_done(struct tevent_req *subreq)
+{
+	struct ldapsrv_search_worker *worker =
+		tevent_req_callback_data(subreq,
+		struct ldapsrv_search_worker);
+	int sys_errno;
+	int rc;
+
+	rc = tstream_writev_recv(subreq, &sys_errno);
+	TALLOC_FREE(subreq);
+	data_blob_free(&worker->frame);
+	if (rc == -1) {
+		ldapsrv_search_worker_failed(worker, strerror(sys_errno));
+		return;
+	}
+
+	ldapsrv_search_worker_read_next(worker);
+}
+
+/*
+ * Move the replies read so far to the call, to be written to the
+ * client
+ */
+static void ldapsrv_search_worker_pass_replies(
+	struct ldapsrv_search_worker_wait_state *state)
+{
+	struct ldapsrv_call *call = state->call;
+	struct ldapsrv_reply *reply = NULL;
+
+	while ((reply = state->replies) != NULL) {
+		DLIST_REMOVE(state->replies, reply);
+		talloc_steal(call, reply);
+		call->reply_size += reply->blob.length;
+		DLIST_ADD_END(call->replies, reply);
+	}
+	state->replies_size = 0;
+}
+
+static void ldapsrv_search_worker_read_done(struct tevent_req *subreq)
+{
+	struct ldapsrv_search_worker *worker =
+		tevent_req_callback_data(subreq,
+		struct ldapsrv_search_worker);
+	struct ldapsrv_search_pool *pool = worker->pool;
+	struct ldapsrv_search_worker_wait_state *state = NULL;
+	struct tevent_req *req = NULL;
+	struct ldapsrv_reply *reply = NULL;
+	DATA_BLOB blob;
+	uint32_t flags;
+	NTSTATUS status;
+
+	status = tstream_read_pdu_blob_recv(subreq, worker, &blob);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		ldapsrv_search_worker_failed(worker, nt_errstr(status));
+		return;
+	}
+
+	flags = RIVAL(blob.data, 4);
+
+	if (worker->req != NULL) {
+		state = tevent_req_data(worker->req,
+					struct ldapsrv_search_worker_wait_state);
+
+		reply = talloc_zero(state, struct ldapsrv_reply);
+		if (reply == NULL) {
+			data_blob_free(&blob);
+			ldapsrv_search_worker_failed(worker, "no memory");
+			return;
+		}
+		reply->blob = data_blob_talloc(reply,
+					       blob.data + 8,
+					       blob.length - 8);
+		if (reply->blob.data == NULL) {
+			data_blob_free(&blob);
+			ldapsrv_search_worker_failed(worker, "no memory");
+			return;
+		}
+		DLIST_ADD_END(state->replies, reply);
+		state->replies_size += reply->blob.length;
+	}
+	data_blob_free(&blob);
+
+	if (!(flags & LDAPSRV_SEARCH_WORKER_LAST_REPLY)) {
+		ssize_t pending = tstream_pending_bytes(worker->stream);
+
+		/*
+		 * Keep reading while the helper has more replies
+		 * ready, up to the watermark, then pass what we
+		 * have to the client.  Reading resumes once the
+		 * client has taken them.
+		 */
+		if (state == NULL ||
+		    (pending > 0 &&
+		     state->replies_size < LDAP_SERVER_STREAM_HIGH_WATERMARK)) {
+			ldapsrv_search_worker_read_next(worker);
+			return;
+		}
+
+		req = worker->req;
+		worker->req = NULL;
+		worker->paused = true;
+		state->worker = NULL;
+		state->ctx->streamed = true;
+		state->call->more_replies = true;
+
+		worker->pause_te = tevent_add_timer(
+			pool->ev,
+			worker,
+			timeval_current_ofs(
+				state->call->conn->limits.search_timeout, 0),
+			ldapsrv_search_worker_pause_timeout,
+			worker);
+		if (worker->pause_te == NULL) {
+			ldapsrv_search_worker_failed(worker, "no memory");
+			return;
+		}
+
+		ldapsrv_search_worker_pass_replies(state);
+		tevent_req_done(req);
+
+		ldapsrv_search_pool_dispatch(pool);
+		return;
+	}
+
+	req = worker->req;
+	worker->req = NULL;
+	worker->busy = false;
+	pool->respawn_delay = LDAPSRV_SEARCH_WORKER_RESPAWN_MIN;
+	if (worker->ctx != NULL) {
+		worker->ctx->worker = NULL;
+		worker->ctx = NULL;
+	}
+
+	if (req != NULL) {
+		state->worker = NULL;
+		ldapsrv_search_worker_pass_replies(state);
+		tevent_req_done(req);
+	}
+
+	ldapsrv_search_pool_dispatch(pool);
+}
+
+static void ldapsrv_search_pool_dispatch(struct ldapsrv_search_pool *pool)
+{
+	while (pool->pending != NULL) {
+		struct ldapsrv_search_worker_wait_state *state = pool->pending;
+		struct ldapsrv_search_worker *worker = NULL;
+
+		for (worker = pool->workers;
+		     worker != NULL;
+		     worker = worker->next) {
+			if (!worker->busy) {
+				break;
+			}
+		}
+		if (worker == NULL) {
+			/*
+			 * Only wait for a helper that is still
+			 * searching, not for clients slow to take
+			 * their replies
+			 */
+			for (worker = pool->workers;
+			     worker != NULL;
+			     worker = worker->next) {
+				if (!worker->paused) {
+					return;
+				}
+			}
+
+			DLIST_REMOVE(pool->pending, state);
+			state->queued = false;
+
+			ldapsrv_search_worker_local(state->req);
+			continue;
+		}
+
+		DLIST_REMOVE(pool->pending, state);
+		state->queued = false;
+
+		ldapsrv_search_worker_start(worker, state);
+	}
+}
+
+static struct tevent_req *ldapsrv_search_worker_wait_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	void *private_data)
+{
+	struct ldapsrv_search_worker_context *ctx =
+		talloc_get_type_abort(private_data,
+		struct ldapsrv_search_worker_context);
+	struct tevent_req *req = NULL;
+	struct ldapsrv_search_worker_wait_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct ldapsrv_search_worker_wait_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->req = req;
+	state->ctx = ctx;
+	state->call = ctx->call;
+	state->pool = ctx->call->conn->service->search_pool;
+
+	tevent_req_defer_callback(req, ev);
+	tevent_req_set_cleanup_fn(req, ldapsrv_search_worker_wait_cleanup);
+
+	if (ctx->worker != NULL) {
+		/*
+		 * The client has taken the replies so far, continue
+		 * reading from the helper
+		 */
+		struct ldapsrv_search_worker *worker = ctx->worker;
+
+		worker->paused = false;
+		TALLOC_FREE(worker->pause_te);
+		worker->req = req;
+		state->worker = worker;
+		ldapsrv_search_worker_read_next(worker);
+		if (!tevent_req_is_in_progress(req)) {
+			return tevent_req_post(req, ev);
+		}
+		return req;
+	}
+
+	if (ctx->streamed) {
+		/*
+		 * The helper was replaced before the search finished,
+		 * the client only has part of the result
+		 */
+		tevent_req_nterror(req, NT_STATUS_CONNECTION_RESET);
+		return tevent_req_post(req, ev);
+	}
+
+	state->frame = ctx->frame;
+	talloc_steal(state, state->frame.data);
+	ctx->frame = data_blob_null;
+
+	if (state->pool->workers == NULL) {
+		ldapsrv_search_worker_local(req);
+		return tevent_req_post(req, ev);
+	}
+
+	DLIST_ADD_END(state->pool->pending, state);
+	state->queued = true;
+
+	ldapsrv_search_pool_dispatch(state->pool);
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	return req;
+}
+
+static NTSTATUS ldapsrv_search_worker_wait_recv(struct tevent_req *req)
+{
+	return tevent_req_simple_recv_ntstatus(req);
+}
+
+/*
+ * Only searches that do not keep state in the ldb context of the
+ * connection are run in the helpers.  Base searches are cheap and
+ * include the rootDSE, which depends on the connection, so they are
+ * also done locally.
+ */
+bool ldapsrv_search_worker_eligible(struct ldapsrv_call *call)
+{
+	static const char * const local_oids[] = {
+		LDB_CONTROL_PAGED_RESULTS_OID,
+		LDB_CONTROL_VLV_REQ_OID,
+		LDB_CONTROL_NOTIFICATION_OID,
+	};
+	struct ldapsrv_service *service = call->conn->service;
+	struct ldap_message *msg = call->request;
+	unsigned int i, j;
+
+	if (service == NULL || service->search_pool == NULL) {
+		return false;
+	}
+	if (service->search_pool->workers == NULL) {
+		return false;
+	}
+	if (call->request_blob.length == 0) {
+		return false;
+	}
+	if (msg->r.SearchRequest.scope == LDAP_SEARCH_SCOPE_BASE) {
+		return false;
+	}
+
+	for (i = 0; msg->controls != NULL && msg->controls[i] != NULL; i++) {
+		for (j = 0; j < ARRAY_SIZE(local_oids); j++) {
+			if (strcmp(msg->controls[i]->oid, local_oids[j]) == 0) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * If the call goes away while reading from its helper is paused, the
+ * rest of the replies still need to be read and dropped
+ */
+static int ldapsrv_search_worker_context_destructor(
+	struct ldapsrv_search_worker_context *ctx)
+{
+	struct ldapsrv_search_worker *worker = ctx->worker;
+
+	if (worker == NULL) {
+		return 0;
+	}
+
+	ctx->worker = NULL;
+	worker->ctx = NULL;
+
+	if (worker->paused) {
+		worker->paused = false;
+		TALLOC_FREE(worker->pause_te);
+		ldapsrv_search_worker_read_next(worker);
+	}
+
+	return 0;
+}
+
+/*
+ * Hand a search request to the helpers.  The replies are collected
+ * in the wait phase of the call, so the task can process calls of
+ * other connections in the meantime.
+ */
+NTSTATUS ldapsrv_search_worker_queue(struct ldapsrv_call *call)
+{
+	struct ldapsrv_connection *conn = call->conn;
+	struct ldapsrv_search_worker_context *ctx = NULL;
+	DATA_BLOB session = data_blob_null;
+	enum ndr_err_code ndr_err;
+	uint32_t flags = 0;
+	size_t length;
+
+	if (call->wait_private != NULL) {
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+
+	ctx = talloc_zero(call, struct ldapsrv_search_worker_context);
+	if (ctx == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	ctx->call = call;
+	talloc_set_destructor(ctx, ldapsrv_search_worker_context_destructor);
+
+	ndr_err = ndr_push_struct_blob(
+		&session,
+		ctx,
+		conn->session_info,
+		(ndr_push_flags_fn_t)ndr_push_auth_session_info);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		TALLOC_FREE(ctx);
+		return ndr_map_error2ntstatus(ndr_err);
+	}
+
+	if (conn->global_catalog) {
+		flags |= LDAPSRV_SEARCH_WORKER_GLOBAL_CATALOG;
+	}
+	if (conn->is_privileged) {
+		flags |= LDAPSRV_SEARCH_WORKER_PRIVILEGED;
+	}
+	if (conn->referral_scheme == LDAP_REFERRAL_SCHEME_LDAPS) {
+		flags |= LDAPSRV_SEARCH_WORKER_REFERRAL_LDAPS;
+	}
+
+	length = 12 + session.length + call->request_blob.length;
+	if (length - 4 > LDAPSRV_SEARCH_WORKER_MAX_REQUEST) {
+		/* Too large for the helpers, do it ourselves */
+		TALLOC_FREE(ctx);
+		return ldapsrv_SearchRequest(call);
+	}
+
+	ctx->frame = data_blob_talloc(ctx, NULL, length);
+	if (ctx->frame.data == NULL) {
+		TALLOC_FREE(ctx);
+		return NT_STATUS_NO_MEMORY;
+	}
+	RSIVAL(ctx->frame.data, 0, length - 4);
+	RSIVAL(ctx->frame.data, 4, flags);
+	RSIVAL(ctx->frame.data, 8, session.length);
+	memcpy(ctx->frame.data + 12, session.data, session.length);
+	memcpy(ctx->frame.data + 12 + session.length,
+	       call->request_blob.data,
+	       call->request_blob.length);
+	data_blob_free(&session);
+	data_blob_free(&call->request_blob);
+
+	call->wait_private = ctx;
+	call->wait_send = ldapsrv_search_worker_wait_send;
+	call->wait_recv = ldapsrv_search_worker_wait_recv;
+	return NT_STATUS_OK;
+}
+
+/*
+ * A helper replacing one that died is forked while the task serves
+ * clients.  It must not keep their connections (or the listening
+ * sockets) open, so close every socket but the one to the task.
+ */
+static void ldapsrv_search_worker_close_sockets(int keep_fd)
+{
+	DIR *dir = NULL;
+	struct dirent *de = NULL;
+	int dir_fd;
+
+	dir = opendir("/proc/self/fd");
+	if (dir == NULL) {
+		return;
+	}
+	dir_fd = dirfd(dir);
+
+	while ((de = readdir(dir)) != NULL) {
+		struct stat st;
+		int fd;
+
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		fd = atoi(de->d_name);
+		if (fd <= 2 || fd == keep_fd || fd == dir_fd) {
+			continue;
+		}
+		if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) {
+			close(fd);
+		}
+	}
+
+	closedir(dir);
+}
+
+static struct ldapsrv_search_worker *ldapsrv_search_worker_spawn(
+	struct ldapsrv_search_pool *pool,
+	struct loadparm_context *lp_ctx)
+{
+	struct ldapsrv_search_worker *worker = NULL;
+	int fds[2];
+	int ret;
+
+	worker = talloc_zero(pool, struct ldapsrv_search_worker);
+	if (worker == NULL) {
+		return NULL;
+	}
+	worker->pool = pool;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	if (ret == -1) {
+		DBG_ERR("socketpair failed: %s\n", strerror(errno));
+		TALLOC_FREE(worker);
+		return NULL;
+	}
+
+	worker->pid = fork();
+	if (worker->pid == -1) {
+		DBG_ERR("fork failed: %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		TALLOC_FREE(worker);
+		return NULL;
+	}
+
+	if (worker->pid == 0) {
+		close(fds[0]);
+		ldapsrv_search_worker_close_sockets(fds[1]);
+		ldapsrv_search_worker_main(lp_ctx, fds[1]);
+		exit(0);
+	}
+
+	close(fds[1]);
+
+	set_blocking(fds[0], false);
+	ret = tstream_bsd_existing_socket(worker, fds[0], &worker->stream);
+	if (ret == -1) {
+		DBG_ERR("tstream_bsd_existing_socket failed: %s\n",
+			strerror(errno));
+		close(fds[0]);
+		kill(worker->pid, SIGKILL);
+		waitpid(worker->pid, NULL, 0);
+		TALLOC_FREE(worker);
+		return NULL;
+	}
+
+	DLIST_ADD_END(pool->workers, worker);
+	return worker;
+}
+
+static void ldapsrv_search_pool_respawn(struct tevent_context *ev,
+					struct tevent_timer *te,
+					struct timeval current_time,
+					void *private_data)
+{
+	struct ldapsrv_search_pool *pool =
+		talloc_get_type_abort(private_data,
+		struct ldapsrv_search_pool);
+	struct ldapsrv_search_worker *worker = NULL;
+	int num_workers = 0;
+	int num_started = 0;
+
+	TALLOC_FREE(pool->respawn_te);
+
+	for (worker = pool->workers; worker != NULL; worker = worker->next) {
+		num_workers++;
+	}
+
+	while (num_workers < pool->num_workers) {
+		worker = ldapsrv_search_worker_spawn(pool, pool->lp_ctx);
+		if (worker == NULL) {
+			break;
+		}
+		num_workers++;
+		num_started++;
+	}
+
+	DBG_NOTICE("Started %d LDAP search workers, %d running\n",
+		   num_started, num_workers);
+
+	if (num_workers < pool->num_workers) {
+		ldapsrv_search_pool_schedule_respawn(pool);
+	}
+
+	ldapsrv_search_pool_dispatch(pool);
+}
+
+/*
+ * Replace the helpers that died, after a delay that grows while the
+ * new ones keep dying before they finish a search
+ */
+static void ldapsrv_search_pool_schedule_respawn(
+	struct ldapsrv_search_pool *pool)
+{
+	if (pool->respawn_te != NULL) {
+		return;
+	}
+
+	pool->respawn_te = tevent_add_timer(
+		pool->ev,
+		pool,
+		timeval_current_ofs(pool->respawn_delay, 0),
+		ldapsrv_search_pool_respawn,
+		pool);
+	if (pool->respawn_te == NULL) {
+		DBG_ERR("Failed to schedule a new LDAP search worker\n");
+		return;
+	}
+
+	pool->respawn_delay = MIN(pool->respawn_delay * 2,
+				  LDAPSRV_SEARCH_WORKER_RESPAWN_MAX);
+}
+
+static bool ldapsrv_search_workers_supported(struct ldb_context *sam_ctx)
+{
+	static const char * const attrs[] = { "backendStore", NULL };
+	TALLOC_CTX *tmp_ctx = NULL;
+	struct ldb_result *res = NULL;
+	struct ldb_dn *dn = NULL;
+	const char *backend_store = NULL;
+	bool supported = false;
+	int ret;
+
+	tmp_ctx = talloc_new(sam_ctx);
+	if (tmp_ctx == NULL) {
+		return false;
+	}
+
+	dn = ldb_dn_new(tmp_ctx, sam_ctx, "@PARTITION");
+	if (dn == NULL) {
+		TALLOC_FREE(tmp_ctx);
+		return false;
+	}
+
+	ret = ldb_search(sam_ctx, tmp_ctx, &res, dn, LDB_SCOPE_BASE,
+			 attrs, NULL);
+	if (ret == LDB_SUCCESS && res->count == 1) {
+		backend_store = ldb_msg_find_attr_as_string(res->msgs[0],
+							    "backendStore",
+							    "tdb");
+		supported = (strcmp(backend_store, "mdb") == 0);
+	}
+
+	TALLOC_FREE(tmp_ctx);
+	return supported;
+}
+
+/*
+ * Start the search helpers of a task, called after the task has forked
+ * and before it accepts any connection, so the helpers do not inherit
+ * client sockets.
+ */
+void ldapsrv_search_workers_init(struct ldapsrv_service *ldap_service)
+{
+	struct task_server *task = ldap_service->task;
+	struct ldapsrv_search_pool *pool = NULL;
+	int num_workers;
+	int i;
+
+	num_workers = lpcfg_ldap_server_search_workers(task->lp_ctx);
+	if (num_workers <= 0) {
+		return;
+	}
+
+	/*
+	 * The standard process model already serves every connection
+	 * from a process of its own, which would all share the helpers
+	 */
+	if (strcmp(task->model_ops->name, "standard") == 0) {
+		DBG_NOTICE("ldap server search workers are not used with "
+			   "the standard process model\n");
+		return;
+	}
+
+	/*
+	 * Concurrent searches only help when readers do not block
+	 * each other and the writer, as with LMDB
+	 */
+	if (!ldapsrv_search_workers_supported(ldap_service->sam_ctx)) {
+		DBG_NOTICE("ldap server search workers require the mdb "
+			   "backend store\n");
+		return;
+	}
+
+	pool = talloc_zero(ldap_service, struct ldapsrv_search_pool);
+	if (pool == NULL) {
+		return;
+	}
+	pool->ev = task->event_ctx;
+	pool->lp_ctx = task->lp_ctx;
+	pool->num_workers = num_workers;
+	pool->respawn_delay = LDAPSRV_SEARCH_WORKER_RESPAWN_MIN;
+
+	for (i = 0; i < num_workers; i++) {
+		struct ldapsrv_search_worker *worker = NULL;
+
+		worker = ldapsrv_search_worker_spawn(pool, task->lp_ctx);
+		if (worker == NULL) {
+			break;
+		}
+	}
+
+	if (pool->workers == NULL) {
+		TALLOC_FREE(pool);
+		return;
+	}
+
+	DBG_NOTICE("Started %d LDAP search workers\n", i);
+	ldap_service->search_pool = pool;
+}
@@ -584,8 +584,12 @@ static void ldapsrv_call_read_done(struct tevent_req *subreq)
 		return;
 	}
 
-	data_blob_free(&blob);
-
+	/* Kept only if the search will be passed to a search worker */
+	call->request_blob = blob;
+	if (call->request->type != LDAP_TAG_SearchRequest ||
+	    !ldapsrv_search_worker_eligible(call)) {
+		data_blob_free(&call->request_blob);
+	}
 
 	/* queue the call in the global queue */
 	subreq = ldapsrv_process_call_send(call,
@@ -600,6 +604,7 @@ static void ldapsrv_call_read_done(struct tevent_req *subreq)
 	conn->active_call = subreq;
 }
 
+static void ldapsrv_call_wait_start(struct ldapsrv_call *call);
 static void ldapsrv_call_wait_done(struct tevent_req *subreq);
 static void ldapsrv_call_writev_start(struct ldapsrv_call *call);
 static void ldapsrv_call_writev_done(struct tevent_req *subreq);
@@ -622,25 +627,35 @@ static void ldapsrv_call_process_done(struct tevent_req *subreq)
 	}
 
 	if (call->wait_send != NULL) {
-		subreq = call->wait_send(call,
-					 conn->connection->event.ctx,
-					 call->wait_private);
-		if (subreq == NULL) {
-			ldapsrv_terminate_connection(conn,
-					"ldapsrv_call_process_done: "
-					"call->wait_send - no memory");
-			return;
-		}
-		tevent_req_set_callback(subreq,
-					ldapsrv_call_wait_done,
-					call);
-		conn->active_call = subreq;
+		ldapsrv_call_wait_start(call);
 		return;
 	}
 
 	ldapsrv_call_writev_start(call);
 }
 
+static void ldapsrv_call_wait_start(struct ldapsrv_call *call)
+{
+	struct ldapsrv_connection *conn = call->conn;
+	struct tevent_req *subreq = NULL;
+
+	call->more_replies = false;
+
+	subreq = call->wait_send(call,
+				 conn->connection->event.ctx,
+				 call->wait_private);
+	if (subreq == NULL) {
+		ldapsrv_terminate_connection(conn,
+				"ldapsrv_call_wait_start: "
+				"call->wait_send - no memory");
+		return;
+	}
+	tevent_req_set_callback(subreq,
+				ldapsrv_call_wait_done,
+				call);
+	conn->active_call = subreq;
+}
+
 static void ldapsrv_call_wait_done(struct tevent_req *subreq)
 {
 	struct ldapsrv_call *call =
@@ -705,6 +720,11 @@ static void ldapsrv_call_writev_start(struct ldapsrv_call *call)
 	}
 
 	if (length == 0) {
+		if (call->more_replies) {
+			ldapsrv_call_wait_start(call);
+			return;
+		}
+
 		if (!call->notification.busy) {
 			TALLOC_FREE(call);
 		}
@@ -814,6 +834,12 @@ static void ldapsrv_call_writev_done(struct tevent_req *subreq)
 		return;
 	}
 
+	/* Or more to wait for, now the client has taken these */
+	if (call->more_replies) {
+		ldapsrv_call_wait_start(call);
+		return;
+	}
+
 	if (!call->notification.busy) {
 		TALLOC_FREE(call);
 	}
@@ -1360,6 +1386,8 @@ static void ldapsrv_post_fork(struct task_server *task, struct process_details *
 				      true);
 		return;
 	}
+
+	ldapsrv_search_workers_init(ldap_service);
 }
 
 NTSTATUS server_service_ldap_init(TALLOC_CTX *ctx)
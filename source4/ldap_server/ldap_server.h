@@ -73,6 +73,8 @@ struct ldapsrv_call {
 	struct ldapsrv_call *prev, *next;
 	struct ldapsrv_connection *conn;
 	struct ldap_message *request;
+	/* The encoded search request, for the search workers */
+	DATA_BLOB request_blob;
 	struct ldapsrv_reply {
 		struct ldapsrv_reply *prev, *next;
 		struct ldap_message *msg;
@@ -94,6 +96,22 @@ struct ldapsrv_call {
 	NTSTATUS (*postprocess_recv)(struct tevent_req *req);
 	void *postprocess_private;
 
+	/*
+	 * Set by a wait_send implementation that finished before all
+	 * the replies of the call were available.  The replies so far
+	 * are written and then the call waits again for the rest.
+	 */
+	bool more_replies;
+
+	/*
+	 * If set, replies are passed to this as they are produced,
+	 * rather than collected on the replies list
+	 */
+	NTSTATUS (*send_reply)(struct ldapsrv_call *call,
+			       struct ldapsrv_reply *reply,
+			       void *private_data);
+	void *send_reply_private;
+
 	struct {
 		bool busy;
 		uint64_t generation;
@@ -111,6 +129,12 @@ struct ldapsrv_call {
  */
 #define LDAP_SERVER_MAX_CHUNK_SIZE ((size_t)(25 * 1024 * 1024))
 
+/*
+ * Bytes of replies read from a search helper before they are written
+ * to the client, rather than reading more
+ */
+#define LDAP_SERVER_STREAM_HIGH_WATERMARK ((size_t)(1024 * 1024))
+
 struct ldapsrv_service {
 	struct tstream_tls_params *tls_params;
 	struct task_server *task;
@@ -122,6 +146,7 @@ struct ldapsrv_service {
 	} notification;
 
 	struct ldb_context *sam_ctx;
+	struct ldapsrv_search_pool *search_pool;
 };
 
 #include "ldap_server/proto.h"
@@ -69,6 +69,11 @@ struct drsuapi_getncchanges_state {
 	struct drsuapi_DsReplicaHighWaterMark final_hwm;
 	struct drsuapi_DsReplicaCursor2CtrEx *final_udv;
 	struct drsuapi_DsReplicaLinkedAttribute *la_list;
+	/*
+	 * the sort keys for la_list, worked out as each link is added
+	 * so a chunk of links can be sorted without parsing them again
+	 */
+	struct la_for_sorting *la_sort_keys;
 	uint32_t la_count;
 	uint32_t la_idx;
 
@@ -77,7 +82,12 @@ struct drsuapi_getncchanges_state {
 	uint32_t total_links;
 };
 
-/* We must keep the GUIDs in NDR form for sorting */
+/*
+ * We must keep the GUIDs in NDR form for sorting.
+ *
+ * In drsuapi_getncchanges_state.la_sort_keys only the GUIDs are
+ * valid, link is filled in by getncchanges_get_sorted_array().
+ */
 struct la_for_sorting {
 	const struct drsuapi_DsReplicaLinkedAttribute *link;
 	uint8_t target_guid[DRS_GUID_SIZE];
@@ -732,18 +742,39 @@ static WERROR get_nc_changes_add_la(TALLOC_CTX *mem_ctx,
 				    const struct ldb_message *msg,
 				    struct dsdb_dn *dsdb_dn,
 				    struct drsuapi_DsReplicaLinkedAttribute **la_list,
+				    struct la_for_sorting **la_sort_keys,
 				    uint32_t *la_count,
 				    bool is_schema_nc)
 {
 	struct drsuapi_DsReplicaLinkedAttribute *la;
+	struct la_for_sorting *sort_key;
+	const struct ldb_val *target_guid;
 	bool active;
 	NTSTATUS status;
 	WERROR werr;
+	enum ndr_err_code ndr_err;
+	DATA_BLOB source_guid;
 
-	(*la_list) = talloc_realloc(mem_ctx, *la_list, struct drsuapi_DsReplicaLinkedAttribute, (*la_count)+1);
-	W_ERROR_HAVE_NO_MEMORY(*la_list);
+	/*
+	 * A large group can have a great many links, so grow the list
+	 * geometrically rather than one link at a time
+	 */
+	if (*la_count >= talloc_array_length(*la_list)) {
+		uint32_t alloc_count = MAX(16, (*la_count) * 2);
+
+		(*la_list) = talloc_realloc(mem_ctx, *la_list,
+					    struct drsuapi_DsReplicaLinkedAttribute,
+					    alloc_count);
+		W_ERROR_HAVE_NO_MEMORY(*la_list);
+
+		(*la_sort_keys) = talloc_realloc(mem_ctx, *la_sort_keys,
+						 struct la_for_sorting,
+						 alloc_count);
+		W_ERROR_HAVE_NO_MEMORY(*la_sort_keys);
+	}
 
 	la = &(*la_list)[*la_count];
+	sort_key = &(*la_sort_keys)[*la_count];
 
 	la->identifier = get_object_identifier(*la_list, msg);
 	W_ERROR_HAVE_NO_MEMORY(la->identifier);
@@ -842,6 +873,27 @@ static WERROR get_nc_changes_add_la(TALLOC_CTX *mem_ctx,
 	werr = dsdb_dn_la_to_blob(sam_ctx, sa, schema, *la_list, dsdb_dn, &la->value.blob);
 	W_ERROR_NOT_OK_RETURN(werr);
 
+	/* Keep the target and source GUIDs in NDR form for sorting */
+	target_guid = ldb_dn_get_extended_component(dsdb_dn->dn, "GUID");
+	if (target_guid == NULL
+			|| target_guid->length != sizeof(sort_key->target_guid)) {
+		DEBUG(0,(__location__ ": Bad la guid in linked attribute '%s' in '%s'\n",
+			 sa->lDAPDisplayName, ldb_dn_get_linearized(msg->dn)));
+		return WERR_DS_DRA_INTERNAL_ERROR;
+	}
+	memcpy(sort_key->target_guid, target_guid->data,
+	       sizeof(sort_key->target_guid));
+
+	source_guid.data = sort_key->source_guid;
+	source_guid.length = sizeof(sort_key->source_guid);
+	ndr_err = ndr_push_struct_into_fixed_blob(&source_guid,
+			&la->identifier->guid,
+			(ndr_push_flags_fn_t)ndr_push_GUID);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		return WERR_DS_DRA_INTERNAL_ERROR;
+	}
+	sort_key->link = NULL;
+
 	(*la_count)++;
 	return WERR_OK;
 }
@@ -859,6 +911,7 @@ static WERROR get_nc_changes_add_links(struct ldb_context *sam_ctx,
 				       uint32_t replica_flags,
 				       const struct ldb_message *msg,
 				       struct drsuapi_DsReplicaLinkedAttribute **la_list,
+				       struct la_for_sorting **la_sort_keys,
 				       uint32_t *la_count,
 				       struct drsuapi_DsReplicaCursorCtrEx *uptodateness_vector)
 {
@@ -952,7 +1005,8 @@ static WERROR get_nc_changes_add_links(struct ldb_context *sam_ctx,
 
 			werr = get_nc_changes_add_la(mem_ctx, sam_ctx, schema,
 						     sa, msg, dsdb_dn, la_list,
-						     la_count, is_schema_nc);
+						     la_sort_keys, la_count,
+						     is_schema_nc);
 			if (!W_ERROR_IS_OK(werr)) {
 				talloc_free(tmp_ctx);
 				return werr;
@@ -1018,6 +1072,8 @@ struct drsuapi_changed_objects {
 	struct ldb_dn *dn;
 	struct GUID guid;
 	uint64_t usn;
+	/* worked out once, rather than on every comparison */
+	bool is_nc_root;
 };
 
 /*
@@ -1027,15 +1083,11 @@ static int site_res_cmp_usn_order(struct drsuapi_changed_objects *m1,
 				  struct drsuapi_changed_objects *m2,
 				  struct drsuapi_getncchanges_state *getnc_state)
 {
-	int ret;
-
-	ret = ldb_dn_compare(getnc_state->ncRoot_dn, m1->dn);
-	if (ret == 0) {
+	if (m1->is_nc_root) {
 		return -1;
 	}
 
-	ret = ldb_dn_compare(getnc_state->ncRoot_dn, m2->dn);
-	if (ret == 0) {
+	if (m2->is_nc_root) {
 		return 1;
 	}
 
@@ -2017,18 +2069,17 @@ static WERROR dcesrv_drsuapi_obj_cache_exists(struct db_context *obj_cache,
 
 /**
  * Copies the la_list specified into a sorted array, ready to be sent in a
- * GetNCChanges response.
+ * GetNCChanges response. The sort keys were worked out (once) by
+ * get_nc_changes_add_la() when the links were added.
  */
 static WERROR getncchanges_get_sorted_array(const struct drsuapi_DsReplicaLinkedAttribute *la_list,
+					    const struct la_for_sorting *la_sort_keys,
 					    const uint32_t link_count,
-					    struct ldb_context *sam_ctx,
 					    TALLOC_CTX *mem_ctx,
-					    const struct dsdb_schema *schema,
 					    struct la_for_sorting **ret_array)
 {
-	int j;
+	uint32_t j;
 	struct la_for_sorting *guid_array;
-	WERROR werr = WERR_OK;
 
 	*ret_array = NULL;
 	guid_array = talloc_array(mem_ctx, struct la_for_sorting, link_count);
@@ -2038,57 +2089,15 @@ static WERROR getncchanges_get_sorted_array(const struct drsuapi_DsReplicaLinked
 	}
 
 	for (j = 0; j < link_count; j++) {
-
-		/* we need to get the target GUIDs to compare */
-		struct dsdb_dn *dn;
-		const struct drsuapi_DsReplicaLinkedAttribute *la = &la_list[j];
-		const struct dsdb_attribute *schema_attrib;
-		const struct ldb_val *target_guid;
-		DATA_BLOB source_guid;
-		TALLOC_CTX *frame = talloc_stackframe();
-		NTSTATUS status;
-
-		schema_attrib = dsdb_attribute_by_attributeID_id(schema, la->attid);
-
-		werr = dsdb_dn_la_from_blob(sam_ctx, schema_attrib, schema, frame, la->value.blob, &dn);
-		if (!W_ERROR_IS_OK(werr)) {
-			DEBUG(0,(__location__ ": Bad la blob in sort\n"));
-			TALLOC_FREE(frame);
-			return werr;
-		}
-
-		/* Extract the target GUID in NDR form */
-		target_guid = ldb_dn_get_extended_component(dn->dn, "GUID");
-		if (target_guid == NULL
-				|| target_guid->length != sizeof(guid_array[0].target_guid)) {
-			status = NT_STATUS_OBJECT_NAME_NOT_FOUND;
-		} else {
-			/* Repack the source GUID as NDR for sorting */
-			status = GUID_to_ndr_blob(&la->identifier->guid,
-						  frame,
-						  &source_guid);
-		}
-
-		if (!NT_STATUS_IS_OK(status)
-				|| source_guid.length != sizeof(guid_array[0].source_guid)) {
-			DEBUG(0,(__location__ ": Bad la guid in sort\n"));
-			TALLOC_FREE(frame);
-			return ntstatus_to_werror(status);
-		}
-
+		guid_array[j] = la_sort_keys[j];
 		guid_array[j].link = &la_list[j];
-		memcpy(guid_array[j].target_guid, target_guid->data,
-		       sizeof(guid_array[j].target_guid));
-		memcpy(guid_array[j].source_guid, source_guid.data,
-		       sizeof(guid_array[j].source_guid));
-		TALLOC_FREE(frame);
 	}
 
 	TYPESAFE_QSORT(guid_array, link_count, linked_attribute_compare);
 
 	*ret_array = guid_array;
 
-	return werr;
+	return WERR_OK;
 }
 
 
@@ -3132,6 +3141,9 @@ allowed:
 			changes[i].dn = search_res->msgs[i]->dn;
 			changes[i].guid = samdb_result_guid(search_res->msgs[i], "objectGUID");
 			changes[i].usn = ldb_msg_find_attr_as_uint64(search_res->msgs[i], "uSNChanged", 0);
+			changes[i].is_nc_root =
+				ldb_dn_compare(getnc_state->ncRoot_dn,
+					       changes[i].dn) == 0;
 
 			if (changes[i].usn > getnc_state->max_usn) {
 				getnc_state->max_usn = changes[i].usn;
@@ -3370,6 +3382,7 @@ allowed:
 						req10->replica_flags,
 						msg,
 						&getnc_state->la_list,
+						&getnc_state->la_sort_keys,
 						&getnc_state->la_count,
 						req10->uptodateness_vector);
 		if (!W_ERROR_IS_OK(werr)) {
@@ -3485,9 +3498,9 @@ allowed:
 		 * in sorted array, ready to send
 		 */
 		werr = getncchanges_get_sorted_array(&getnc_state->la_list[getnc_state->la_idx],
+						     &getnc_state->la_sort_keys[getnc_state->la_idx],
 						     link_count,
-						     sam_ctx, getnc_state,
-						     schema,
+						     getnc_state,
 						     &la_sorted);
 		if (!W_ERROR_IS_OK(werr)) {
 			return werr;
@@ -3519,6 +3532,7 @@ allowed:
 			 */
 			talloc_steal(mem_ctx, getnc_state->la_list);
 			getnc_state->la_list = NULL;
+			TALLOC_FREE(getnc_state->la_sort_keys);
 			getnc_state->la_idx = 0;
 			getnc_state->la_count = 0;
 		}
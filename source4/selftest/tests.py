@@ -1261,6 +1261,13 @@ for env in ["ktest", "ad_member", "ad_dc_no_ntlm"]:
                            extra_path=[os.path.join(srcdir(), 'python/samba/tests')],
                            name="samba.tests.ntlmdisabled.python(%s)" % env)
 
+# ad_dc_no_ntlm has "auth:logon stamp interval = 5"
+plantestsuite_loadlist("samba4.ldap.login_stamps.python(ad_dc_no_ntlm)", "ad_dc_no_ntlm",
+                       [python, os.path.join(DSDB_PYTEST_DIR, "login_stamps.py"),
+                        "$SERVER", '-U"$USERNAME%$PASSWORD"', "-W$DOMAIN", "--realm=$REALM",
+                        "-k", "yes", "--logon-stamp-interval=5",
+                        '$LOADLIST', '$LISTOPT'])
+
 # Demote the vampire DC, it must be the last test each DC, before the dbcheck
 for env in ['vampire_dc', 'promoted_dc', 'rodc']:
     planoldpythontestsuite(env, "samba.tests.samba_tool.demote",
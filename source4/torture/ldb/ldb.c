@@ -1744,6 +1744,64 @@ static bool torture_ldb_unpack_and_filter(struct torture_context *torture,
 	return true;
 }
 
+static bool torture_ldb_unpack_attrs(struct torture_context *torture,
+				     const void *data_p)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(torture);
+	struct ldb_context *ldb;
+	struct ldb_val data = *discard_const_p(struct ldb_val, data_p);
+	struct ldb_message *unpack_msg = ldb_msg_new(mem_ctx);
+	struct ldb_message *msg = ldb_msg_new(mem_ctx);
+	const char *lookup_names[] = {"instanceType", "nonexistent",
+				      "whenChanged", "objectClass",
+				      "uSNCreated", "showInAdvancedViewOnly",
+				      "name", "cnNotHere", NULL};
+	const char *ldif_text;
+	struct ldb_ldif ldif;
+	uint32_t format;
+
+	ldb = samba_ldb_init(mem_ctx, torture->ev, NULL, NULL, NULL);
+	torture_assert(torture,
+		       ldb != NULL,
+		       "Failed to init samba");
+
+	torture_assert_int_equal(torture,
+				 ldb_unpack_get_format(&data, &format),
+				 0, "ldb_unpack_get_format failed");
+
+	torture_assert_int_equal(torture,
+				 ldb_unpack_data_flags_attrs(ldb, &data,
+					unpack_msg,
+					LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC,
+					lookup_names),
+				 0, "ldb_unpack_data_flags_attrs failed");
+
+	/* Only the V2 format can skip elements */
+	if (format == LDB_PACKING_FORMAT_V2) {
+		torture_assert_int_equal(torture, unpack_msg->num_elements, 6,
+					 "Got wrong count of elements");
+	} else {
+		torture_assert_int_equal(torture, unpack_msg->num_elements, 13,
+					 "Got wrong count of elements");
+	}
+
+	msg->dn = talloc_steal(msg, unpack_msg->dn);
+
+	torture_assert_int_equal(torture,
+				 ldb_filter_attrs(ldb, unpack_msg,
+						  lookup_names, msg),
+				 0, "ldb_filter_attrs failed");
+
+	ldif.changetype = LDB_CHANGETYPE_NONE;
+	ldif.msg = msg;
+	ldif_text = ldb_ldif_write_string(ldb, mem_ctx, &ldif);
+
+	torture_assert_str_equal(torture, ldif_text, dda1d01d_ldif_reduced,
+				 "Expected fields did not match");
+
+	return true;
+}
+
 struct torture_suite *torture_ldb(TALLOC_CTX *mem_ctx)
 {
 	int i;
@@ -1787,6 +1845,9 @@ struct torture_suite *torture_ldb(TALLOC_CTX *mem_ctx)
 			talloc_asprintf(mem_ctx,
 					"unpack-data-and-filter-v%d", i+1),
 			torture_ldb_unpack_and_filter, &bins[i]);
+		torture_suite_add_simple_tcase_const(suite,
+			talloc_asprintf(mem_ctx, "unpack-data-attrs-v%d", i+1),
+			torture_ldb_unpack_attrs, &bins[i]);
 	}
 
 	suite->description = talloc_strdup(suite, "LDB (samba-specific behaviour) tests");
@@ -76,6 +76,7 @@
 	torture_ldb,
 	torture_dsdb_dn,
 	torture_dsdb_syntax,
+	torture_dsdb_schema_lookup,
 	torture_registry,
 	torture_local_verif_trailer,
 	torture_local_nss,